@@ -0,0 +1,463 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright (C) 2023, Google LLC
+ *
+ * Userspace simulator of the State Machine of the Pogo management driver
+ *
+ * Replays scenarios through the State Machine core of pogo_transport_sm.h on the fake board of
+ * pogo_transport_sm_fake.h, at full speed and without the hardware, and reports per scenario:
+ *  - transitions and dispatches per second
+ *  - the distribution of the number of states entered per step, and the worst case
+ *  - the side effects of one pass: GPIO writes, regulator toggles, VOUT votes, IRQ toggles, extcon
+ *    changes, data path switches and polarity updates
+ *
+ * Without files, the built-in scenarios run, including a random walk over the inputs. A scenario
+ * file has one step per line, '#' starts a comment:
+ *	pogo <0|1>		edge of the pogo line, 1 docked
+ *	acc <0|1>		edge of the accessory line
+ *	wait <ms>		let time pass, running the debounce timers that expire
+ *	input <NAME>		feed an input of pogo_inputs[], e.g. USBC_HOST_ON
+ *	force_pogo <0|1>	set force_pogo
+ *	mfg <0|1>		set mfg_acc_test
+ *	ss_udev <0|1>		a superspeed device is enumerated behind the hub
+ *	expect <STATE>		check the state of pogo_states[]
+ *
+ * Build with "make sim".
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pogo_transport_sm_fake.h"
+
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+
+#define SIM_ITERATIONS		100000
+#define SIM_RANDOM_STEPS	1000
+/* Path lengths above this land in the last bucket */
+#define SIM_PATH_BUCKETS	8
+
+enum sim_op {
+	OP_POGO,
+	OP_ACC,
+	OP_WAIT,
+	OP_INPUT,
+	OP_FORCE_POGO,
+	OP_MFG,
+	OP_SS_UDEV,
+	OP_EXPECT,
+};
+
+static const char * const sim_ops[] = {
+	[OP_POGO] = "pogo",
+	[OP_ACC] = "acc",
+	[OP_WAIT] = "wait",
+	[OP_INPUT] = "input",
+	[OP_FORCE_POGO] = "force_pogo",
+	[OP_MFG] = "mfg",
+	[OP_SS_UDEV] = "ss_udev",
+	[OP_EXPECT] = "expect",
+};
+
+struct sim_step {
+	enum sim_op op;
+	unsigned int arg;
+	unsigned int line;
+};
+
+struct sim_scenario {
+	const char *name;
+	struct sim_step *steps;
+	unsigned int nr_steps;
+};
+
+struct sim_result {
+	unsigned long long ns;
+	unsigned long long transitions;
+	unsigned long long dispatches;
+	unsigned long long path_hist[SIM_PATH_BUCKETS + 1];
+	unsigned int max_path_len;
+	unsigned int failures;
+	/* Side effects of the first pass */
+	struct pogo_fake_counters pass;
+	enum pogo_state final_state;
+};
+
+/* Steps of the built-in scenarios, in the syntax of the scenario files */
+static const char * const sim_dock_undock[] = {
+	"pogo 1", "wait 2000", "expect DOCK_HUB", "input USBC_ORIENTATION", "pogo 0",
+	"expect STANDBY",
+};
+
+static const char * const sim_dock_bounce[] = {
+	"pogo 1", "wait 5", "pogo 0", "wait 3", "pogo 1", "wait 7", "pogo 0", "wait 2500",
+	"expect STANDBY", "pogo 1", "wait 40", "pogo 0", "wait 20", "pogo 1", "wait 2000",
+	"expect DOCK_HUB", "pogo 0", "expect STANDBY",
+};
+
+static const char * const sim_dock_with_device[] = {
+	"input USBC_HOST_ON", "expect DEVICE_DIRECT", "pogo 1", "wait 2000",
+	"expect DOCK_DEVICE_HUB", "pogo 0", "expect DEVICE_HUB", "input USBC_HOST_OFF",
+	"expect STANDBY",
+};
+
+static const char * const sim_h1s_on_off_on[] = {
+	"input HES_ATTACH", "acc 1", "wait 10", "expect STANDBY_ACC_DEBOUNCED",
+	"input ACC_CONNECTED", "expect ACC_DIRECT", "input HES_DETACH", "acc 0",
+	"expect STANDBY", "input HES_ATTACH", "acc 1", "wait 10", "input ACC_CONNECTED",
+	"expect ACC_DIRECT", "input HES_DETACH", "acc 0", "expect STANDBY",
+};
+
+static const char * const sim_lc[] = {
+	"input HES_ATTACH", "acc 1", "wait 10", "input ACC_CONNECTED", "input LC", "expect LC",
+	"input USBC_HOST_ON", "expect LC_DEVICE_DIRECT", "input LC_CLEAR",
+	"expect ACC_DEVICE_HUB", "input LC", "input USBC_HOST_OFF", "input LC_CLEAR",
+	"expect ACC_DIRECT", "input HES_DETACH", "acc 0", "expect STANDBY",
+};
+
+static const char * const sim_hub_mux[] = {
+	"pogo 1", "wait 2000", "ss_udev 1", "input USBC_HOST_ON", "input USBC_HOST_OFF",
+	"ss_udev 0", "pogo 0", "expect STANDBY",
+};
+
+#define SIM_SCRIPT(n)	{ #n, sim_##n, ARRAY_SIZE(sim_##n) }
+
+static const struct {
+	const char *name;
+	const char * const *lines;
+	unsigned int nr_lines;
+} sim_scripts[] = {
+	SIM_SCRIPT(dock_undock),
+	SIM_SCRIPT(dock_bounce),
+	SIM_SCRIPT(dock_with_device),
+	SIM_SCRIPT(h1s_on_off_on),
+	SIM_SCRIPT(lc),
+	SIM_SCRIPT(hub_mux),
+};
+
+static int sim_lookup(const char *name, const char * const *names, unsigned int nr,
+		      const char *prefix)
+{
+	size_t len = strlen(prefix);
+	unsigned int i;
+
+	if (!strncmp(name, prefix, len))
+		name += len;
+
+	for (i = 0; i < nr; i++)
+		if (names[i] && !strcmp(name, names[i]))
+			return i;
+
+	return -1;
+}
+
+/* Parse one step; return 1 if @line holds one, 0 if it is blank and -EINVAL if it is wrong */
+static int sim_parse(const char *line, unsigned int nr, struct sim_step *step)
+{
+	char op[32], arg[64];
+	int n, val;
+
+	n = sscanf(line, " %31s %63s", op, arg);
+	if (n <= 0 || op[0] == '#')
+		return 0;
+	if (n != 2)
+		return -EINVAL;
+
+	val = sim_lookup(op, sim_ops, ARRAY_SIZE(sim_ops), "");
+	if (val < 0)
+		return -EINVAL;
+
+	step->op = val;
+	step->line = nr;
+
+	switch (step->op) {
+	case OP_INPUT:
+		val = sim_lookup(arg, pogo_inputs, INPUT_ENTER, "INPUT_");
+		break;
+	case OP_EXPECT:
+		val = sim_lookup(arg, pogo_states, ARRAY_SIZE(pogo_states), "");
+		break;
+	default:
+		val = atoi(arg);
+		break;
+	}
+	if (val < 0)
+		return -EINVAL;
+
+	step->arg = val;
+	return 1;
+}
+
+static int sim_add(struct sim_scenario *sc, const char *line, unsigned int nr)
+{
+	struct sim_step step, *steps;
+	int ret;
+
+	ret = sim_parse(line, nr, &step);
+	if (ret <= 0)
+		return ret;
+
+	steps = realloc(sc->steps, (sc->nr_steps + 1) * sizeof(*steps));
+	if (!steps)
+		return -ENOMEM;
+
+	steps[sc->nr_steps++] = step;
+	sc->steps = steps;
+	return 0;
+}
+
+static int sim_load_file(struct sim_scenario *sc, const char *path)
+{
+	unsigned int nr = 0;
+	char line[256];
+	FILE *f;
+	int ret = 0;
+
+	f = fopen(path, "r");
+	if (!f)
+		return -errno;
+
+	sc->name = path;
+	while (fgets(line, sizeof(line), f)) {
+		ret = sim_add(sc, line, ++nr);
+		if (ret) {
+			fprintf(stderr, "%s:%u: bad step: %s", path, nr, line);
+			break;
+		}
+	}
+
+	fclose(f);
+	return ret;
+}
+
+static int sim_load_script(struct sim_scenario *sc, unsigned int idx)
+{
+	unsigned int i;
+	int ret;
+
+	sc->name = sim_scripts[idx].name;
+	for (i = 0; i < sim_scripts[idx].nr_lines; i++) {
+		ret = sim_add(sc, sim_scripts[idx].lines[i], i + 1);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* Random walk over the line edges, the inputs fed by events and the waits */
+static int sim_load_random(struct sim_scenario *sc, unsigned int seed)
+{
+	struct sim_step *step;
+	unsigned int i;
+	bool pogo = false, acc = false;
+
+	sc->name = "random";
+	sc->steps = calloc(SIM_RANDOM_STEPS, sizeof(*sc->steps));
+	if (!sc->steps)
+		return -ENOMEM;
+
+	srand(seed);
+	for (i = 0; i < SIM_RANDOM_STEPS; i++) {
+		step = &sc->steps[i];
+		step->line = i + 1;
+
+		switch (rand() % 8) {
+		case 0:
+			step->op = OP_POGO;
+			step->arg = pogo = !pogo;
+			break;
+		case 1:
+			step->op = OP_ACC;
+			step->arg = acc = !acc;
+			break;
+		case 2:
+		case 3:
+			step->op = OP_WAIT;
+			step->arg = rand() % (POGO_FAKE_POGO_DEBOUNCE_MS + 500);
+			break;
+		default:
+			step->op = OP_INPUT;
+			/* POGO_ACTIVE and POGO_STANDBY only come with an edge of the line */
+			step->arg = INPUT_USBC_HOST_ON + rand() % (INPUT_ENTER - INPUT_USBC_HOST_ON);
+			break;
+		}
+	}
+	sc->nr_steps = SIM_RANDOM_STEPS;
+
+	return 0;
+}
+
+static void sim_step(struct pogo_fake_board *board, const struct sim_step *step)
+{
+	switch (step->op) {
+	case OP_POGO:
+		pogo_fake_pogo_edge(board, step->arg);
+		break;
+	case OP_ACC:
+		pogo_fake_acc_edge(board, step->arg);
+		break;
+	case OP_WAIT:
+		board->path_len = 0;
+		pogo_fake_advance(board, step->arg);
+		break;
+	case OP_INPUT:
+		pogo_fake_dispatch(board, step->arg);
+		break;
+	case OP_FORCE_POGO:
+		board->force_pogo = step->arg;
+		break;
+	case OP_MFG:
+		board->mfg_acc_test = step->arg;
+		break;
+	case OP_SS_UDEV:
+		board->ss_udev_attached = step->arg;
+		break;
+	case OP_EXPECT:
+		break;
+	}
+}
+
+static unsigned long long sim_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sim_run(const struct sim_scenario *sc, unsigned int iterations,
+		    struct sim_result *res)
+{
+	struct pogo_fake_board board;
+	const struct sim_step *step;
+	unsigned long long start_ns;
+	unsigned int i, n;
+
+	memset(res, 0, sizeof(*res));
+
+	/* One checked pass for the side effects, the path lengths and the expectations */
+	pogo_fake_init(&board);
+	for (n = 0; n < sc->nr_steps; n++) {
+		step = &sc->steps[n];
+		if (step->op == OP_EXPECT) {
+			if (board.sm.state != step->arg) {
+				fprintf(stderr, "%s:%u: %s, expected %s\n", sc->name, step->line,
+					pogo_states[board.sm.state], pogo_states[step->arg]);
+				res->failures++;
+			}
+			continue;
+		}
+
+		sim_step(&board, step);
+		res->path_hist[board.path_len < SIM_PATH_BUCKETS ? board.path_len :
+			       SIM_PATH_BUCKETS]++;
+	}
+	res->pass = board.count;
+	res->max_path_len = board.max_path_len;
+	res->final_state = board.sm.state;
+
+	start_ns = sim_now_ns();
+	for (i = 0; i < iterations; i++) {
+		pogo_fake_init(&board);
+		for (n = 0; n < sc->nr_steps; n++)
+			sim_step(&board, &sc->steps[n]);
+		res->transitions += board.count.transitions;
+		res->dispatches += board.count.dispatches;
+	}
+	res->ns = sim_now_ns() - start_ns;
+}
+
+static void sim_report(const struct sim_scenario *sc, unsigned int iterations,
+		       const struct sim_result *res)
+{
+	double sec = res->ns ? res->ns / 1e9 : 1e-9;
+	unsigned int i;
+
+	printf("%s: %u steps x %u, %.3f s%s\n", sc->name, sc->nr_steps, iterations, sec,
+	       res->failures ? ", FAILED" : "");
+	printf("  transitions/s %.0f, dispatches/s %.0f, ns/transition %.1f\n",
+	       res->transitions / sec, res->dispatches / sec,
+	       res->transitions ? (double)res->ns / res->transitions : 0);
+	printf("  path length max %u, steps by length:", res->max_path_len);
+	for (i = 0; i <= SIM_PATH_BUCKETS; i++)
+		printf(" %u%s:%llu", i, i == SIM_PATH_BUCKETS ? "+" : "", res->path_hist[i]);
+	printf("\n");
+	printf("  per pass: transitions %u dispatches %u runs %u\n", res->pass.transitions,
+	       res->pass.dispatches, res->pass.runs);
+	printf("  side effects: gpio %u regulator %u vote %u irq %u extcon %u path %u polarity %u\n",
+	       res->pass.gpio_writes, res->pass.regulator_toggles, res->pass.votes,
+	       res->pass.irq_toggles, res->pass.extcon_changes, res->pass.path_switches,
+	       res->pass.polarity_updates);
+	printf("  final state %s\n", pogo_states[res->final_state]);
+}
+
+static int sim_scenario(struct sim_scenario *sc, unsigned int iterations)
+{
+	struct sim_result res;
+
+	sim_run(sc, iterations, &res);
+	sim_report(sc, iterations, &res);
+	free(sc->steps);
+
+	return res.failures ? 1 : 0;
+}
+
+static void sim_usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-n iterations] [-s seed] [scenario...]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int iterations = SIM_ITERATIONS, seed = 1, i;
+	struct sim_scenario sc;
+	int opt, ret = 0;
+
+	while ((opt = getopt(argc, argv, "n:s:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			sim_usage(argv[0]);
+			return opt == 'h' ? 0 : 2;
+		}
+	}
+
+	if (optind < argc) {
+		for (; optind < argc; optind++) {
+			memset(&sc, 0, sizeof(sc));
+			if (sim_load_file(&sc, argv[optind])) {
+				free(sc.steps);
+				return 2;
+			}
+			ret |= sim_scenario(&sc, iterations);
+		}
+		return ret;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(sim_scripts); i++) {
+		memset(&sc, 0, sizeof(sc));
+		if (sim_load_script(&sc, i)) {
+			fprintf(stderr, "%s: bad step\n", sim_scripts[i].name);
+			return 2;
+		}
+		ret |= sim_scenario(&sc, iterations);
+	}
+
+	memset(&sc, 0, sizeof(sc));
+	if (sim_load_random(&sc, seed))
+		return 2;
+	ret |= sim_scenario(&sc, iterations / 100 ? iterations / 100 : 1);
+
+	return ret;
+}
@@ -6,30 +6,41 @@
  */
 
 #include <linux/alarmtimer.h>
+#include <linux/cpumask.h>
 #include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/extcon.h>
 #include <linux/extcon-provider.h>
 #include <linux/interrupt.h>
 #include <linux/i2c.h>
+#include <linux/input.h>
 #include <linux/kthread.h>
+#include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
 #include <linux/of_gpio.h>
 #include <linux/of_irq.h>
+#include <linux/percpu.h>
 #include <linux/platform_device.h>
 #include <linux/power_supply.h>
 #include <linux/regulator/consumer.h>
+#include <linux/sched.h>
+#include <linux/sort.h>
 #include <linux/spinlock.h>
 #include <linux/usb.h>
 #include <linux/usb/tcpm.h>
 #include <misc/gvotable.h>
+#include <uapi/linux/sched/types.h>
 
 #include "../tcpci.h"
 #include "google_bms.h"
 #include "google_psy.h"
 #include "tcpci_max77759.h"
+#include "pogo_transport_sm.h"
+
+#define CREATE_TRACE_POINTS
+#include "pogo_transport_trace.h"
 
 #define POGO_TIMEOUT_MS 10000
 #define LC_WAKEUP_TIMEOUT_MS 10000
@@ -37,13 +48,33 @@
 #define POGO_USB_RETRY_COUNT 10
 #define POGO_USB_RETRY_INTEREVAL_MS 50
 #define POGO_PSY_DEBOUNCE_MS 50
+#define POGO_PSY_DEBOUNCE_MIN_MS 10
+#define POGO_PSY_DEBOUNCE_MAX_MS 100
 #define POGO_PSY_NRDY_RETRY_MS 500
+/* Give up on a dock below POGO_USB_CAPABLE_THRESHOLD_UV after as long as the legacy retries */
+#define POGO_USB_QUAL_TIMEOUT_MS (POGO_USB_RETRY_COUNT * POGO_USB_RETRY_INTEREVAL_MS)
 #define POGO_ACC_GPIO_DEBOUNCE_MS 20
+#define POGO_ACC_GPIO_DEBOUNCE_MIN_MS 5
+#define POGO_ACC_GPIO_DEBOUNCE_MAX_MS 40
+#define POGO_DEBOUNCE_MARGIN_MS 5
+#define POGO_HUB_HOST_OFF_WAIT_MS 60
+#define POGO_HUB_RESET_ASSERT_US 1000
+#define POGO_HUB_RESET_SETTLE_US 0
+#define POGO_HUB_ENUM_TIMEOUT_MS 150
+#define POGO_HUB_POWER_OFF_MS 10
+#define POGO_HUB_SPEC_TIMEOUT_MS 3000
+#define POGO_UEVENT_COALESCE_MS 20
+#define POGO_SNAPSHOT_VERSION 1
 #define LC_DELAY_CHECK_MS 5000
 #define LC_DISABLE_MS 1800000 /* 30 min */
 #define LC_ENABLE_MS 300000 /* 5 min */
 #define LC_BOOTUP_MS 3000
+#define LC_SAFETY_CHECK_MS 1800000 /* 30 min */
 #define ACC_CHARGING_TIMEOUT_SEC 1800 /* 30 min */
+#define POGO_EVENT_POOL_SIZE 16
+#define POGO_EVENT_RING_SIZE 32 /* power of 2 */
+#define POGO_BLOG_SIZE 128 /* entries per CPU, power of 2 */
+#define POGO_BLOG_LINE 96
 
 #define KEEP_USB_PATH 2
 #define KEEP_HUB_PATH 2
@@ -52,97 +83,6 @@
 #define POGO_VOTER "POGO"
 #define SSPHY_RESTART_EL "SSPHY_RESTART"
 
-/*
- * State Description:
- *	INVALID_STATE,
- *  (A)	STANDBY,			// Nothing attached, hub disabled
- *	DOCKING_DEBOUNCED,		// STANDBY -> DOCK_HUB, pogo gpio
- *	STANDBY_ACC_DEBOUNCED,		// STANDBY -> ACC_DIRECT, acc gpio
- *  (B)	DOCK_HUB,			// Dock online, hub enabled
- *  (C)	DOCK_DEVICE_HUB,		// Dock online, usb device online, hub enabled
- *  (H)	DOCK_AUDIO_HUB,			// Dock online, usb audio online, hub enabled
- *  (I)	AUDIO_HUB,			// Usb audio online, hub enabled
- *	AUDIO_HUB_DOCKING_DEBOUNCED,	// AUDIO_HUB -> DOCK_AUDIO_HUB, pogo gpio
- *	AUDIO_HUB_ACC_DEBOUNCED,	// AUDIO_HUB -> ACC_AUDIO_HUB, acc gpio
- *  (D)	DEVICE_HUB,			// Usb device online, hub enabled
- *      DEVICE_HUB_DOCKING_DEBOUNCED,   // DEVICE_HUB -> DOCK_DEVICE_HUB, pogo gpio
- *      DEVICE_HUB_ACC_DEBOUNCED,	// DEVICE_HUB -> ACC_DEVICE_HUB, acc gpio
- *  (E)	DEVICE_DIRECT,			// Usb device online, hub disabled
- *	DEVICE_DOCKING_DEBOUNCED,	// DEVICE_DIRECT -> DOCK_DEVICE_HUB, pogo gpio
- *	DEVICE_DIRECT_ACC_DEBOUNCED,	// DEVICE_DIRECT -> ACC_DEVICE_HUB, acc gpio
- *  (F)	AUDIO_DIRECT,			// Usb audio online, hub disabled
- *	AUDIO_DIRECT_DOCKING_DEBOUNCED,	// AUDIO_DIRECT -> AUDIO_DIRECT_DOCK_OFFLINE, pogo gpio
- *	AUDIO_DIRECT_ACC_DEBOUNCED,	// AUDIO_DIRECT -> ACC_DEVICE_HUB, acc gpio
- *  (G)	AUDIO_DIRECT_DOCK_OFFLINE,	// Usb audio online, dock offline, hub disabled
- *  (J)	HOST_DIRECT,			// Usb host online, hub disabled
- *	HOST_DIRECT_DOCKING_DEBOUNCED,	// HOST_DIRECT -> HOST_DIRECT_DOCK_OFFLINE, pogo gpio
- *  (K)	HOST_DIRECT_DOCK_OFFLINE,	// Usb host online, dock offline, hub disabled
- *      HOST_DIRECT_ACC_DEBOUNCED,	// HOST_DIRECT -> HOST_DIRECT_ACC_OFFLINE, acc gpio
- *  (L)	DOCK_HUB_HOST_OFFLINE,		// Dock online, usb host offline, hub enabled
- *  (M)	ACC_DIRECT,			// Acc online, hub disabled
- *  (N)	ACC_DEVICE_HUB,			// Acc online, usb device online, hub enabled
- *  (O)	ACC_HUB,			// Acc online, hub enabled
- *  (T)	ACC_HUB_HOST_OFFLINE,		// Acc online, hub enabled, usb host offline
- *  (P)	ACC_AUDIO_HUB,			// Acc online, usb audio online, hub enabled
- *  (Q)	LC,				// Pogo Vout off
- *  (U)	LC_DEVICE_DIRECT,		// Pogo Vout off, Usb device online, hub disabled
- *  (V)	LC_AUDIO_DIRECT,		// Pogo Vout off, Usb audio online, hub disabled
- *  (W)	LC_ALL_OFFLINE,			// Pogo Vout off, Usb host offline, hub disabled
- *  (X)	LC_HOST_DIRECT,			// Pogo Vout off, USb host online, hub disabled
- *  (R)	HOST_DIRECT_ACC_OFFLINE,	// Usb host online, acc offline, hub disabled
- *  (S)	ACC_DIRECT_HOST_OFFLINE,	// Acc online, usb host offline
- */
-
-#define FOREACH_STATE(S)			\
-	S(INVALID_STATE),			\
-	S(STANDBY),				\
-	S(DOCKING_DEBOUNCED),			\
-	S(STANDBY_ACC_DEBOUNCED),		\
-	S(DOCK_HUB),				\
-	S(DOCK_DEVICE_HUB),			\
-	S(DOCK_AUDIO_HUB),			\
-	S(AUDIO_HUB),				\
-	S(AUDIO_HUB_DOCKING_DEBOUNCED),		\
-	S(AUDIO_HUB_ACC_DEBOUNCED),		\
-	S(DEVICE_HUB),				\
-	S(DEVICE_HUB_DOCKING_DEBOUNCED),	\
-	S(DEVICE_HUB_ACC_DEBOUNCED),		\
-	S(DEVICE_DIRECT),			\
-	S(DEVICE_DOCKING_DEBOUNCED),		\
-	S(DEVICE_DIRECT_ACC_DEBOUNCED),		\
-	S(AUDIO_DIRECT),			\
-	S(AUDIO_DIRECT_DOCKING_DEBOUNCED),	\
-	S(AUDIO_DIRECT_ACC_DEBOUNCED),		\
-	S(AUDIO_DIRECT_DOCK_OFFLINE),		\
-	S(HOST_DIRECT),				\
-	S(HOST_DIRECT_DOCKING_DEBOUNCED),	\
-	S(HOST_DIRECT_DOCK_OFFLINE),		\
-	S(HOST_DIRECT_ACC_DEBOUNCED),		\
-	S(DOCK_HUB_HOST_OFFLINE),		\
-	S(ACC_DIRECT),				\
-	S(ACC_DEVICE_HUB),			\
-	S(ACC_HUB),				\
-	S(ACC_HUB_HOST_OFFLINE),		\
-	S(ACC_AUDIO_HUB),			\
-	S(LC),					\
-	S(LC_DEVICE_DIRECT),			\
-	S(LC_AUDIO_DIRECT),			\
-	S(LC_ALL_OFFLINE),			\
-	S(LC_HOST_DIRECT),			\
-	S(HOST_DIRECT_ACC_OFFLINE),		\
-	S(ACC_DIRECT_HOST_OFFLINE)
-
-#define GENERATE_ENUM(e)	e
-#define GENERATE_STRING(s)	#s
-
-enum pogo_state {
-	FOREACH_STATE(GENERATE_ENUM)
-};
-
-static const char * const pogo_states[] = {
-	FOREACH_STATE(GENERATE_STRING)
-};
-
 enum pogo_event_type {
 	/* Reported when docking status changes */
 	EVENT_DOCKING,
@@ -184,8 +124,18 @@ enum pogo_event_type {
 #define EVENT_LC_STATUS_CHANGED		BIT(8)
 #define EVENT_USB_SUSPEND		BIT(9)
 #define EVENT_FORCE_POGO		BIT(10)
+/* Number of the event bits above */
+#define EVENT_TYPES			11
 #define EVENT_LAST_EVENT_TYPE		BIT(63)
 
+/* How queued entries of the same event are merged by pogo_transport_event_handler() */
+enum pogo_event_coalesce {
+	/* Every entry is handled in arrival order with the inputs sampled when it was queued */
+	COALESCE_NONE,
+	/* Only the newest queued entry is handled; the handler reads the current inputs */
+	COALESCE_LATEST,
+};
+
 enum lc_stages {
 	STAGE_UNKNOWN,
 	STAGE_WAIT_FOR_SUSPEND,
@@ -209,6 +159,20 @@ static int modparam_state_machine_enable;
 module_param_named(state_machine_enable, modparam_state_machine_enable, int, 0644);
 MODULE_PARM_DESC(state_machine_enable, "Enabling pogo state machine transition");
 
+static bool modparam_logbuffer_verbose;
+module_param_named(logbuffer_verbose, modparam_logbuffer_verbose, bool, 0644);
+MODULE_PARM_DESC(logbuffer_verbose, "Also format the binary log of the hot paths into logbuffer");
+
+/* Overrides device tree config; applied at probe */
+static int modparam_wq_rt_priority;
+module_param_named(wq_rt_priority, modparam_wq_rt_priority, int, 0444);
+MODULE_PARM_DESC(wq_rt_priority, "SCHED_FIFO priority of wq-pogo-transport, 0 for SCHED_NORMAL");
+
+/* Overrides device tree config; applied at probe */
+static char *modparam_wq_cpus;
+module_param_named(wq_cpus, modparam_wq_cpus, charp, 0444);
+MODULE_PARM_DESC(wq_cpus, "List of CPUs wq-pogo-transport runs on, e.g. 0-3");
+
 extern void register_bus_suspend_callback(void (*callback)(void *bus_suspend_payload, bool main_hcd,
 							   bool suspend),
 					  void *data);
@@ -237,6 +201,199 @@ enum pogo_accessory_detection {
 	ENABLED
 };
 
+enum pogo_hub_recover_step {
+	HUB_RECOVER_POLARITY,
+	HUB_RECOVER_SSPHY,
+	HUB_RECOVER_RESET,
+	HUB_RECOVER_POWER_CYCLE,
+	HUB_RECOVER_STEPS,
+};
+
+static const char * const pogo_hub_recover_names[] = {
+	[HUB_RECOVER_POLARITY] = "polarity",
+	[HUB_RECOVER_SSPHY] = "ssphy_restart",
+	[HUB_RECOVER_RESET] = "reset",
+	[HUB_RECOVER_POWER_CYCLE] = "power_cycle",
+};
+
+#define POGO_TIMING_BUCKETS 16
+
+/*
+ * Execution time of a work item. Updated from the worker with data_path_lock held, except for the
+ * queue delays and the hub enumeration latencies which are guarded by stats_lock.
+ */
+struct pogo_transport_timing {
+	u64 count;
+	u64 total_ns;
+	u64 max_ns;
+	/* hist[i] counts runs shorter than 2^i us; the last bucket also takes the longer ones */
+	u32 hist[POGO_TIMING_BUCKETS];
+};
+
+#define POGO_BOUNCE_BUCKETS 64
+#define POGO_BOUNCE_MIN_SAMPLES 8
+#define POGO_BOUNCE_WEIGHT 256 /* one burst, in hist units */
+#define POGO_BOUNCE_DECAY 8 /* a release drops 1/POGO_BOUNCE_DECAY of every bucket */
+#define POGO_EDGE_BUF 8 /* power of 2 */
+#define POGO_IRQ_STORM_WINDOW_MS 100
+#define POGO_IRQ_STORM_THRESHOLD 50 /* edges per window */
+#define POGO_IRQ_STORM_BACKOFF_MIN_MS 100
+#define POGO_IRQ_STORM_BACKOFF_MAX_MS 10000
+/* A storm this soon after the line was unmasked doubles the backoff */
+#define POGO_IRQ_STORM_QUIET_MS 1000
+
+/*
+ * Contact bounce of one detection line. A burst starts at an edge and takes every following edge
+ * closer than max_ms to the previous one; close_work closes it into hist once the line has been
+ * quiet for max_ms.
+ *
+ * hist is a rolling window rather than a per-dock one, as a dock only bounces a couple of times: a
+ * release of the dock or accessory decays it by 1/POGO_BOUNCE_DECAY so that a worn dock fades out
+ * over the next sessions instead of setting the debounce for good.
+ */
+struct pogo_bounce {
+	/* Guards the fields below; taken from the hard IRQ handler of the line */
+	spinlock_t lock;
+	bool burst_open;
+	u64 burst_start_ns;
+	u64 last_edge_ns;
+	/* The most recent edges, edge_ns[(edge_head - 1) % POGO_EDGE_BUF] being last_edge_ns */
+	u64 edge_ns[POGO_EDGE_BUF];
+	unsigned int edge_head;
+	/* Sum of hist, POGO_BOUNCE_WEIGHT per burst */
+	u32 weight;
+	/* hist[i] weighs bursts lasting i ms; the last bucket also takes the longer ones */
+	u32 hist[POGO_BOUNCE_BUCKETS];
+	struct kthread_delayed_work close_work;
+	struct kthread_worker *wq;
+	/* Bounds of the learned debounce */
+	u32 min_ms;
+	u32 max_ms;
+};
+
+enum pogo_hall {
+	HALL1_S,
+	HALL2_S,
+	HALL_COUNT,
+};
+
+/* Userspace observable state, sent as the env of KOBJ_CHANGE */
+struct pogo_uevent_state {
+	enum pogo_state state;
+	bool pogo_usb_active;
+	bool pogo_hub_active;
+	bool docked;
+};
+
+/*
+ * Edge rate guard of one IRQ line. The hard IRQ handler counts edges per window and masks the line
+ * when they exceed irq_storm_threshold; work unmasks it again after backoff_ms. Only updated from
+ * the hard IRQ handler, or from work while the line is masked.
+ */
+struct pogo_irq_storm {
+	struct pogo_transport *pogo_transport;
+	const char *name;
+	int irq;
+	u64 window_start_ns;
+	u32 edges;
+	u64 unmask_ns;
+	u32 backoff_ms;
+	bool masked;
+	atomic_t episodes;
+	struct kthread_delayed_work work;
+};
+
+/*
+ * An entry of event_ring. seq is owned by the ring: it equals the position when the slot is free
+ * and position + 1 once the entry is published to the handler.
+ */
+struct pogo_event_entry {
+	atomic_t seq;
+	unsigned long event;
+	/* Boot time when the event was queued */
+	u64 ts_ns;
+	/* Inputs sampled when the event was queued */
+	enum typec_data_role usbc_data_role;
+	bool usbc_data_active;
+	bool hall1_s_state;
+	bool lc;
+};
+
+/*
+ * Side effects decided under data_path_lock and applied by pogo_transport_defer_apply() once the
+ * lock is released. Only the acc-detect LDO enable and the extcon notifications of ACT_DOCK are
+ * deferred; see pogo_transport_defer_apply().
+ */
+struct pogo_transport_deferred {
+	bool acc_ldo_on;
+	/* ACT_DOCK has set the cables; the ones flagged below still have to be synced */
+	bool dock;
+	bool sync_usb;
+	bool sync_dock;
+};
+
+/* Messages of the binary log, formatted by pogo_transport_blog_format() */
+enum pogo_blog_id {
+	BLOG_NONE,
+	BLOG_POGO_ISR,
+	BLOG_ACC_ISR,
+	BLOG_POGO_IRQ,		/* pogo_gpio */
+	BLOG_ACC_IRQ,		/* acc_detect */
+	BLOG_QUEUE_EVENT,	/* event bit number */
+	BLOG_PENDING_STATE,	/* from, to, delay_ms */
+	BLOG_STATE,		/* from, to, lc */
+	BLOG_DELAYED_STATE,	/* from, to, delay_ms, lc */
+};
+
+struct pogo_blog_entry {
+	u64 ts_ns;
+	u16 id;
+	u32 args[4];
+};
+
+/* Written only by the local CPU with IRQs disabled; read without locking from debugfs */
+struct pogo_blog_ring {
+	unsigned int head;
+	struct pogo_blog_entry entries[POGO_BLOG_SIZE];
+};
+
+#define POGO_NR_STATES ARRAY_SIZE(pogo_states)
+#define POGO_STATS_VERSION 1
+
+/* Power rails whose enabled time is accounted in pogo_transport_stats */
+enum pogo_stats_rail {
+	STATS_RAIL_HUB_LDO,
+	STATS_RAIL_ACC_DETECT_LDO,
+	STATS_RAIL_POGO_VOUT,
+	STATS_RAIL_COUNT,
+};
+
+/*
+ * Binary layout of debugfs "stats", native endian, times in ns of boot time. Bump
+ * POGO_STATS_VERSION whenever the layout changes.
+ */
+struct pogo_transport_stats {
+	u32 version;
+	u32 nr_states;
+	u32 nr_rails;
+	u32 reserved;
+	/* Boot time of the last reset */
+	u64 since_ns;
+	/* Indexed by enum pogo_state */
+	struct {
+		u64 entries;
+		u64 total_ns;
+		u64 max_ns;
+	} state[POGO_NR_STATES];
+	/* Indexed by enum pogo_stats_rail */
+	struct {
+		u64 on_ns;
+		u64 enables;
+	} rail[STATS_RAIL_COUNT];
+	/* transitions[from][to] */
+	u32 transitions[POGO_NR_STATES][POGO_NR_STATES];
+};
+
 struct pogo_transport_udev_ids {
 	__le16 vendor;
 	__le16 product;
@@ -255,6 +412,15 @@ struct pogo_transport {
 	int pogo_acc_gpio;
 	int pogo_acc_irq;
 	unsigned int pogo_acc_gpio_debounce_ms;
+	/* Debounce pogo and acc detection on the p99 bounce plus debounce_margin_ms */
+	unsigned long adaptive_debounce;
+	unsigned long debounce_margin_ms;
+	struct pogo_bounce pogo_bounce;
+	struct pogo_bounce acc_bounce;
+	/* Edges per POGO_IRQ_STORM_WINDOW_MS above which an IRQ line is masked; 0 disables */
+	unsigned long irq_storm_threshold;
+	struct pogo_irq_storm pogo_storm;
+	struct pogo_irq_storm acc_storm;
 	struct regulator *hub_ldo;
 	struct regulator *acc_detect_ldo;
 	/* Raw value of the active state. Set to 1 when pogo_ovp_en is ACTIVE_HIGH */
@@ -297,23 +463,37 @@ struct pogo_transport {
 	/* When true, the bus not yet suspended after lc is triggered */
 	bool wait_for_suspend;
 
+	/* Guards stats and the bookkeeping below, updated from the worker and the threaded IRQ */
+	spinlock_t stats_lock;
+	struct pogo_transport_stats stats;
+	/* State as seen by the stats and the boot time it was entered */
+	enum pogo_state stats_state;
+	u64 stats_state_enter_ns;
+	/* Boot time each rail was enabled, 0 when disabled */
+	u64 stats_rail_on_ns[STATS_RAIL_COUNT];
+
+	/* Binary log of the hot paths, see pogo_transport_blog() */
+	struct pogo_blog_ring __percpu *blog;
+
 	struct kthread_worker *wq;
 	struct kthread_delayed_work state_machine;
 	struct kthread_work event_work;
-	enum pogo_state prev_state;
-	enum pogo_state state;
-	enum pogo_state delayed_state;
-	unsigned long delayed_runtime;
-	unsigned long delay_ms;
+	/* State Machine core, see pogo_transport_sm_ops */
+	struct pogo_sm sm;
+	/* When true, side effects are recorded in deferred instead of being applied */
+	bool deferring;
+	struct pogo_transport_deferred deferred;
 	unsigned long lc_delay_check_ms;
 	unsigned long lc_enable_ms;
 	unsigned long lc_disable_ms;
 	unsigned long lc_bootup_ms;
+	/* Longest period between checks when acc_charger_psy changes are notified */
+	unsigned long lc_safety_check_ms;
 	u64 acc_charging_timeout_sec;
 	u64 acc_charging_full_begin_ns;
 	u64 acc_discharging_begin_ns;
+	/* Events that did not fit in event_ring; handled after it in bit order */
 	unsigned long event_map;
-	bool state_machine_running;
 	bool state_machine_enabled;
 	spinlock_t pogo_event_lock;
 
@@ -326,14 +506,59 @@ struct pogo_transport {
 
 	/* To read voltage at the pogo pins */
 	struct power_supply *pogo_psy;
+	/* Notified on pogo_psy changes to qualify the dock voltage without polling */
+	struct notifier_block pogo_psy_nb;
+	bool pogo_psy_nb_registered;
+	/* Re-reads pogo_psy on notification, or once the qualification timed out */
+	struct kthread_delayed_work voltage_qual_work;
+	/* Boot time the dock voltage was first read below the threshold, 0 when not qualifying */
+	u64 voltage_qual_start_ns;
+	/* When true, reading pogo_psy returned -EAGAIN and has to be retried */
+	bool voltage_read_pending;
 	/* To read the status exported from pogo accessory charger */
 	struct power_supply *acc_charger_psy;
 	char *acc_charger_psy_name;
+	/* When true, acc_charger_psy was re-registered and the cached handle has to be dropped */
+	bool acc_charger_psy_stale;
+	/* Number of times lc_retry_work was scheduled to read acc_charger_psy again */
+	unsigned int acc_charger_retry;
+	struct kthread_delayed_work lc_retry_work;
+	/* Notified on acc_charger_psy changes to re-evaluate the charging status in lc */
+	struct notifier_block acc_charger_nb;
+	bool acc_charger_nb_registered;
+	struct kthread_work acc_charger_work;
+	/* Status and capacity of acc_charger_psy at the last evaluation, valid if cached */
+	int acc_charger_status;
+	int acc_charger_capacity;
+	bool acc_charger_cached;
 	enum lc_stages lc_stage;
 	/* Retry when voltage is less than POGO_USB_CAPABLE_THRESHOLD_UV */
 	unsigned int retry_count;
 	/* To signal userspace extcon observer */
 	struct extcon_dev *extcon;
+	/* Last EXTCON_USB and EXTCON_DOCK states set by update_extcon_dev() */
+	bool extcon_usb;
+	bool extcon_dock;
+	/* update_extcon_dev() calls that left both cables unchanged */
+	atomic_t extcon_skipped;
+	/* Payload of the last KOBJ_CHANGE; guarded by data_path_lock */
+	struct pogo_uevent_state last_uevent;
+	struct kthread_delayed_work uevent_work;
+	/* KOBJ_CHANGE requests dropped as nothing observable changed */
+	atomic_t uevent_skipped;
+	/* Bumped, and the snapshot attribute notified, whenever a snapshotted field changes */
+	atomic64_t snapshot_gen;
+	/*
+	 * Optional in-kernel consumer of the hall sensors, matched by input device name and
+	 * <type code> of the event. The hall1_s and hall2_s attributes remain as the fallback.
+	 */
+	struct input_handler hall_handler;
+	bool hall_handler_registered;
+	const char *hall_input[HALL_COUNT];
+	u32 hall_event[HALL_COUNT][2];
+	/* Latest value reported by the input device, -1 once consumed by hall_work */
+	atomic_t hall_value[HALL_COUNT];
+	struct kthread_work hall_work;
 	/* When true, disable voltage based detection of pogo partners */
 	bool disable_voltage_detection;
 	struct gvotable_election *charger_mode_votable;
@@ -342,6 +567,68 @@ struct pogo_transport {
 	/* Used for cancellable work such as pogo debouncing */
 	struct kthread_delayed_work pogo_accessory_debounce_work;
 
+	/* Turns on Host Mode for the hub once the previous mode has been torn down */
+	struct kthread_delayed_work hub_host_work;
+	/* Power off the hub after being idle for hub_idle_ms; 0 disables the policy */
+	unsigned long hub_idle_ms;
+	struct kthread_delayed_work hub_idle_work;
+	/* When true, hub_ldo is off and the hub held in reset by hub_idle_work */
+	bool hub_gated;
+	/* When true, an event may use the hub; ungate it once the State Machine has settled */
+	bool hub_wake_pending;
+	/* Number of non-hub USB devices attached */
+	atomic_t hub_udev_count;
+	/* pogo-hub-reset pulse width and the wait after releasing it */
+	u32 hub_reset_assert_us;
+	u32 hub_reset_settle_us;
+	/* Boot time of the last hub reset, cleared once a udev enumerates behind it */
+	u64 hub_reset_ns;
+	/* Start recovering the hub if nothing enumerates within hub_enum_timeout_ms; 0 disables */
+	unsigned long hub_enum_timeout_ms;
+	struct kthread_delayed_work hub_enum_work;
+	/* When true, the watchdog is waiting for a udev to enumerate behind the hub */
+	bool hub_enum_expected;
+	/* Next rung of the recovery ladder, enum pogo_hub_recover_step */
+	atomic_t hub_recover_step;
+	/* When true, hub_enum_work holds the hub in reset for the last rung and releases it next */
+	bool hub_recover_hold;
+	atomic_t hub_recover_attempts[HUB_RECOVER_STEPS];
+	/* Indexed by the last rung taken before the hub enumerated */
+	atomic_t hub_recover_success[HUB_RECOVER_STEPS];
+	atomic_t hub_recover_exhausted;
+	/* Power hub_ldo up on H1S attach, ahead of the dock being qualified */
+	unsigned long hub_speculative;
+	/* When true, hub_ldo was enabled on H1S attach and the hub is held in reset */
+	bool hub_spec_on;
+	struct kthread_delayed_work hub_spec_work;
+	atomic_t hub_spec_hits;
+	atomic_t hub_spec_misses;
+	/* Hub power-up and hub reset to enumeration latency, guarded by stats_lock */
+	struct pogo_transport_timing hub_power_enum_timing;
+	struct pogo_transport_timing hub_reset_enum_timing;
+	/* When true, hub_host_work still has to turn on Host Mode for the hub */
+	bool hub_host_pending;
+	/* Boot time of the last switch to the hub, cleared once a udev enumerates behind it */
+	u64 hub_switch_ns;
+
+	/* Preallocated events for pogo_transport_event(), one bit per slot in event_pool_map */
+	struct pogo_event *event_pool;
+	unsigned long *event_pool_map;
+	unsigned int event_pool_size;
+	atomic_t event_pool_used;
+	/* Highest number of pool slots in use at the same time */
+	atomic_t event_pool_hwm;
+	/* Number of events allocated outside the pool because the pool was full */
+	atomic_t event_pool_exhausted;
+
+	/* Events in arrival order, queued without locks by pogo_transport_queue_event() */
+	struct pogo_event_entry event_ring[POGO_EVENT_RING_SIZE];
+	atomic_t event_ring_head;
+	/* Only advanced by event_work */
+	unsigned int event_ring_tail;
+	/* Number of events queued in event_map because event_ring was full */
+	atomic_t event_ring_overflow;
+
 	struct alarm lc_check_alarm;
 	struct kthread_work lc_work;
 
@@ -354,6 +641,13 @@ struct pogo_transport {
 	/* Cache values from the Type-C driver */
 	enum typec_data_role usbc_data_role;
 	bool usbc_data_active;
+
+	/* Execution time of update_pogo_transport(), the event handler and the state machine */
+	struct pogo_transport_timing legacy_timing;
+	struct pogo_transport_timing event_handler_timing;
+	/* Time from queueing an event until event_work pops it, per event bit; under stats_lock */
+	struct pogo_transport_timing queue_delay[EVENT_TYPES];
+	struct pogo_transport_timing state_machine_timing;
 };
 
 static const unsigned int pogo_extcon_cable[] = {
@@ -390,34 +684,172 @@ static bool pogo_transport_match_udev(const struct pogo_transport_udev_ids *list
 
 static void pogo_transport_event(struct pogo_transport *pogo_transport,
 				 enum pogo_event_type event_type, int delay_ms);
+static void init_hall_input(struct pogo_transport *pogo_transport);
 
-static void update_extcon_dev(struct pogo_transport *pogo_transport, bool docked, bool usb_capable)
+/*
+ * Notify userspace that the observable state may have changed. Requests within
+ * POGO_UEVENT_COALESCE_MS are folded into one KOBJ_CHANGE, which is only sent if the state
+ * differs from the last one sent.
+ */
+static void pogo_transport_uevent(struct pogo_transport *pogo_transport)
+{
+	kthread_queue_delayed_work(pogo_transport->wq, &pogo_transport->uevent_work,
+				   msecs_to_jiffies(POGO_UEVENT_COALESCE_MS));
+}
+
+/* A field reported by the snapshot attribute has changed; wake up its pollers */
+static void pogo_transport_snapshot_changed(struct pogo_transport *pogo_transport)
+{
+	atomic64_inc(&pogo_transport->snapshot_gen);
+	sysfs_notify(&pogo_transport->dev->kobj, NULL, "snapshot");
+}
+
+static void pogo_transport_uevent_work(struct kthread_work *work)
+{
+	struct pogo_transport *pogo_transport =
+		container_of(container_of(work, struct kthread_delayed_work, work),
+			     struct pogo_transport, uevent_work);
+	struct max77759_plat *chip = pogo_transport->chip;
+	struct pogo_uevent_state cur;
+	char state[32], usb_active[24], hub_active[16], docked[16];
+	char *envp[] = {state, usb_active, hub_active, docked, NULL};
+
+	mutex_lock(&chip->data_path_lock);
+	cur.state = pogo_transport->sm.state;
+	cur.pogo_usb_active = pogo_transport->pogo_usb_active;
+	cur.pogo_hub_active = pogo_transport->pogo_hub_active;
+	cur.docked = pogo_transport->extcon_dock;
+	if (cur.state == pogo_transport->last_uevent.state &&
+	    cur.pogo_usb_active == pogo_transport->last_uevent.pogo_usb_active &&
+	    cur.pogo_hub_active == pogo_transport->last_uevent.pogo_hub_active &&
+	    cur.docked == pogo_transport->last_uevent.docked) {
+		mutex_unlock(&chip->data_path_lock);
+		atomic_inc(&pogo_transport->uevent_skipped);
+		return;
+	}
+	pogo_transport->last_uevent = cur;
+	mutex_unlock(&chip->data_path_lock);
+
+	scnprintf(state, sizeof(state), "POGO_STATE=%s", pogo_states[cur.state]);
+	scnprintf(usb_active, sizeof(usb_active), "POGO_USB_ACTIVE=%u", cur.pogo_usb_active);
+	scnprintf(hub_active, sizeof(hub_active), "HUB_ACTIVE=%u", cur.pogo_hub_active);
+	scnprintf(docked, sizeof(docked), "DOCKED=%u", cur.docked);
+	kobject_uevent_env(&pogo_transport->dev->kobj, KOBJ_CHANGE, envp);
+}
+
+/* Drop 1/POGO_BOUNCE_DECAY of every bucket, rounding up so that stale bursts fade out entirely */
+static void pogo_transport_bounce_decay(struct pogo_bounce *bounce)
 {
+	unsigned long flags;
+	u32 weight = 0;
+	int i;
+
+	spin_lock_irqsave(&bounce->lock, flags);
+	for (i = 0; i < POGO_BOUNCE_BUCKETS; i++) {
+		bounce->hist[i] -= DIV_ROUND_UP(bounce->hist[i], POGO_BOUNCE_DECAY);
+		weight += bounce->hist[i];
+	}
+	WRITE_ONCE(bounce->weight, weight);
+	spin_unlock_irqrestore(&bounce->lock, flags);
+}
+
+/* Forget everything learned on @bounce */
+static void pogo_transport_bounce_clear(struct pogo_bounce *bounce)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&bounce->lock, flags);
+	memset(bounce->hist, 0, sizeof(bounce->hist));
+	WRITE_ONCE(bounce->weight, 0);
+	spin_unlock_irqrestore(&bounce->lock, flags);
+}
+
+/* Set @cable to @state without notifying; return true if it has to be synced */
+static bool pogo_transport_extcon_set(struct pogo_transport *pogo_transport, unsigned int cable,
+				      bool state)
+{
+	bool *shadow = cable == EXTCON_USB ? &pogo_transport->extcon_usb :
+			&pogo_transport->extcon_dock;
 	int ret;
 
+	if (*shadow == state)
+		return false;
+
+	ret = extcon_set_state(pogo_transport->extcon, cable, state);
+	if (ret) {
+		dev_err(pogo_transport->dev, "%s Failed to %s %s\n", __func__,
+			state ? "set" : "clear",
+			cable == EXTCON_USB ? "EXTCON_USB" : "EXTCON_DOCK");
+		return false;
+	}
+	*shadow = state;
+	pogo_transport_snapshot_changed(pogo_transport);
+
+	/* Undocked; age what was learned from this dock */
+	if (cable == EXTCON_DOCK && !state) {
+		pogo_transport_bounce_decay(&pogo_transport->pogo_bounce);
+		pogo_transport_bounce_decay(&pogo_transport->acc_bounce);
+	}
+
+	return true;
+}
+
+/* Notify the extcon observers of the cables set by pogo_transport_extcon_set() */
+static void pogo_transport_extcon_sync(struct pogo_transport *pogo_transport, bool docked,
+				       bool sync_usb, bool sync_dock)
+{
 	/* While docking, Signal EXTCON_USB before signalling EXTCON_DOCK */
-	if (docked) {
-		ret = extcon_set_state_sync(pogo_transport->extcon, EXTCON_USB, usb_capable);
-		if (ret)
-			dev_err(pogo_transport->dev, "%s Failed to %s EXTCON_USB\n", __func__,
-				usb_capable ? "set" : "clear");
-		ret = extcon_set_state_sync(pogo_transport->extcon, EXTCON_DOCK, true);
-		if (ret)
-			dev_err(pogo_transport->dev, "%s Failed to set EXTCON_DOCK\n", __func__);
+	static const unsigned int dock_order[] = {EXTCON_USB, EXTCON_DOCK};
+	/* b/241919179: While undocking, Signal EXTCON_DOCK before signalling EXTCON_USB */
+	static const unsigned int undock_order[] = {EXTCON_DOCK, EXTCON_USB};
+	const unsigned int *order = docked ? dock_order : undock_order;
+	int i, ret;
+
+	if (!sync_usb && !sync_dock) {
+		atomic_inc(&pogo_transport->extcon_skipped);
 		return;
 	}
 
-	/* b/241919179: While undocking, Signal EXTCON_DOCK before signalling EXTCON_USB */
-	ret = extcon_set_state_sync(pogo_transport->extcon, EXTCON_DOCK, false);
-	if (ret)
-		dev_err(pogo_transport->dev, "%s Failed to clear EXTCON_DOCK\n", __func__);
-	ret = extcon_set_state_sync(pogo_transport->extcon, EXTCON_USB, false);
-	if (ret)
-		dev_err(pogo_transport->dev, "%s Failed to clear EXTCON_USB\n", __func__);
+	for (i = 0; i < ARRAY_SIZE(dock_order); i++) {
+		if (!(order[i] == EXTCON_USB ? sync_usb : sync_dock))
+			continue;
+
+		ret = extcon_sync(pogo_transport->extcon, order[i]);
+		if (ret)
+			dev_err(pogo_transport->dev, "%s Failed to sync %s\n", __func__,
+				order[i] == EXTCON_USB ? "EXTCON_USB" : "EXTCON_DOCK");
+	}
+
+	pogo_transport_uevent(pogo_transport);
+}
+
+/*
+ * Set EXTCON_USB and EXTCON_DOCK, skipping the cables already in the requested state. Both states
+ * are updated before the first notification so that every notifier sees the final state, then the
+ * changed cables are notified in order.
+ *
+ * This function is guarded by (max77759_plat)->data_path_lock
+ */
+static void update_extcon_dev(struct pogo_transport *pogo_transport, bool docked, bool usb_capable)
+{
+	bool sync_usb = false, sync_dock = false;
+
+	/* Supersedes a dock notification deferred by ACT_DOCK; sync its cables here instead */
+	if (pogo_transport->deferring && pogo_transport->deferred.dock) {
+		sync_usb = pogo_transport->deferred.sync_usb;
+		sync_dock = pogo_transport->deferred.sync_dock;
+		pogo_transport->deferred.dock = false;
+	}
+
+	sync_usb |= pogo_transport_extcon_set(pogo_transport, EXTCON_USB, docked && usb_capable);
+	sync_dock |= pogo_transport_extcon_set(pogo_transport, EXTCON_DOCK, docked);
+	pogo_transport_extcon_sync(pogo_transport, docked, sync_usb, sync_dock);
 }
 
 static void ssphy_restart_control(struct pogo_transport *pogo_transport, bool enable)
 {
+	int ret;
+
 	if (!pogo_transport->ssphy_restart_votable)
 		pogo_transport->ssphy_restart_votable =
 				gvotable_election_get_handle(SSPHY_RESTART_EL);
@@ -429,7 +861,125 @@ static void ssphy_restart_control(struct pogo_transport *pogo_transport, bool en
 	}
 
 	logbuffer_log(pogo_transport->log, "ssphy_restart_control %u", enable);
-	gvotable_cast_long_vote(pogo_transport->ssphy_restart_votable, POGO_VOTER, enable, enable);
+	ret = gvotable_cast_long_vote(pogo_transport->ssphy_restart_votable, POGO_VOTER, enable,
+				      enable);
+	trace_pogo_transport_vote(pogo_transport->dev, SSPHY_RESTART_EL, enable, enable, ret);
+}
+
+/* Reset the statistics, keeping the current state and rails as entered/enabled from @now */
+static void pogo_transport_stats_reset_locked(struct pogo_transport *pogo_transport, u64 now)
+{
+	struct pogo_transport_stats *stats = &pogo_transport->stats;
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->version = POGO_STATS_VERSION;
+	stats->nr_states = POGO_NR_STATES;
+	stats->nr_rails = STATS_RAIL_COUNT;
+	stats->since_ns = now;
+	pogo_transport->stats_state_enter_ns = now;
+	for (i = 0; i < STATS_RAIL_COUNT; i++) {
+		if (pogo_transport->stats_rail_on_ns[i])
+			pogo_transport->stats_rail_on_ns[i] = now;
+	}
+}
+
+static void pogo_transport_stats_state(struct pogo_transport *pogo_transport,
+				       enum pogo_state from, enum pogo_state to)
+{
+	struct pogo_transport_stats *stats = &pogo_transport->stats;
+	u64 now = ktime_get_boottime_ns();
+	u64 residency;
+
+	spin_lock(&pogo_transport->stats_lock);
+	residency = now - pogo_transport->stats_state_enter_ns;
+	stats->state[from].total_ns += residency;
+	stats->state[from].max_ns = max(stats->state[from].max_ns, residency);
+	stats->state[to].entries++;
+	stats->transitions[from][to]++;
+	pogo_transport->stats_state = to;
+	pogo_transport->stats_state_enter_ns = now;
+	spin_unlock(&pogo_transport->stats_lock);
+}
+
+static void pogo_transport_stats_rail(struct pogo_transport *pogo_transport,
+				      enum pogo_stats_rail rail, bool on)
+{
+	struct pogo_transport_stats *stats = &pogo_transport->stats;
+	u64 *on_since = &pogo_transport->stats_rail_on_ns[rail];
+	u64 now = ktime_get_boottime_ns();
+
+	spin_lock(&pogo_transport->stats_lock);
+	if (on && !*on_since) {
+		*on_since = now;
+		stats->rail[rail].enables++;
+	} else if (!on && *on_since) {
+		stats->rail[rail].on_ns += now - *on_since;
+		*on_since = 0;
+	}
+	spin_unlock(&pogo_transport->stats_lock);
+}
+
+/* Copy the statistics, accounting the current state and the enabled rails up to now */
+static void pogo_transport_stats_snapshot(struct pogo_transport *pogo_transport,
+					  struct pogo_transport_stats *snapshot)
+{
+	enum pogo_state state;
+	u64 now, residency;
+	int i;
+
+	spin_lock(&pogo_transport->stats_lock);
+	now = ktime_get_boottime_ns();
+	*snapshot = pogo_transport->stats;
+	state = pogo_transport->stats_state;
+	residency = now - pogo_transport->stats_state_enter_ns;
+	snapshot->state[state].total_ns += residency;
+	snapshot->state[state].max_ns = max(snapshot->state[state].max_ns, residency);
+	for (i = 0; i < STATS_RAIL_COUNT; i++) {
+		if (pogo_transport->stats_rail_on_ns[i])
+			snapshot->rail[i].on_ns += now - pogo_transport->stats_rail_on_ns[i];
+	}
+	spin_unlock(&pogo_transport->stats_lock);
+}
+
+/* Cast @vote for @reason on charger_mode_votable */
+static int pogo_transport_vote_charger_mode(struct pogo_transport *pogo_transport, int reason,
+					    int vote)
+{
+	int ret;
+
+	ret = gvotable_cast_long_vote(pogo_transport->charger_mode_votable, POGO_VOTER, reason,
+				      vote);
+	trace_pogo_transport_vote(pogo_transport->dev, GBMS_MODE_VOTABLE, reason, vote, ret);
+
+	if (!ret && reason == GBMS_POGO_VOUT) {
+		pogo_transport_stats_rail(pogo_transport, STATS_RAIL_POGO_VOUT, vote);
+		pogo_transport_snapshot_changed(pogo_transport);
+	}
+
+	return ret;
+}
+
+static int pogo_transport_set_regulator(struct pogo_transport *pogo_transport,
+					struct regulator *regulator, const char *supply,
+					bool enable)
+{
+	int ret;
+
+	if (enable)
+		ret = regulator_enable(regulator);
+	else
+		ret = regulator_disable(regulator);
+	trace_pogo_transport_regulator(pogo_transport->dev, supply, enable, ret);
+
+	if (!ret && regulator == pogo_transport->hub_ldo)
+		pogo_transport_stats_rail(pogo_transport, STATS_RAIL_HUB_LDO, enable);
+	else if (!ret && regulator == pogo_transport->acc_detect_ldo)
+		pogo_transport_stats_rail(pogo_transport, STATS_RAIL_ACC_DETECT_LDO, enable);
+	if (!ret)
+		pogo_transport_snapshot_changed(pogo_transport);
+
+	return ret;
 }
 
 /*
@@ -455,73 +1005,444 @@ static void pogo_transport_update_polarity(struct pogo_transport *pogo_transport
 		      prop.intval, sync);
 }
 
-static void disable_and_bypass_hub(struct pogo_transport *pogo_transport)
+/*
+ * Drop a hub bring-up still waiting for hub_host_work. Host Mode was never turned on for the hub,
+ * so pogo_usb_active is cleared as there is nothing to turn off.
+ *
+ * This function is guarded by (max77759_plat)->data_path_lock
+ */
+static void pogo_transport_cancel_hub_host(struct pogo_transport *pogo_transport)
 {
-	int ret;
-
-	if (!pogo_transport->hub_embedded)
+	if (!pogo_transport->hub_host_pending)
 		return;
 
-	/* USB_MUX_HUB_SEL set to 0 to bypass the hub */
-	gpio_set_value(pogo_transport->pogo_hub_sel_gpio, 0);
-	logbuffer_log(pogo_transport->log, "POGO: hub-mux:%d",
-		      gpio_get_value(pogo_transport->pogo_hub_sel_gpio));
-	pogo_transport->pogo_hub_active = false;
+	pogo_transport->hub_host_pending = false;
+	pogo_transport->pogo_usb_active = false;
+	pogo_transport_snapshot_changed(pogo_transport);
+	logbuffer_log(pogo_transport->log, "POGO: hub host mode cancelled");
+}
 
-	/*
-	 * No further action in the callback of the votable if it is disabled. Disable it here for
-	 * the bookkeeping purpose in the dumpstate.
-	 */
-	ssphy_restart_control(pogo_transport, false);
+/* pogo-hub-reset is active high */
+static void pogo_transport_hub_reset(struct pogo_transport *pogo_transport, bool assert)
+{
+	gpio_set_value(pogo_transport->pogo_hub_reset_gpio, assert);
+	pogo_transport_snapshot_changed(pogo_transport);
+}
+
+/*
+ * Start the enumeration watchdog from the first rung of the recovery ladder. A hub held in reset
+ * by the ladder is released on time first; the window starts from there.
+ */
+static void pogo_transport_hub_enum_arm(struct pogo_transport *pogo_transport)
+{
+	WRITE_ONCE(pogo_transport->hub_enum_expected, true);
+	atomic_set(&pogo_transport->hub_recover_step, 0);
+	if (pogo_transport->hub_enum_timeout_ms && !pogo_transport->hub_recover_hold)
+		kthread_mod_delayed_work(pogo_transport->wq, &pogo_transport->hub_enum_work,
+					 msecs_to_jiffies(pogo_transport->hub_enum_timeout_ms));
+}
+
+/*
+ * First half of the reset and power cycle rungs: hold the hub in reset, with hub_ldo off for a
+ * power cycle, and return how long to hold it. hub_enum_work releases it on its next run instead
+ * of sleeping under data_path_lock. hub_ldo and Host Mode are left on for a reset.
+ *
+ * This function is guarded by (max77759_plat)->data_path_lock
+ */
+static unsigned long pogo_transport_hub_recover_hold_locked(struct pogo_transport *pogo_transport,
+							    int step)
+{
+	int ret;
+
+	pogo_transport_hub_reset(pogo_transport, true);
+	pogo_transport->hub_recover_hold = true;
+	if (step == HUB_RECOVER_RESET)
+		return DIV_ROUND_UP(pogo_transport->hub_reset_assert_us, USEC_PER_MSEC);
 
 	if (pogo_transport->hub_ldo && regulator_is_enabled(pogo_transport->hub_ldo) > 0) {
-		ret = regulator_disable(pogo_transport->hub_ldo);
+		ret = pogo_transport_set_regulator(pogo_transport, pogo_transport->hub_ldo,
+						   "usb-hub", false);
 		if (ret)
-			logbuffer_log(pogo_transport->log, "Failed to disable hub_ldo %d", ret);
+			logbuffer_log(pogo_transport->log, "%s: Failed to disable hub_ldo %d",
+				      __func__, ret);
 	}
+
+	return POGO_HUB_POWER_OFF_MS;
 }
 
-static void switch_to_usbc_locked(struct pogo_transport *pogo_transport)
+/*
+ * Second half of the reset and power cycle rungs: power hub_ldo back up if it is off and release
+ * the reset. The hub drops off the root port and enumerates again from here.
+ *
+ * This function is guarded by (max77759_plat)->data_path_lock
+ */
+static void pogo_transport_hub_recover_release_locked(struct pogo_transport *pogo_transport,
+						      int step)
 {
-	struct max77759_plat *chip = pogo_transport->chip;
 	int ret;
 
-	if (pogo_transport->pogo_usb_active) {
-		ret = extcon_set_state_sync(chip->extcon, EXTCON_USB_HOST, 0);
-		logbuffer_log(pogo_transport->log, "%s: %s turning off host for Pogo", __func__,
-			      ret < 0 ? "Failed" : "Succeeded");
-		pogo_transport->pogo_usb_active = false;
+	pogo_transport->hub_recover_hold = false;
+	if (step == HUB_RECOVER_POWER_CYCLE && pogo_transport->hub_ldo &&
+	    regulator_is_enabled(pogo_transport->hub_ldo) <= 0) {
+		ret = pogo_transport_set_regulator(pogo_transport, pogo_transport->hub_ldo,
+						   "usb-hub", true);
+		if (ret)
+			logbuffer_log(pogo_transport->log, "%s: Failed to enable hub_ldo %d",
+				      __func__, ret);
 	}
+	pogo_transport_hub_reset(pogo_transport, false);
 
-	disable_and_bypass_hub(pogo_transport);
-
-	ret = pinctrl_select_state(pogo_transport->pinctrl, pogo_transport->susp_usb_state);
-	if (ret)
-		dev_err(pogo_transport->dev, "failed to select suspend in usb state ret:%d\n", ret);
+	if (step == HUB_RECOVER_POWER_CYCLE) {
+		WRITE_ONCE(pogo_transport->hub_reset_ns, 0);
+		WRITE_ONCE(pogo_transport->hub_switch_ns, ktime_get_boottime_ns());
+	} else {
+		WRITE_ONCE(pogo_transport->hub_switch_ns, 0);
+		WRITE_ONCE(pogo_transport->hub_reset_ns, ktime_get_boottime_ns());
+	}
+}
 
-	gpio_set_value(pogo_transport->pogo_data_mux_gpio, 0);
-	logbuffer_log(pogo_transport->log, "POGO: data-mux:%d",
-		      gpio_get_value(pogo_transport->pogo_data_mux_gpio));
-	data_alt_path_active(chip, false);
+/* The window after @step of the ladder: hub_enum_timeout_ms, growing by a quarter per rung */
+static unsigned long pogo_transport_hub_enum_backoff_ms(struct pogo_transport *pogo_transport,
+							int step)
+{
+	unsigned long delay_ms = pogo_transport->hub_enum_timeout_ms;
 
-	/*
-	 * Calling extcon_set_state_sync to turn off the host resets the orientation of USB-C and
-	 * the USB phy was also reset to the default value CC1.
-	 * Update the orientation for superspeed phy if USB-C is connected and CC2 is active.
-	 */
-	if (pogo_transport->polarity == TYPEC_POLARITY_CC2)
-		pogo_transport_update_polarity(pogo_transport, TYPEC_POLARITY_CC2, false);
+	while (step-- > 0)
+		delay_ms += delay_ms / 4;
 
-	enable_data_path_locked(chip);
-	/* pogo_transport->pogo_usb_active updated. Delaying till usb-c is activated. */
-	kobject_uevent(&pogo_transport->dev->kobj, KOBJ_CHANGE);
+	return delay_ms;
 }
 
-static void switch_to_pogo_locked(struct pogo_transport *pogo_transport)
-{
-	struct max77759_plat *chip = pogo_transport->chip;
+/*
+ * The SSPHY has been restarted for an orientation change. The hub is expected to enumerate again
+ * on its own; only start the watchdog so that it gets reset if nothing shows up.
+ *
+ * This function is guarded by (max77759_plat)->data_path_lock
+ */
+static void pogo_transport_hub_ssphy_restarted_locked(struct pogo_transport *pogo_transport)
+{
+	if (!pogo_transport->pogo_hub_active || pogo_transport->hub_gated)
+		return;
+
+	pogo_transport_hub_enum_arm(pogo_transport);
+}
+
+/*
+ * Nothing enumerated behind the hub within the window. Take the next rung of the recovery ladder,
+ * from the cheapest to the most disruptive: polarity re-sync, SSPHY restart, hub reset and hub_ldo
+ * power cycle. Each rung waits a quarter longer than the one before for the hub to show up.
+ *
+ * With a window of T the rungs fire at T, 2T, 3.25T and 4.8T after the watchdog is armed and it
+ * gives up at about 6.8T. With the default 150ms the power cycle goes out at 721ms, including the
+ * 1ms reset hold, and the ladder is exhausted at 1022ms.
+ */
+static void pogo_transport_hub_enum_work(struct kthread_work *work)
+{
+	struct pogo_transport *pogo_transport =
+		container_of(container_of(work, struct kthread_delayed_work, work),
+			     struct pogo_transport, hub_enum_work);
+	struct max77759_plat *chip = pogo_transport->chip;
+	unsigned long delay_ms;
+	int step;
+
+	mutex_lock(&chip->data_path_lock);
+	if (!pogo_transport->hub_enum_timeout_ms || !pogo_transport->pogo_hub_active ||
+	    pogo_transport->hub_gated || !READ_ONCE(pogo_transport->hub_enum_expected)) {
+		/* Someone else took the hub over; a gated hub stays in reset */
+		if (pogo_transport->hub_recover_hold) {
+			pogo_transport->hub_recover_hold = false;
+			if (!pogo_transport->hub_gated)
+				pogo_transport_hub_reset(pogo_transport, false);
+		}
+		goto unlock;
+	}
+
+	step = atomic_read(&pogo_transport->hub_recover_step);
+	if (pogo_transport->hub_recover_hold) {
+		pogo_transport_hub_recover_release_locked(pogo_transport, step - 1);
+		delay_ms = pogo_transport_hub_enum_backoff_ms(pogo_transport, step - 1) +
+			   DIV_ROUND_UP(pogo_transport->hub_reset_settle_us, USEC_PER_MSEC);
+		goto rearm;
+	}
+
+	if (step >= HUB_RECOVER_STEPS) {
+		atomic_inc(&pogo_transport->hub_recover_exhausted);
+		logbuffer_log(pogo_transport->log, "hub recovery exhausted");
+		goto unlock;
+	}
+
+	atomic_inc(&pogo_transport->hub_recover_attempts[step]);
+	logbuffer_log(pogo_transport->log, "hub enumeration timeout, recovery:%s",
+		      pogo_hub_recover_names[step]);
+
+	delay_ms = pogo_transport_hub_enum_backoff_ms(pogo_transport, step);
+	switch (step) {
+	case HUB_RECOVER_POLARITY:
+		pogo_transport_update_polarity(pogo_transport, pogo_transport->polarity, true);
+		break;
+	case HUB_RECOVER_SSPHY:
+		ssphy_restart_control(pogo_transport, true);
+		break;
+	case HUB_RECOVER_RESET:
+	case HUB_RECOVER_POWER_CYCLE:
+		delay_ms = pogo_transport_hub_recover_hold_locked(pogo_transport, step);
+		break;
+	}
+	atomic_set(&pogo_transport->hub_recover_step, step + 1);
+
+rearm:
+	kthread_mod_delayed_work(pogo_transport->wq, &pogo_transport->hub_enum_work,
+				 msecs_to_jiffies(delay_ms));
+
+unlock:
+	mutex_unlock(&chip->data_path_lock);
+}
+
+/*
+ * Power the hub up on H1S attach so it is out of its power-on time by the time the dock is
+ * qualified. The hub is held in reset and left unselected until switch_to_hub_locked() takes over.
+ *
+ * This function is guarded by (max77759_plat)->data_path_lock
+ */
+static void pogo_transport_hub_speculate_locked(struct pogo_transport *pogo_transport)
+{
+	int ret;
+
+	if (!pogo_transport->hub_speculative || !pogo_transport->hub_embedded ||
+	    !pogo_transport->hub_ldo || pogo_transport->hub_spec_on ||
+	    pogo_transport->pogo_hub_active)
+		return;
+
+	pogo_transport_hub_reset(pogo_transport, true);
+	ret = pogo_transport_set_regulator(pogo_transport, pogo_transport->hub_ldo, "usb-hub",
+					   true);
+	if (ret) {
+		logbuffer_log(pogo_transport->log, "%s: Failed to enable hub_ldo %d", __func__,
+			      ret);
+		pogo_transport_hub_reset(pogo_transport, false);
+		return;
+	}
+
+	pogo_transport->hub_spec_on = true;
+	kthread_mod_delayed_work(pogo_transport->wq, &pogo_transport->hub_spec_work,
+				 msecs_to_jiffies(POGO_HUB_SPEC_TIMEOUT_MS));
+	logbuffer_log(pogo_transport->log, "hub speculative power-up");
+}
+
+/*
+ * Roll back a speculative hub power-up that switch_to_hub_locked() did not take over.
+ *
+ * This function is guarded by (max77759_plat)->data_path_lock
+ */
+static void pogo_transport_hub_speculate_miss_locked(struct pogo_transport *pogo_transport,
+						     const char *reason)
+{
+	int ret;
+
+	if (!pogo_transport->hub_spec_on)
+		return;
+
+	pogo_transport->hub_spec_on = false;
+	atomic_inc(&pogo_transport->hub_spec_misses);
+	ret = pogo_transport_set_regulator(pogo_transport, pogo_transport->hub_ldo, "usb-hub",
+					   false);
+	if (ret)
+		logbuffer_log(pogo_transport->log, "%s: Failed to disable hub_ldo %d", __func__,
+			      ret);
+	pogo_transport_hub_reset(pogo_transport, false);
+	logbuffer_log(pogo_transport->log, "hub speculation missed: %s", reason);
+}
+
+static void pogo_transport_hub_spec_work(struct kthread_work *work)
+{
+	struct pogo_transport *pogo_transport =
+		container_of(container_of(work, struct kthread_delayed_work, work),
+			     struct pogo_transport, hub_spec_work);
+	struct max77759_plat *chip = pogo_transport->chip;
+
+	mutex_lock(&chip->data_path_lock);
+	pogo_transport_hub_speculate_miss_locked(pogo_transport, "timeout");
+	mutex_unlock(&chip->data_path_lock);
+}
+
+static void disable_and_bypass_hub(struct pogo_transport *pogo_transport)
+{
+	int ret;
+
+	if (!pogo_transport->hub_embedded)
+		return;
+
+	pogo_transport_hub_speculate_miss_locked(pogo_transport, "bypass");
+	WRITE_ONCE(pogo_transport->hub_switch_ns, 0);
+	WRITE_ONCE(pogo_transport->hub_reset_ns, 0);
+	WRITE_ONCE(pogo_transport->hub_enum_expected, false);
+
+	/* hub_ldo is already off if the hub was gated; only release the reset */
+	if (pogo_transport->hub_gated) {
+		pogo_transport->hub_gated = false;
+		pogo_transport_hub_reset(pogo_transport, false);
+	}
+
+	/* USB_MUX_HUB_SEL set to 0 to bypass the hub */
+	gpio_set_value(pogo_transport->pogo_hub_sel_gpio, 0);
+	logbuffer_log(pogo_transport->log, "POGO: hub-mux:%d",
+		      gpio_get_value(pogo_transport->pogo_hub_sel_gpio));
+	pogo_transport->pogo_hub_active = false;
+	pogo_transport_snapshot_changed(pogo_transport);
+
+	/*
+	 * No further action in the callback of the votable if it is disabled. Disable it here for
+	 * the bookkeeping purpose in the dumpstate.
+	 */
+	ssphy_restart_control(pogo_transport, false);
+
+	if (pogo_transport->hub_ldo && regulator_is_enabled(pogo_transport->hub_ldo) > 0) {
+		ret = pogo_transport_set_regulator(pogo_transport, pogo_transport->hub_ldo,
+						   "usb-hub", false);
+		if (ret)
+			logbuffer_log(pogo_transport->log, "Failed to disable hub_ldo %d", ret);
+	}
+}
+
+/*
+ * Power the hub back up if hub_idle_work has gated it.
+ *
+ * This function is guarded by (max77759_plat)->data_path_lock
+ */
+static void pogo_transport_hub_ungate_locked(struct pogo_transport *pogo_transport)
+{
+	int ret;
+
+	if (!pogo_transport->hub_gated)
+		return;
+
+	pogo_transport->hub_gated = false;
+	if (pogo_transport->hub_ldo) {
+		ret = pogo_transport_set_regulator(pogo_transport, pogo_transport->hub_ldo,
+						   "usb-hub", true);
+		if (ret)
+			logbuffer_log(pogo_transport->log, "%s: Failed to enable hub_ldo %d",
+				      __func__, ret);
+	}
+	pogo_transport_hub_reset(pogo_transport, false);
+	WRITE_ONCE(pogo_transport->hub_switch_ns, ktime_get_boottime_ns());
+	pogo_transport_hub_enum_arm(pogo_transport);
+	logbuffer_log(pogo_transport->log, "hub ungated");
+}
+
+/*
+ * Ungate the hub if an event asked for it and the data path is still on the hub once the State
+ * Machine has settled. The switches away from the hub release a gated hub themselves.
+ *
+ * This function is guarded by (max77759_plat)->data_path_lock
+ */
+static void pogo_transport_hub_wake_locked(struct pogo_transport *pogo_transport)
+{
+	if (!pogo_transport->hub_wake_pending)
+		return;
+
+	pogo_transport->hub_wake_pending = false;
+	if (pogo_transport->pogo_hub_active)
+		pogo_transport_hub_ungate_locked(pogo_transport);
+}
+
+/* The hub is idle if it is enabled, both HCDs are suspended and no device is attached */
+static bool pogo_transport_hub_idle(struct pogo_transport *pogo_transport)
+{
+	return pogo_transport->hub_idle_ms && pogo_transport->pogo_hub_active &&
+	       !pogo_transport->hub_gated && bus_suspend(pogo_transport) &&
+	       !atomic_read(&pogo_transport->hub_udev_count);
+}
+
+/* Arm hub_idle_work if the hub is idle; the work checks again under data_path_lock */
+static void pogo_transport_hub_idle_check(struct pogo_transport *pogo_transport)
+{
+	if (pogo_transport_hub_idle(pogo_transport))
+		kthread_mod_delayed_work(pogo_transport->wq, &pogo_transport->hub_idle_work,
+					 msecs_to_jiffies(pogo_transport->hub_idle_ms));
+}
+
+static void pogo_transport_hub_idle_work(struct kthread_work *work)
+{
+	struct pogo_transport *pogo_transport =
+		container_of(container_of(work, struct kthread_delayed_work, work),
+			     struct pogo_transport, hub_idle_work);
+	struct max77759_plat *chip = pogo_transport->chip;
+	int ret;
+
+	mutex_lock(&chip->data_path_lock);
+	if (!pogo_transport_hub_idle(pogo_transport))
+		goto unlock;
+
+	pogo_transport_hub_reset(pogo_transport, true);
+	if (pogo_transport->hub_ldo && regulator_is_enabled(pogo_transport->hub_ldo) > 0) {
+		ret = pogo_transport_set_regulator(pogo_transport, pogo_transport->hub_ldo,
+						   "usb-hub", false);
+		if (ret) {
+			logbuffer_log(pogo_transport->log, "%s: Failed to disable hub_ldo %d",
+				      __func__, ret);
+			pogo_transport_hub_reset(pogo_transport, false);
+			goto unlock;
+		}
+	}
+	pogo_transport->hub_gated = true;
+	logbuffer_log(pogo_transport->log, "hub gated after %lu ms idle",
+		      pogo_transport->hub_idle_ms);
+
+unlock:
+	mutex_unlock(&chip->data_path_lock);
+}
+
+static void switch_to_usbc_locked(struct pogo_transport *pogo_transport)
+{
+	struct max77759_plat *chip = pogo_transport->chip;
+	int ret;
+
+	trace_pogo_transport_switch_path(pogo_transport->dev, "usbc",
+					 pogo_transport->pogo_usb_active, chip->data_active);
+	pogo_transport_cancel_hub_host(pogo_transport);
+
+	if (pogo_transport->pogo_usb_active) {
+		ret = extcon_set_state_sync(chip->extcon, EXTCON_USB_HOST, 0);
+		logbuffer_log(pogo_transport->log, "%s: %s turning off host for Pogo", __func__,
+			      ret < 0 ? "Failed" : "Succeeded");
+		pogo_transport->pogo_usb_active = false;
+	}
+
+	disable_and_bypass_hub(pogo_transport);
+
+	ret = pinctrl_select_state(pogo_transport->pinctrl, pogo_transport->susp_usb_state);
+	if (ret)
+		dev_err(pogo_transport->dev, "failed to select suspend in usb state ret:%d\n", ret);
+
+	gpio_set_value(pogo_transport->pogo_data_mux_gpio, 0);
+	logbuffer_log(pogo_transport->log, "POGO: data-mux:%d",
+		      gpio_get_value(pogo_transport->pogo_data_mux_gpio));
+	pogo_transport_snapshot_changed(pogo_transport);
+	data_alt_path_active(chip, false);
+
+	/*
+	 * Calling extcon_set_state_sync to turn off the host resets the orientation of USB-C and
+	 * the USB phy was also reset to the default value CC1.
+	 * Update the orientation for superspeed phy if USB-C is connected and CC2 is active.
+	 */
+	if (pogo_transport->polarity == TYPEC_POLARITY_CC2)
+		pogo_transport_update_polarity(pogo_transport, TYPEC_POLARITY_CC2, false);
+
+	enable_data_path_locked(chip);
+	/* pogo_transport->pogo_usb_active updated. Delaying till usb-c is activated. */
+	pogo_transport_uevent(pogo_transport);
+}
+
+static void switch_to_pogo_locked(struct pogo_transport *pogo_transport)
+{
+	struct max77759_plat *chip = pogo_transport->chip;
 	int ret;
 
+	trace_pogo_transport_switch_path(pogo_transport->dev, "pogo",
+					 pogo_transport->pogo_usb_active, chip->data_active);
+	pogo_transport_cancel_hub_host(pogo_transport);
+
 	data_alt_path_active(chip, true);
 	if (chip->data_active) {
 		ret = extcon_set_state_sync(chip->extcon, chip->active_data_role == TYPEC_HOST ?
@@ -547,15 +1468,62 @@ static void switch_to_pogo_locked(struct pogo_transport *pogo_transport)
 	logbuffer_log(pogo_transport->log, "%s: %s turning on host for Pogo", __func__, ret < 0 ?
 		      "Failed" : "Succeeded");
 	pogo_transport->pogo_usb_active = true;
+	pogo_transport_snapshot_changed(pogo_transport);
 	/* pogo_transport->pogo_usb_active updated */
-	kobject_uevent(&pogo_transport->dev->kobj, KOBJ_CHANGE);
+	pogo_transport_uevent(pogo_transport);
+}
+
+/*
+ * Second half of switch_to_hub_locked(): turn on Host Mode for the hub.
+ *
+ * This function is guarded by (max77759_plat)->data_path_lock
+ */
+static void pogo_transport_hub_host_on_locked(struct pogo_transport *pogo_transport)
+{
+	struct max77759_plat *chip = pogo_transport->chip;
+	int ret;
+
+	/*
+	 * The polarity was reset to 0 when Host Mode was disabled for USB-C or POGO. If current
+	 * polarity is CC2, update it to ssphy before enabling the Host Mode for hub.
+	 */
+	if (pogo_transport->polarity == TYPEC_POLARITY_CC2)
+		pogo_transport_update_polarity(pogo_transport, pogo_transport->polarity, false);
+
+	ret = extcon_set_state_sync(chip->extcon, EXTCON_USB_HOST, 1);
+	logbuffer_log(pogo_transport->log, "%s: %s turning on host for hub", __func__, ret < 0 ?
+		      "Failed" : "Succeeded");
+	pogo_transport_hub_enum_arm(pogo_transport);
+
+	/* pogo_transport->pogo_usb_active updated.*/
+	pogo_transport_uevent(pogo_transport);
+}
+
+static void pogo_transport_hub_host_work(struct kthread_work *work)
+{
+	struct pogo_transport *pogo_transport =
+			container_of(container_of(work, struct kthread_delayed_work, work),
+				     struct pogo_transport, hub_host_work);
+	struct max77759_plat *chip = pogo_transport->chip;
+
+	mutex_lock(&chip->data_path_lock);
+	if (pogo_transport->hub_host_pending) {
+		pogo_transport->hub_host_pending = false;
+		pogo_transport_hub_host_on_locked(pogo_transport);
+	}
+	mutex_unlock(&chip->data_path_lock);
 }
 
 static void switch_to_hub_locked(struct pogo_transport *pogo_transport)
 {
 	struct max77759_plat *chip = pogo_transport->chip;
+	bool mode_changed = false;
 	int ret;
 
+	trace_pogo_transport_switch_path(pogo_transport->dev, "hub",
+					 pogo_transport->pogo_usb_active, chip->data_active);
+	pogo_transport_cancel_hub_host(pogo_transport);
+
 	/*
 	 * TODO: set alt_path_active; re-design this function for
 	 * 1. usb-c only (hub disabled)
@@ -573,10 +1541,12 @@ static void switch_to_hub_locked(struct pogo_transport *pogo_transport)
 			      "Failed" : "Succeeded", chip->active_data_role == TYPEC_HOST ?
 			      "Host" : "Device");
 		chip->data_active = false;
+		mode_changed = true;
 	}
 
 	/* if pogo-usb is active, disable it */
 	if (pogo_transport->pogo_usb_active) {
+		mode_changed = true;
 		ret = extcon_set_state_sync(chip->extcon, EXTCON_USB_HOST, 0);
 		logbuffer_log(pogo_transport->log, "%s: %s turning off host for Pogo", __func__,
 			      ret < 0 ? "Failed" : "Succeeded");
@@ -588,13 +1558,26 @@ static void switch_to_hub_locked(struct pogo_transport *pogo_transport)
 		pogo_transport->pogo_usb_active = false;
 	}
 
-	if (pogo_transport->hub_ldo) {
-		ret = regulator_enable(pogo_transport->hub_ldo);
+	if (pogo_transport->hub_spec_on) {
+		/* hub_ldo is already on; release the reset held since the H1S attach */
+		pogo_transport->hub_spec_on = false;
+		atomic_inc(&pogo_transport->hub_spec_hits);
+		pogo_transport_hub_reset(pogo_transport, false);
+		logbuffer_log(pogo_transport->log, "hub speculation hit");
+	} else if (pogo_transport->hub_ldo) {
+		ret = pogo_transport_set_regulator(pogo_transport, pogo_transport->hub_ldo,
+						   "usb-hub", true);
 		if (ret)
 			logbuffer_log(pogo_transport->log, "%s: Failed to enable hub_ldo %d",
 				      __func__, ret);
 	}
 
+	/* hub_ldo was off if the hub was gated; release the reset now that it is powered */
+	if (pogo_transport->hub_gated) {
+		pogo_transport->hub_gated = false;
+		pogo_transport_hub_reset(pogo_transport, false);
+	}
+
 	ret = pinctrl_select_state(pogo_transport->pinctrl, pogo_transport->hub_state);
 	if (ret)
 		dev_err(pogo_transport->dev, "failed to select hub state ret:%d\n", ret);
@@ -608,51 +1591,174 @@ static void switch_to_hub_locked(struct pogo_transport *pogo_transport)
 		      gpio_get_value(pogo_transport->pogo_data_mux_gpio),
 		      gpio_get_value(pogo_transport->pogo_hub_sel_gpio));
 
-	/* wait for the host mode to be turned off completely */
-	mdelay(60);
+	pogo_transport->pogo_usb_active = true;
+	pogo_transport->pogo_hub_active = true;
+	pogo_transport_snapshot_changed(pogo_transport);
+	WRITE_ONCE(pogo_transport->hub_switch_ns, ktime_get_boottime_ns());
+
+	if (!mode_changed) {
+		pogo_transport_hub_host_on_locked(pogo_transport);
+		return;
+	}
 
 	/*
-	 * The polarity was reset to 0 when Host Mode was disabled for USB-C or POGO. If current
-	 * polarity is CC2, update it to ssphy before enabling the Host Mode for hub.
+	 * Wait for the previous mode to be turned off completely before turning on Host Mode for
+	 * the hub. Finish from hub_host_work instead of stalling the worker, and the TCPC behind
+	 * data_path_lock, for the whole period.
 	 */
-	if (pogo_transport->polarity == TYPEC_POLARITY_CC2)
-		pogo_transport_update_polarity(pogo_transport, pogo_transport->polarity, false);
+	pogo_transport->hub_host_pending = true;
+	kthread_mod_delayed_work(pogo_transport->wq, &pogo_transport->hub_host_work,
+				 msecs_to_jiffies(POGO_HUB_HOST_OFF_WAIT_MS));
+}
 
-	ret = extcon_set_state_sync(chip->extcon, EXTCON_USB_HOST, 1);
-	logbuffer_log(pogo_transport->log, "%s: %s turning on host for hub", __func__, ret < 0 ?
-		      "Failed" : "Succeeded");
+static void pogo_transport_timing_add(struct pogo_transport_timing *timing, u64 elapsed_ns)
+{
+	unsigned int bucket = fls64(div_u64(elapsed_ns, NSEC_PER_USEC));
 
-	pogo_transport->pogo_usb_active = true;
-	pogo_transport->pogo_hub_active = true;
-	/* pogo_transport->pogo_usb_active updated.*/
-	kobject_uevent(&pogo_transport->dev->kobj, KOBJ_CHANGE);
+	timing->count++;
+	timing->total_ns += elapsed_ns;
+	timing->max_ns = max(timing->max_ns, elapsed_ns);
+	timing->hist[min_t(unsigned int, bucket, POGO_TIMING_BUCKETS - 1)]++;
 }
 
-static void update_pogo_transport(struct pogo_transport *pogo_transport,
-				  enum pogo_event_type event_type)
+static void pogo_transport_timing_record(struct pogo_transport_timing *timing, u64 start_ns)
 {
-	struct max77759_plat *chip = pogo_transport->chip;
-	int ret;
-	union power_supply_propval voltage_now = {0};
-	bool docked = !gpio_get_value(pogo_transport->pogo_gpio);
-	bool acc_detected = gpio_get_value(pogo_transport->pogo_acc_gpio);
+	pogo_transport_timing_add(timing, ktime_get_ns() - start_ns);
+}
 
-	ret = power_supply_get_property(pogo_transport->pogo_psy, POWER_SUPPLY_PROP_VOLTAGE_NOW,
-					&voltage_now);
-	if (ret) {
-		dev_err(pogo_transport->dev, "%s voltage now read err: %d\n", __func__, ret);
-		if (ret == -EAGAIN)
+static const char *pogo_blog_state(u32 state)
+{
+	return state < ARRAY_SIZE(pogo_states) ? pogo_states[state] : "?";
+}
+
+static int pogo_transport_blog_format(char *buf, size_t size, const struct pogo_blog_entry *entry)
+{
+	const u32 *args = entry->args;
+
+	switch (entry->id) {
+	case BLOG_POGO_ISR:
+		return scnprintf(buf, size, "POGO IRQ triggered");
+	case BLOG_ACC_ISR:
+		return scnprintf(buf, size, "POGO ACC IRQ triggered");
+	case BLOG_POGO_IRQ:
+		return scnprintf(buf, size, "Pogo threaded irq running, pogo_gpio %u", args[0]);
+	case BLOG_ACC_IRQ:
+		return scnprintf(buf, size, "Pogo acc threaded irq running, acc_detect %u",
+				 args[0]);
+	case BLOG_QUEUE_EVENT:
+		return scnprintf(buf, size, "QUEUE EVENT %u", args[0]);
+	case BLOG_PENDING_STATE:
+		return scnprintf(buf, size, "pending state change %s -> %s @ %u ms",
+				 pogo_blog_state(args[0]), pogo_blog_state(args[1]), args[2]);
+	case BLOG_STATE:
+		return scnprintf(buf, size, "state change %s -> %s [%s]", pogo_blog_state(args[0]),
+				 pogo_blog_state(args[1]), args[2] ? "lc" : "");
+	case BLOG_DELAYED_STATE:
+		return scnprintf(buf, size, "state change %s -> %s [delayed %u ms] [%s]",
+				 pogo_blog_state(args[0]), pogo_blog_state(args[1]), args[2],
+				 args[3] ? "lc" : "");
+	default:
+		return scnprintf(buf, size, "unknown id %u", entry->id);
+	}
+}
+
+/*
+ * Binary log for the hot paths, safe from hard IRQ context. The arguments are stored in a per-CPU
+ * ring and only formatted when debugfs "blog" is read, or right away into logbuffer if
+ * logbuffer_verbose is set.
+ */
+static void pogo_transport_blog(struct pogo_transport *pogo_transport, enum pogo_blog_id id,
+				u32 arg0, u32 arg1, u32 arg2, u32 arg3)
+{
+	struct pogo_blog_entry entry = {
+		.ts_ns = ktime_get_boottime_ns(),
+		.id = id,
+		.args = { arg0, arg1, arg2, arg3 },
+	};
+	struct pogo_blog_ring *ring;
+	char buf[POGO_BLOG_LINE];
+	unsigned long flags;
+
+	if (pogo_transport->blog) {
+		local_irq_save(flags);
+		ring = this_cpu_ptr(pogo_transport->blog);
+		ring->entries[ring->head++ % POGO_BLOG_SIZE] = entry;
+		local_irq_restore(flags);
+	}
+
+	if (READ_ONCE(modparam_logbuffer_verbose)) {
+		pogo_transport_blog_format(buf, sizeof(buf), &entry);
+		logbuffer_log(pogo_transport->log, "%s", buf);
+	}
+}
+
+/*
+ * Called with the dock voltage below POGO_USB_CAPABLE_THRESHOLD_UV. Starts the qualification on
+ * the first read and (re)arms voltage_qual_work for the remainder of POGO_USB_QUAL_TIMEOUT_MS, as a
+ * pogo_psy notification may have run the work early. Returns true once the timeout has expired.
+ */
+static bool pogo_transport_voltage_qual_timeout(struct pogo_transport *pogo_transport)
+{
+	u64 now = ktime_get_boottime_ns();
+	u64 elapsed_ms;
+
+	if (!pogo_transport->voltage_qual_start_ns)
+		pogo_transport->voltage_qual_start_ns = now;
+
+	elapsed_ms = div_u64(now - pogo_transport->voltage_qual_start_ns, NSEC_PER_MSEC);
+	if (elapsed_ms >= POGO_USB_QUAL_TIMEOUT_MS) {
+		pogo_transport->voltage_qual_start_ns = 0;
+		return true;
+	}
+
+	kthread_mod_delayed_work(pogo_transport->wq, &pogo_transport->voltage_qual_work,
+				 msecs_to_jiffies(POGO_USB_QUAL_TIMEOUT_MS - elapsed_ms));
+
+	return false;
+}
+
+static void update_pogo_transport(struct pogo_transport *pogo_transport,
+				  enum pogo_event_type event_type)
+{
+	struct max77759_plat *chip = pogo_transport->chip;
+	int ret;
+	union power_supply_propval voltage_now = {0};
+	bool docked = !gpio_get_value(pogo_transport->pogo_gpio);
+	bool acc_detected = gpio_get_value(pogo_transport->pogo_acc_gpio);
+	u64 start_ns;
+
+	ret = power_supply_get_property(pogo_transport->pogo_psy, POWER_SUPPLY_PROP_VOLTAGE_NOW,
+					&voltage_now);
+	if (ret) {
+		dev_err(pogo_transport->dev, "%s voltage now read err: %d\n", __func__, ret);
+		if (ret == -EAGAIN && pogo_transport->pogo_psy_nb_registered) {
+			/* Read again on the next pogo_psy change, or after the back off */
+			pogo_transport->voltage_read_pending = true;
+			kthread_mod_delayed_work(pogo_transport->wq,
+						 &pogo_transport->voltage_qual_work,
+						 msecs_to_jiffies(POGO_PSY_NRDY_RETRY_MS));
+		} else if (ret == -EAGAIN) {
 			pogo_transport_event(pogo_transport, EVENT_RETRY_READ_VOLTAGE,
 					     POGO_PSY_NRDY_RETRY_MS);
+		}
 		goto free;
 	}
+	pogo_transport->voltage_read_pending = false;
 
 	if (event_type == EVENT_DOCKING || event_type == EVENT_RETRY_READ_VOLTAGE) {
 		if (docked) {
 			if (pogo_transport->disable_voltage_detection ||
 			    voltage_now.intval >= POGO_USB_CAPABLE_THRESHOLD_UV) {
+				pogo_transport->voltage_qual_start_ns = 0;
 				pogo_transport->pogo_usb_capable = true;
 				update_extcon_dev(pogo_transport, true, true);
+			} else if (pogo_transport->pogo_psy_nb_registered) {
+				/* Wait for pogo_psy to report the voltage crossing the threshold */
+				if (pogo_transport_voltage_qual_timeout(pogo_transport)) {
+					pogo_transport->pogo_usb_capable = false;
+					update_extcon_dev(pogo_transport, true, false);
+				}
+				goto free;
 			} else {
 				/* retry every 50ms * 10 times */
 				if (pogo_transport->retry_count < POGO_USB_RETRY_COUNT) {
@@ -669,12 +1775,18 @@ static void update_pogo_transport(struct pogo_transport *pogo_transport,
 		} else {
 			/* Clear retry count when un-docked */
 			pogo_transport->retry_count = 0;
+			pogo_transport->voltage_qual_start_ns = 0;
 			pogo_transport->pogo_usb_capable = false;
 			update_extcon_dev(pogo_transport, false, false);
 		}
 	}
 
 	mutex_lock(&chip->data_path_lock);
+	start_ns = ktime_get_ns();
+	/* Docking and USB-C data changes may use the hub; see pogo_transport_hub_wake_locked() */
+	if ((event_type == EVENT_DOCKING && docked) || event_type == EVENT_RETRY_READ_VOLTAGE ||
+	    event_type == EVENT_DATA_ACTIVE_CHANGED)
+		pogo_transport->hub_wake_pending = true;
 
 	/* Special case for force_usb: ignore everything */
 	if (modparam_force_usb)
@@ -764,7 +1876,9 @@ static void update_pogo_transport(struct pogo_transport *pogo_transport,
 
 		if (pogo_transport->acc_detect_ldo &&
 		    pogo_transport->accessory_detection_enabled == ENABLED) {
-			ret = regulator_enable(pogo_transport->acc_detect_ldo);
+			ret = pogo_transport_set_regulator(pogo_transport,
+							   pogo_transport->acc_detect_ldo,
+							   "acc-detect", true);
 			if (ret)
 				logbuffer_log(pogo_transport->log, "%s: Failed to enable acc_detect %d",
 					      __func__, ret);
@@ -775,8 +1889,7 @@ static void update_pogo_transport(struct pogo_transport *pogo_transport,
 				disable_irq_nosync(pogo_transport->pogo_irq);
 				pogo_transport->pogo_irq_enabled = false;
 			}
-			ret = gvotable_cast_long_vote(pogo_transport->charger_mode_votable,
-						      POGO_VOTER, GBMS_POGO_VOUT, 1);
+			ret = pogo_transport_vote_charger_mode(pogo_transport, GBMS_POGO_VOUT, 1);
 			if (ret)
 				logbuffer_log(pogo_transport->log,
 					      "%s: Failed to vote VOUT, ret %d", __func__, ret);
@@ -786,15 +1899,16 @@ static void update_pogo_transport(struct pogo_transport *pogo_transport,
 		break;
 	case EVENT_HALL_SENSOR_ACC_UNDOCKED:
 		pogo_transport->mock_hid_connected = 0;
-		ret = gvotable_cast_long_vote(pogo_transport->charger_mode_votable, POGO_VOTER,
-					      GBMS_POGO_VOUT, 0);
+		ret = pogo_transport_vote_charger_mode(pogo_transport, GBMS_POGO_VOUT, 0);
 		if (ret)
 			logbuffer_log(pogo_transport->log, "%s: Failed to unvote VOUT, ret %d",
 				      __func__, ret);
 
 		if (pogo_transport->acc_detect_ldo &&
 		    regulator_is_enabled(pogo_transport->acc_detect_ldo)) {
-			ret = regulator_disable(pogo_transport->acc_detect_ldo);
+			ret = pogo_transport_set_regulator(pogo_transport,
+							   pogo_transport->acc_detect_ldo,
+							   "acc-detect", false);
 			if (ret)
 				logbuffer_log(pogo_transport->log, "%s: Failed to disable acc_detect %d",
 					      __func__, ret);
@@ -829,8 +1943,7 @@ static void update_pogo_transport(struct pogo_transport *pogo_transport,
 			pogo_transport->acc_irq_enabled = false;
 		}
 
-		ret = gvotable_cast_long_vote(pogo_transport->charger_mode_votable, POGO_VOTER,
-					      GBMS_POGO_VOUT, 1);
+		ret = pogo_transport_vote_charger_mode(pogo_transport, GBMS_POGO_VOUT, 1);
 		if (ret)
 			logbuffer_log(pogo_transport->log, "%s: Failed to vote VOUT, ret %d",
 				      __func__, ret);
@@ -843,7 +1956,9 @@ static void update_pogo_transport(struct pogo_transport *pogo_transport,
 		 */
 		if (pogo_transport->acc_detect_ldo &&
 		    regulator_is_enabled(pogo_transport->acc_detect_ldo)) {
-			ret = regulator_disable(pogo_transport->acc_detect_ldo);
+			ret = pogo_transport_set_regulator(pogo_transport,
+							   pogo_transport->acc_detect_ldo,
+							   "acc-detect", false);
 			if (ret)
 				logbuffer_log(pogo_transport->log, "%s: Failed to disable acc_detect_ldo %d",
 					      __func__, ret);
@@ -874,14 +1989,15 @@ static void update_pogo_transport(struct pogo_transport *pogo_transport,
 		/* Disable, just in case when docked, if acc_detect_ldo was on */
 		if (pogo_transport->acc_detect_ldo &&
 		    regulator_is_enabled(pogo_transport->acc_detect_ldo)) {
-			ret = regulator_disable(pogo_transport->acc_detect_ldo);
+			ret = pogo_transport_set_regulator(pogo_transport,
+							   pogo_transport->acc_detect_ldo,
+							   "acc-detect", false);
 			if (ret)
 				logbuffer_log(pogo_transport->log,
 					      "%s: Failed to disable acc_detect %d", __func__, ret);
 		}
 
-		ret = gvotable_cast_long_vote(pogo_transport->charger_mode_votable, POGO_VOTER,
-					      GBMS_POGO_VOUT, 1);
+		ret = pogo_transport_vote_charger_mode(pogo_transport, GBMS_POGO_VOUT, 1);
 		if (ret)
 			logbuffer_log(pogo_transport->log, "%s: Failed to vote VOUT, ret %d",
 				      __func__, ret);
@@ -896,6 +2012,7 @@ static void update_pogo_transport(struct pogo_transport *pogo_transport,
 			pogo_transport_update_polarity(pogo_transport, pogo_transport->polarity,
 						       true);
 			ssphy_restart_control(pogo_transport, true);
+			pogo_transport_hub_ssphy_restarted_locked(pogo_transport);
 		}
 		break;
 	default:
@@ -903,8 +2020,10 @@ static void update_pogo_transport(struct pogo_transport *pogo_transport,
 	}
 
 exit:
+	pogo_transport_hub_wake_locked(pogo_transport);
+	pogo_transport_timing_record(&pogo_transport->legacy_timing, start_ns);
 	mutex_unlock(&chip->data_path_lock);
-	kobject_uevent(&pogo_transport->dev->kobj, KOBJ_CHANGE);
+	pogo_transport_uevent(pogo_transport);
 free:
 	logbuffer_logk(pogo_transport->log, LOGLEVEL_INFO,
 		       "ev:%u dock:%u f_u:%u f_p:%u f_h:%u p_u:%u p_act:%u hub:%u d_act:%u mock:%u v:%d",
@@ -921,6 +2040,48 @@ free:
 		       voltage_now.intval);
 }
 
+/*
+ * Grab a free slot from the event pool. The slot is claimed with test_and_set_bit_lock() so that
+ * callers from any context can allocate without taking a lock. Falls back to devm_kzalloc() when
+ * the pool is exhausted.
+ */
+static struct pogo_event *pogo_transport_event_alloc(struct pogo_transport *pogo_transport)
+{
+	unsigned int size = pogo_transport->event_pool_size;
+	unsigned int idx;
+	int used, hwm;
+
+	do {
+		idx = find_first_zero_bit(pogo_transport->event_pool_map, size);
+		if (idx >= size) {
+			atomic_inc(&pogo_transport->event_pool_exhausted);
+			return devm_kzalloc(pogo_transport->dev, sizeof(struct pogo_event),
+					    GFP_KERNEL);
+		}
+	} while (test_and_set_bit_lock(idx, pogo_transport->event_pool_map));
+
+	used = atomic_inc_return(&pogo_transport->event_pool_used);
+	hwm = atomic_read(&pogo_transport->event_pool_hwm);
+	while (used > hwm && !atomic_try_cmpxchg(&pogo_transport->event_pool_hwm, &hwm, used))
+		;
+
+	return &pogo_transport->event_pool[idx];
+}
+
+static void pogo_transport_event_free(struct pogo_transport *pogo_transport,
+				      struct pogo_event *evt)
+{
+	struct pogo_event *pool = pogo_transport->event_pool;
+
+	if (evt < pool || evt >= pool + pogo_transport->event_pool_size) {
+		devm_kfree(pogo_transport->dev, evt);
+		return;
+	}
+
+	atomic_dec(&pogo_transport->event_pool_used);
+	clear_bit_unlock(evt - pool, pogo_transport->event_pool_map);
+}
+
 static void process_generic_event(struct kthread_work *work)
 {
 	struct pogo_event *event =
@@ -930,7 +2091,20 @@ static void process_generic_event(struct kthread_work *work)
 
 	update_pogo_transport(pogo_transport, event->event_type);
 
-	devm_kfree(pogo_transport->dev, event);
+	pogo_transport_event_free(pogo_transport, event);
+}
+
+static void pogo_transport_voltage_qual_work(struct kthread_work *work)
+{
+	struct pogo_transport *pogo_transport =
+		container_of(container_of(work, struct kthread_delayed_work, work),
+			     struct pogo_transport, voltage_qual_work);
+
+	/* Stale if the dock was qualified or undocked by another event in the meantime */
+	if (!pogo_transport->voltage_qual_start_ns && !pogo_transport->voltage_read_pending)
+		return;
+
+	update_pogo_transport(pogo_transport, EVENT_RETRY_READ_VOLTAGE);
 }
 
 static void process_debounce_event(struct kthread_work *work)
@@ -954,7 +2128,7 @@ static void pogo_transport_event(struct pogo_transport *pogo_transport,
 		return;
 	}
 
-	evt = devm_kzalloc(pogo_transport->dev, sizeof(*evt), GFP_KERNEL);
+	evt = pogo_transport_event_alloc(pogo_transport);
 	if (!evt) {
 		logbuffer_log(pogo_transport->log, "POGO: Dropping event");
 		return;
@@ -969,36 +2143,6 @@ static void pogo_transport_event(struct pogo_transport *pogo_transport,
 /* State Machine Functions                                                 */
 /*-------------------------------------------------------------------------*/
 
-/*
- * State transition
- *
- * This function is guarded by (max77759_plat)->data_path_lock
- */
-static void pogo_transport_set_state(struct pogo_transport *pogo_transport, enum pogo_state state,
-				     unsigned int delay_ms)
-{
-	if (delay_ms) {
-		logbuffer_log(pogo_transport->log, "pending state change %s -> %s @ %u ms",
-			      pogo_states[pogo_transport->state], pogo_states[state], delay_ms);
-		pogo_transport->delayed_state = state;
-		kthread_mod_delayed_work(pogo_transport->wq, &pogo_transport->state_machine,
-					 msecs_to_jiffies(delay_ms));
-		pogo_transport->delayed_runtime = jiffies + msecs_to_jiffies(delay_ms);
-		pogo_transport->delay_ms = delay_ms;
-	} else {
-		logbuffer_logk(pogo_transport->log, LOGLEVEL_INFO, "state change %s -> %s [%s]",
-			       pogo_states[pogo_transport->state], pogo_states[state],
-			       pogo_transport->lc ? "lc" : "");
-		pogo_transport->delayed_state = INVALID_STATE;
-		pogo_transport->prev_state = pogo_transport->state;
-		pogo_transport->state = state;
-
-		if (!pogo_transport->state_machine_running)
-			kthread_mod_delayed_work(pogo_transport->wq, &pogo_transport->state_machine,
-						 0);
-	}
-}
-
 /*
  * Accessory Detection regulator control
  *  - Return -ENXIO if Accessory Detection regulator does not exist
@@ -1012,13 +2156,23 @@ static int pogo_transport_acc_regulator(struct pogo_transport *pogo_transport, b
 	if (!pogo_transport->acc_detect_ldo)
 		return -ENXIO;
 
+	if (pogo_transport->deferring) {
+		pogo_transport->deferred.acc_ldo_on = enable;
+		if (enable)
+			return 0;
+	}
+
 	if (regulator_is_enabled(pogo_transport->acc_detect_ldo) == enable)
 		return 0;
 
 	if (enable)
-		ret = regulator_enable(pogo_transport->acc_detect_ldo);
+		ret = pogo_transport_set_regulator(pogo_transport,
+						   pogo_transport->acc_detect_ldo,
+						   "acc-detect", true);
 	else
-		ret = regulator_disable(pogo_transport->acc_detect_ldo);
+		ret = pogo_transport_set_regulator(pogo_transport,
+						   pogo_transport->acc_detect_ldo,
+						   "acc-detect", false);
 
 	return ret;
 }
@@ -1036,8 +2190,7 @@ static void pogo_transport_reset_acc_detection(struct pogo_transport *pogo_trans
 {
 	int ret;
 
-	ret = gvotable_cast_long_vote(pogo_transport->charger_mode_votable, POGO_VOTER,
-				      GBMS_POGO_VOUT, 0);
+	ret = pogo_transport_vote_charger_mode(pogo_transport, GBMS_POGO_VOUT, 0);
 	if (ret)
 		logbuffer_log(pogo_transport->log, "%s: Failed to unvote VOUT, ret %d", __func__,
 			      ret);
@@ -1059,1072 +2212,638 @@ static void pogo_transport_reset_acc_detection(struct pogo_transport *pogo_trans
 }
 
 /*
- * This function implements the actions unon entering each state.
+ * Call this function to:
+ *  - Disable POGO OVP
+ *  - Disable Accessory Detection IRQ
+ *  - Disable POGO Voltage Detection IRQ
+ *  - Enable POGO Vout by voting 1 to charger_mode_votable
  *
- * This function is guarded by (max77759_plat)->data_path_lock
+ *  This function is guarded by (max77759_plat)->data_path_lock
  */
-static void pogo_transport_run_state_machine(struct pogo_transport *pogo_transport)
+static void pogo_transport_skip_acc_detection(struct pogo_transport *pogo_transport)
 {
-	bool acc_detected = gpio_get_value(pogo_transport->pogo_acc_gpio);
-	bool docked = !gpio_get_value(pogo_transport->pogo_gpio);
-	struct max77759_plat *chip = pogo_transport->chip;
 	int ret;
 
-	switch (pogo_transport->state) {
-	case STANDBY:
-		/* DATA_STATUS_ENABLED */
-		break;
-	case DOCKING_DEBOUNCED:
-		if (docked) {
-			switch_to_hub_locked(pogo_transport);
-			pogo_transport_set_state(pogo_transport, DOCK_HUB, 0);
-		} else {
-			pogo_transport_set_state(pogo_transport, STANDBY, 0);
-		}
-		break;
-	case DOCK_HUB:
-		/* clear Dock dock detected notification */
-		/* Clear accessory detected notification */
-		/* DATA_STATUS_DISABLED_DEVICE_DOCK */
-		update_extcon_dev(pogo_transport, true, true);
-		break;
-	case DOCK_AUDIO_HUB:
-		update_extcon_dev(pogo_transport, true, true);
-		break;
-	case DEVICE_DOCKING_DEBOUNCED:
-		if (docked) {
-			switch_to_hub_locked(pogo_transport);
-			/* switch_to_hub_locked cleared data_active, set it here */
-			chip->data_active = true;
-			pogo_transport_set_state(pogo_transport, DOCK_DEVICE_HUB, 0);
-		} else {
-			pogo_transport_set_state(pogo_transport, DEVICE_DIRECT, 0);
-		}
-		break;
-	case DOCK_DEVICE_HUB:
-		update_extcon_dev(pogo_transport, true, true);
-		/* DATA_STATUS_DISABLED_DEVICE_DOCK */
-		break;
-	case DEVICE_HUB_DOCKING_DEBOUNCED:
-		if (docked) {
-			pogo_transport_set_state(pogo_transport, DOCK_DEVICE_HUB, 0);
-		} else {
-			pogo_transport_set_state(pogo_transport, DEVICE_HUB, 0);
-		}
-		break;
-	case AUDIO_DIRECT_DOCKING_DEBOUNCED:
-		if (docked) {
-			pogo_transport_set_state(pogo_transport, AUDIO_DIRECT_DOCK_OFFLINE, 0);
-		} else {
-			pogo_transport_set_state(pogo_transport, AUDIO_DIRECT, 0);
-		}
-		break;
-	case AUDIO_DIRECT_DOCK_OFFLINE:
-		/* Push dock detected notification */
-		update_extcon_dev(pogo_transport, true, true);
-		break;
-	case AUDIO_HUB_DOCKING_DEBOUNCED:
-		if (docked) {
-			pogo_transport_set_state(pogo_transport, DOCK_AUDIO_HUB, 0);
-		} else {
-			pogo_transport_set_state(pogo_transport, AUDIO_HUB, 0);
-		}
-		break;
-	case HOST_DIRECT:
-		/* DATA_STATUS_ENABLED */
-		/* Clear Pogo accessory Detected */
-		/* Clear USB accessory detected notification */
-		break;
-	case HOST_DIRECT_DOCKING_DEBOUNCED:
-		if (docked) {
-			if (pogo_transport->force_pogo) {
-				switch_to_hub_locked(pogo_transport);
-				/* switch_to_hub_locked cleared data_active, set it here */
-				chip->data_active = true;
-				pogo_transport_set_state(pogo_transport, DOCK_HUB_HOST_OFFLINE, 0);
-			} else {
-				pogo_transport_set_state(pogo_transport, HOST_DIRECT_DOCK_OFFLINE,
-							 0);
-			}
-		} else {
-			pogo_transport_set_state(pogo_transport, HOST_DIRECT, 0);
-		}
-		break;
-	case HOST_DIRECT_DOCK_OFFLINE:
-		/* Push Dock dock detected notification */
-		update_extcon_dev(pogo_transport, true, true);
-		break;
-	case DOCK_HUB_HOST_OFFLINE:
-		/* Push accessory detected notification */
-		update_extcon_dev(pogo_transport, true, true);
-		break;
-	case STANDBY_ACC_DEBOUNCED:
-	case DEVICE_DIRECT_ACC_DEBOUNCED:
-	case DEVICE_HUB_ACC_DEBOUNCED:
-	case AUDIO_DIRECT_ACC_DEBOUNCED:
-	case AUDIO_HUB_ACC_DEBOUNCED:
-	case HOST_DIRECT_ACC_DEBOUNCED:
-		/* debounce fail; leave the IRQ and regulator enabled and do nothing */
-		if (!acc_detected)
-			break;
+	logbuffer_log(pogo_transport->log, "%s: Skip enabling comparator logic, enable vout",
+		      __func__);
 
-		/*
-		 * Disable the IRQ to ignore the noise after POGO Vout is enabled. It will be
-		 * re-enabled when HES reports the attach event.
-		 */
-		if (pogo_transport->acc_irq_enabled) {
-			disable_irq(pogo_transport->pogo_acc_irq);
-			pogo_transport->acc_irq_enabled = false;
-		}
+	/*
+	 * Disable OVP to prevent the voltage going through POGO_VIN. OVP will be re-enabled once
+	 * we vote GBMS_POGO_VIN and GBMS gets the votable result.
+	 */
+	if (pogo_transport->pogo_ovp_en_gpio >= 0)
+		gpio_set_value_cansleep(pogo_transport->pogo_ovp_en_gpio,
+					!pogo_transport->pogo_ovp_en_active_state);
 
-		/* TODO: queue work for gvotable cast vote if it takes too much time */
-		ret = gvotable_cast_long_vote(pogo_transport->charger_mode_votable, POGO_VOTER,
-					      GBMS_POGO_VOUT, 1);
-		if (ret)
-			logbuffer_log(pogo_transport->log, "%s: Failed to vote VOUT, ret %d",
-				      __func__, ret);
-		break;
-	case ACC_DIRECT:
-		/* Clear Pogo accessory Detected */
-		/* Clear USB accessory detected notification */
-		break;
-	case ACC_DEVICE_HUB:
-		/* DATA_STATUS_DISABLED_DEVICE_DOCK */
-		break;
-	case HOST_DIRECT_ACC_OFFLINE:
-		/* Push Pogo accessory Detected */
-		break;
-	default:
-		break;
+	if (pogo_transport->acc_irq_enabled) {
+		disable_irq(pogo_transport->pogo_acc_irq);
+		pogo_transport->acc_irq_enabled = false;
+	}
+
+	if (pogo_transport->pogo_irq_enabled) {
+		disable_irq(pogo_transport->pogo_irq);
+		pogo_transport->pogo_irq_enabled = false;
 	}
+
+	ret = pogo_transport_vote_charger_mode(pogo_transport, GBMS_POGO_VOUT, 1);
+	if (ret)
+		logbuffer_log(pogo_transport->log, "%s: Failed to vote VOUT, ret %d", __func__,
+			      ret);
 }
 
-/* Main loop of the State Machine */
-static void pogo_transport_state_machine_work(struct kthread_work *work)
+/*
+ * Call this function to:
+ *  - Disable POGO OVP
+ *  - Enable Accessory Detection IRQ
+ *  - Enable the regulator for Accessory Detection Logic
+ *
+ *  This function is guarded by (max77759_plat)->data_path_lock
+ */
+static void pogo_transport_enable_acc_detection(struct pogo_transport *pogo_transport)
 {
-	struct pogo_transport *pogo_transport =
-			container_of(container_of(work, struct kthread_delayed_work, work),
-			     struct pogo_transport, state_machine);
-	struct max77759_plat *chip = pogo_transport->chip;
-	enum pogo_state prev_state;
+	int ret;
 
-	mutex_lock(&chip->data_path_lock);
-	pogo_transport->state_machine_running = true;
+	/*
+	 * Disable OVP to prevent the voltage going through POGO_VIN. OVP will be re-enabled once
+	 * we vote GBMS_POGO_VIN and GBMS gets the votable result.
+	 */
+	if (pogo_transport->pogo_ovp_en_gpio >= 0)
+		gpio_set_value_cansleep(pogo_transport->pogo_ovp_en_gpio,
+					!pogo_transport->pogo_ovp_en_active_state);
 
-	if (pogo_transport->delayed_state) {
-		logbuffer_logk(pogo_transport->log, LOGLEVEL_INFO,
-			       "state change %s -> %s [delayed %ld ms] [%s]",
-			       pogo_states[pogo_transport->state],
-			       pogo_states[pogo_transport->delayed_state],
-			       pogo_transport->delay_ms,
-			       pogo_transport->lc ? "lc" : "");
-		pogo_transport->prev_state = pogo_transport->state;
-		pogo_transport->state = pogo_transport->delayed_state;
-		pogo_transport->delayed_state = INVALID_STATE;
+	if (!pogo_transport->acc_irq_enabled) {
+		enable_irq(pogo_transport->pogo_acc_irq);
+		pogo_transport->acc_irq_enabled = true;
 	}
 
-	do {
-		prev_state = pogo_transport->state;
-		pogo_transport_run_state_machine(pogo_transport);
-	} while (pogo_transport->state != prev_state && !pogo_transport->delayed_state);
-
-	pogo_transport->state_machine_running = false;
-	mutex_unlock(&chip->data_path_lock);
+	ret = pogo_transport_acc_regulator(pogo_transport, true);
+	if (ret)
+		logbuffer_log(pogo_transport->log, "%s: Failed to enable acc_detect %d", __func__,
+			      ret);
 }
 
 /*
- * Called when POGO Voltage Detection IRQ is active
- *  - Triggered from event: EVENT_POGO_IRQ
+ * Called when the Accessory Detection debounce expires. If the accessory is still detected,
+ * disable the Accessory Detection IRQ and enable POGO Vout by voting 1 to charger_mode_votable.
  *
- * This function is guarded by (max77759_plat)->data_path_lock
+ *  This function is guarded by (max77759_plat)->data_path_lock
  */
-static void pogo_transport_pogo_irq_active(struct pogo_transport *pogo_transport)
+static void pogo_transport_acc_debounced(struct pogo_transport *pogo_transport)
 {
-	switch (pogo_transport->state) {
-	case STANDBY:
-	case STANDBY_ACC_DEBOUNCED:
-		pogo_transport_set_state(pogo_transport, DOCKING_DEBOUNCED, POGO_PSY_DEBOUNCE_MS);
-		break;
-	case DEVICE_HUB:
-	case DEVICE_HUB_ACC_DEBOUNCED:
-		pogo_transport_set_state(pogo_transport, DEVICE_HUB_DOCKING_DEBOUNCED,
-					 POGO_PSY_DEBOUNCE_MS);
-		break;
-	case DEVICE_DIRECT:
-	case DEVICE_DIRECT_ACC_DEBOUNCED:
-		pogo_transport_set_state(pogo_transport, DEVICE_DOCKING_DEBOUNCED,
-					 POGO_PSY_DEBOUNCE_MS);
-		break;
-	case AUDIO_DIRECT:
-	case AUDIO_DIRECT_ACC_DEBOUNCED:
-		pogo_transport_set_state(pogo_transport, AUDIO_DIRECT_DOCKING_DEBOUNCED,
-					 POGO_PSY_DEBOUNCE_MS);
-		break;
-	case AUDIO_HUB:
-	case AUDIO_HUB_ACC_DEBOUNCED:
-		pogo_transport_set_state(pogo_transport, AUDIO_HUB_DOCKING_DEBOUNCED,
-					 POGO_PSY_DEBOUNCE_MS);
-		break;
-	case HOST_DIRECT:
-	case HOST_DIRECT_ACC_DEBOUNCED:
-		pogo_transport_set_state(pogo_transport, HOST_DIRECT_DOCKING_DEBOUNCED,
-					 POGO_PSY_DEBOUNCE_MS);
-		break;
-	default:
-		break;
+	int ret;
+
+	/* debounce fail; leave the IRQ and regulator enabled and do nothing */
+	if (!gpio_get_value(pogo_transport->pogo_acc_gpio)) {
+		pogo_transport_hub_speculate_miss_locked(pogo_transport, "debounce");
+		return;
+	}
+
+	/*
+	 * Disable the IRQ to ignore the noise after POGO Vout is enabled. It will be re-enabled
+	 * when HES reports the attach event.
+	 */
+	if (pogo_transport->acc_irq_enabled) {
+		disable_irq(pogo_transport->pogo_acc_irq);
+		pogo_transport->acc_irq_enabled = false;
 	}
+
+	/* TODO: queue work for gvotable cast vote if it takes too much time */
+	ret = pogo_transport_vote_charger_mode(pogo_transport, GBMS_POGO_VOUT, 1);
+	if (ret)
+		logbuffer_log(pogo_transport->log, "%s: Failed to vote VOUT, ret %d", __func__, ret);
 }
 
 /*
- * Called when POGO Voltage Detection IRQ is standby
- *  - Triggered from event: EVENT_POGO_IRQ
+ * b/271669059: Toggle the hub mux if a superspeed udev was attached when USB-C leaves Host Mode
+ * while the hub is enabled.
  *
- * This function is guarded by (max77759_plat)->data_path_lock
+ *  This function is guarded by (max77759_plat)->data_path_lock
  */
-static void pogo_transport_pogo_irq_standby(struct pogo_transport *pogo_transport)
+static void pogo_transport_toggle_hub_mux(struct pogo_transport *pogo_transport)
 {
-	struct max77759_plat *chip = pogo_transport->chip;
+	if (!pogo_transport->ss_udev_attached)
+		return;
 
-	/* Pogo irq in standy implies undocked. Signal userspace before altering data path. */
-	update_extcon_dev(pogo_transport, false, false);
-	switch (pogo_transport->state) {
-	case STANDBY:
-		pogo_transport_set_state(pogo_transport, STANDBY, 0);
-		break;
-	case DOCK_HUB:
-		switch_to_usbc_locked(pogo_transport);
-		pogo_transport_set_state(pogo_transport, STANDBY, 0);
-		break;
-	case DOCK_DEVICE_HUB:
-		pogo_transport_set_state(pogo_transport, DEVICE_HUB, 0);
-		break;
-	case DOCK_AUDIO_HUB:
-		pogo_transport_set_state(pogo_transport, AUDIO_HUB, 0);
-		break;
-	case AUDIO_DIRECT_DOCK_OFFLINE:
-		pogo_transport_set_state(pogo_transport, AUDIO_DIRECT, 0);
-		break;
-	case HOST_DIRECT_DOCK_OFFLINE:
-		pogo_transport_set_state(pogo_transport, HOST_DIRECT, 0);
-		break;
-	case DOCK_HUB_HOST_OFFLINE:
-		/* Clear data_active so that Type-C stack is able to enable the USB data later */
-		chip->data_active = false;
-		switch_to_usbc_locked(pogo_transport);
-		pogo_transport_set_state(pogo_transport, HOST_DIRECT, 0);
-		break;
-	default:
-		break;
+	/* USB_MUX_HUB_SEL set to 0 to bypass the hub */
+	gpio_set_value(pogo_transport->pogo_hub_sel_gpio, 0);
+	logbuffer_log(pogo_transport->log, "POGO: toggling hub-mux, hub-mux:%d",
+		      gpio_get_value(pogo_transport->pogo_hub_sel_gpio));
+	mdelay(10);
+	/* USB_MUX_HUB_SEL set to 1 to switch the path to hub */
+	gpio_set_value(pogo_transport->pogo_hub_sel_gpio, 1);
+	logbuffer_log(pogo_transport->log, "POGO: hub-mux:%d",
+		      gpio_get_value(pogo_transport->pogo_hub_sel_gpio));
+}
+
+/* Record an edge of @bounce and start the quiet-gap timer if it opens a burst; hard IRQ context */
+static void pogo_transport_bounce_edge(struct pogo_bounce *bounce, u64 now_ns)
+{
+	bool opened = false;
+
+	spin_lock(&bounce->lock);
+	bounce->edge_ns[bounce->edge_head++ & (POGO_EDGE_BUF - 1)] = now_ns;
+	if (!bounce->burst_open) {
+		bounce->burst_open = true;
+		bounce->burst_start_ns = now_ns;
+		opened = true;
 	}
+	WRITE_ONCE(bounce->last_edge_ns, now_ns);
+	spin_unlock(&bounce->lock);
+
+	if (opened)
+		kthread_mod_delayed_work(bounce->wq, &bounce->close_work,
+					 msecs_to_jiffies(bounce->max_ms));
 }
 
-/*
- * Called when USB-C port enters Host Mode
- *  - Triggered from event: EVENT_USBC_DATA_CHANGE
- *
- * This function is guarded by (max77759_plat)->data_path_lock
- */
-static void pogo_transport_usbc_host_on(struct pogo_transport *pogo_transport)
+/* Close the open burst into hist once the line has been quiet for max_ms, or wait for the rest */
+static void pogo_transport_bounce_close_work(struct kthread_work *work)
 {
-	struct max77759_plat *chip = pogo_transport->chip;
+	struct pogo_bounce *bounce =
+		container_of(container_of(work, struct kthread_delayed_work, work),
+			     struct pogo_bounce, close_work);
+	u64 quiet_ns, now_ns, burst_ms;
+	unsigned long flags;
 
-	switch (pogo_transport->state) {
-	case STANDBY:
-		pogo_transport_set_state(pogo_transport, DEVICE_DIRECT, 0);
-		break;
-	case DOCK_HUB:
-		/* Set data_active since USB-C device is attached */
-		chip->data_active = true;
-		pogo_transport_set_state(pogo_transport, DOCK_DEVICE_HUB, 0);
-		break;
-	case ACC_DIRECT:
-		switch_to_hub_locked(pogo_transport);
-		/* Set data_active since USB-C device is attached */
-		chip->data_active = true;
-		pogo_transport_set_state(pogo_transport, ACC_DEVICE_HUB, 0);
-		break;
-	case ACC_HUB:
-		/* Set data_active since USB-C device is attached */
-		chip->data_active = true;
-		pogo_transport_set_state(pogo_transport, ACC_DEVICE_HUB, 0);
-		break;
-	case LC:
-		/* Set data_active since USB-C device is attached */
-		chip->data_active = true;
-		pogo_transport_set_state(pogo_transport, LC_DEVICE_DIRECT, 0);
-		break;
-	default:
-		break;
+	spin_lock_irqsave(&bounce->lock, flags);
+	if (!bounce->burst_open)
+		goto unlock;
+
+	quiet_ns = bounce->last_edge_ns + (u64)bounce->max_ms * NSEC_PER_MSEC;
+	now_ns = ktime_get_ns();
+	if (now_ns < quiet_ns) {
+		spin_unlock_irqrestore(&bounce->lock, flags);
+		kthread_mod_delayed_work(bounce->wq, &bounce->close_work,
+					 nsecs_to_jiffies(quiet_ns - now_ns) + 1);
+		return;
 	}
+
+	burst_ms = div_u64(bounce->last_edge_ns - bounce->burst_start_ns, NSEC_PER_MSEC);
+	bounce->hist[min_t(u64, burst_ms, POGO_BOUNCE_BUCKETS - 1)] += POGO_BOUNCE_WEIGHT;
+	WRITE_ONCE(bounce->weight, bounce->weight + POGO_BOUNCE_WEIGHT);
+	bounce->burst_open = false;
+
+unlock:
+	spin_unlock_irqrestore(&bounce->lock, flags);
 }
 
-/*
- * Called when USB-C port leaves Host Mode
- *  - Triggered from event: EVENT_USBC_DATA_CHANGE
- *
- * This function is guarded by (max77759_plat)->data_path_lock
- */
-static void pogo_transport_usbc_host_off(struct pogo_transport *pogo_transport)
+/* Upper bound, in ms, of the shortest bucket range holding 99% of the bursts */
+static unsigned int pogo_transport_bounce_p99_ms(const struct pogo_bounce *bounce)
 {
-	struct max77759_plat *chip = pogo_transport->chip;
-	bool ss_attached = pogo_transport->ss_udev_attached;
+	u32 weight = READ_ONCE(bounce->weight);
+	u32 target = weight - weight / 100;
+	u32 sum = 0;
+	int i;
 
-	pogo_transport->ss_udev_attached = false;
+	for (i = 0; i < POGO_BOUNCE_BUCKETS - 1; i++) {
+		sum += READ_ONCE(bounce->hist[i]);
+		if (sum >= target)
+			break;
+	}
 
-	switch (pogo_transport->state) {
-	case DOCK_DEVICE_HUB:
-		/* Clear data_active since USB-C device is detached */
-		chip->data_active = false;
-		pogo_transport_set_state(pogo_transport, DOCK_HUB, 0);
-		break;
-	case DEVICE_HUB:
-		switch_to_usbc_locked(pogo_transport);
-		pogo_transport_set_state(pogo_transport, STANDBY, 0);
-		break;
-	case DEVICE_DIRECT:
-	case AUDIO_DIRECT:
-		pogo_transport_set_state(pogo_transport, STANDBY, 0);
-		break;
-	case AUDIO_DIRECT_DOCK_OFFLINE:
-		switch_to_hub_locked(pogo_transport);
-		pogo_transport_set_state(pogo_transport, DOCK_HUB, 0);
-		break;
-	case DOCK_AUDIO_HUB:
-		/* Clear data_active since USB-C device is detached */
-		chip->data_active = false;
-		pogo_transport_set_state(pogo_transport, DOCK_HUB, 0);
-		break;
-	case AUDIO_HUB:
-		switch_to_usbc_locked(pogo_transport);
-		pogo_transport_set_state(pogo_transport, STANDBY, 0);
-		break;
-	case ACC_DEVICE_HUB:
-	case ACC_AUDIO_HUB:
-		/* b/271669059 */
-		if (ss_attached) {
-			/* USB_MUX_HUB_SEL set to 0 to bypass the hub */
-			gpio_set_value(pogo_transport->pogo_hub_sel_gpio, 0);
-			logbuffer_log(pogo_transport->log, "POGO: toggling hub-mux, hub-mux:%d",
-				      gpio_get_value(pogo_transport->pogo_hub_sel_gpio));
-			mdelay(10);
-			/* USB_MUX_HUB_SEL set to 1 to switch the path to hub */
-			gpio_set_value(pogo_transport->pogo_hub_sel_gpio, 1);
-			logbuffer_log(pogo_transport->log, "POGO: hub-mux:%d",
-				      gpio_get_value(pogo_transport->pogo_hub_sel_gpio));
-		}
+	return i + 1;
+}
 
-		/* Clear data_active since USB-C device is detached */
-		chip->data_active = false;
-		pogo_transport_set_state(pogo_transport, ACC_HUB, 0);
-		break;
-	case LC_DEVICE_DIRECT:
-	case LC_AUDIO_DIRECT:
-		/* Clear data_active since USB-C device is detached */
-		chip->data_active = false;
-		pogo_transport_set_state(pogo_transport, LC, 0);
-		break;
+/* Return the learned debounce of @bounce, or @default_ms until there are enough samples */
+static unsigned int pogo_transport_debounce_ms(struct pogo_transport *pogo_transport,
+					       const struct pogo_bounce *bounce,
+					       unsigned int default_ms)
+{
+	unsigned int debounce_ms;
+
+	if (!pogo_transport->adaptive_debounce || !default_ms ||
+	    READ_ONCE(bounce->weight) < POGO_BOUNCE_MIN_SAMPLES * POGO_BOUNCE_WEIGHT)
+		return default_ms;
+
+	debounce_ms = pogo_transport_bounce_p99_ms(bounce) + pogo_transport->debounce_margin_ms;
+
+	return clamp(debounce_ms, bounce->min_ms, bounce->max_ms);
+}
+
+static unsigned int pogo_transport_delay_ms(struct pogo_transport *pogo_transport,
+					    enum pogo_delay delay)
+{
+	switch (delay) {
+	case DELAY_POGO:
+		return pogo_transport_debounce_ms(pogo_transport, &pogo_transport->pogo_bounce,
+						  POGO_PSY_DEBOUNCE_MS);
+	case DELAY_ACC:
+		/* 0 when the GPIO debounces in hardware */
+		return pogo_transport_debounce_ms(pogo_transport, &pogo_transport->acc_bounce,
+						  pogo_transport->pogo_acc_gpio_debounce_ms);
 	default:
-		break;
+		return 0;
 	}
 }
 
 /*
- * Called when USB-C port enters Device Mode
- *  - Triggered from event: EVENT_USBC_DATA_CHANGE
+ * Start recording the slow side effects of the State Machine in (pogo_transport)->deferred.
  *
  * This function is guarded by (max77759_plat)->data_path_lock
  */
-static void pogo_transport_usbc_device_on(struct pogo_transport *pogo_transport)
+static void pogo_transport_defer_begin(struct pogo_transport *pogo_transport)
 {
-	struct max77759_plat *chip = pogo_transport->chip;
-
-	switch (pogo_transport->state) {
-	case STANDBY:
-		pogo_transport_set_state(pogo_transport, HOST_DIRECT, 0);
-		break;
-	case DOCK_HUB:
-		/*
-		 * Set data_active so that once USB-C cable is detached later, Type-C stack is able
-		 * to call back for the data changed event
-		 */
-		chip->data_active = true;
-		pogo_transport_set_state(pogo_transport, DOCK_HUB_HOST_OFFLINE, 0);
-		break;
-	case ACC_DIRECT:
-		/*
-		 * Set data_active so that once USB-C cable is detached later, Type-C stack is able
-		 * to call back for the data changed event
-		 */
-		chip->data_active = true;
-		pogo_transport_set_state(pogo_transport, ACC_DIRECT_HOST_OFFLINE, 0);
-		break;
-	case ACC_HUB:
-		/*
-		 * Set data_active so that once USB-C cable is detached later, Type-C stack is able
-		 * to call back for the data changed event
-		 */
-		chip->data_active = true;
-		pogo_transport_set_state(pogo_transport, ACC_HUB_HOST_OFFLINE, 0);
-		break;
-	case LC:
-		/*
-		 * Set data_active so that once USB-C cable is detached later, Type-C stack is able
-		 * to call back for the data changed event
-		 */
-		chip->data_active = true;
-		pogo_transport_set_state(pogo_transport, LC_HOST_DIRECT, 0);
-		break;
-	default:
-		break;
-	}
+	memset(&pogo_transport->deferred, 0, sizeof(pogo_transport->deferred));
+	pogo_transport->deferring = true;
 }
 
 /*
- * Called when USB-C port leaves Device Mode
- *  - Triggered from event: EVENT_USBC_DATA_CHANGE
+ * Stop recording and hand the side effects to the caller for pogo_transport_defer_apply().
  *
  * This function is guarded by (max77759_plat)->data_path_lock
  */
-static void pogo_transport_usbc_device_off(struct pogo_transport *pogo_transport)
+static void pogo_transport_defer_end(struct pogo_transport *pogo_transport,
+				     struct pogo_transport_deferred *deferred)
 {
-	struct max77759_plat *chip = pogo_transport->chip;
-
-	switch (pogo_transport->state) {
-	case HOST_DIRECT:
-		pogo_transport_set_state(pogo_transport, STANDBY, 0);
-		break;
-	case HOST_DIRECT_DOCK_OFFLINE:
-		switch_to_hub_locked(pogo_transport);
-		pogo_transport_set_state(pogo_transport, DOCK_HUB, 0);
-		break;
-	case DOCK_HUB_HOST_OFFLINE:
-		/*
-		 * Clear data_active so that Type-C stack is able to call back for the data changed
-		 * event
-		 */
-		chip->data_active = false;
-		pogo_transport_set_state(pogo_transport, DOCK_HUB, 0);
-		break;
-	case HOST_DIRECT_ACC_OFFLINE:
-		switch_to_pogo_locked(pogo_transport);
-		pogo_transport_set_state(pogo_transport, ACC_DIRECT, 0);
-		break;
-	case ACC_DIRECT_HOST_OFFLINE:
-		/*
-		 * Clear data_active so that Type-C stack is able to call back for the data changed
-		 * event
-		 */
-		chip->data_active = false;
-		pogo_transport_set_state(pogo_transport, ACC_DIRECT, 0);
-		break;
-	case ACC_HUB_HOST_OFFLINE:
-		/*
-		 * Clear data_active so that Type-C stack is able to call back for the data changed
-		 * event
-		 */
-		chip->data_active = false;
-		pogo_transport_set_state(pogo_transport, ACC_HUB, 0);
-		break;
-	case LC_ALL_OFFLINE:
-	case LC_HOST_DIRECT:
-		/*
-		 * Clear data_active so that Type-C stack is able to call back for the data changed
-		 * event
-		 */
-		chip->data_active = false;
-		pogo_transport_set_state(pogo_transport, LC, 0);
-		break;
-	default:
-		break;
-	}
+	pogo_transport->deferring = false;
+	*deferred = pogo_transport->deferred;
 }
 
 /*
- * Called when device attribute "move_data_to_usb" is written to 1
- *  - Triggered from event: EVENT_ENABLE_USB_DATA
+ * Apply the side effects recorded under data_path_lock after the lock has been released, so that
+ * TCPC data role changes do not wait for the acc-detect LDO ramp and the extcon notifier chains.
  *
- * This function is guarded by (max77759_plat)->data_path_lock
+ * The State Machine and the events only run on pogo_transport->wq, so nothing can change the state
+ * between the decision and this call; the next event is only decided once this returns. There is
+ * no generation to re-validate against for that reason.
+ *
+ * Everything else still runs under the lock, and TCPC still waits for it: the POGO VOUT vote has
+ * to land before the data path is switched, hub_ldo is part of the hub power sequencing in
+ * switch_to_hub_locked(), the regulator disables and the undock notification have to stay in
+ * order with the IRQ and data path changes, and so do the hub-mux toggle and the logbuffer lines.
  */
-static void pogo_transport_enable_usb_data(struct pogo_transport *pogo_transport)
+static void pogo_transport_defer_apply(struct pogo_transport *pogo_transport,
+				       const struct pogo_transport_deferred *deferred)
 {
-	struct max77759_plat *chip = pogo_transport->chip;
+	int ret;
 
-	switch (pogo_transport->state) {
-	case DOCK_HUB_HOST_OFFLINE:
-		/*
-		 * Clear data_active so that Type-C stack is able to call back for the data changed
-		 * event later
-		 */
-		chip->data_active = false;
-		switch_to_usbc_locked(pogo_transport);
-		pogo_transport_set_state(pogo_transport, HOST_DIRECT_DOCK_OFFLINE, 0);
-		break;
-	case ACC_DIRECT_HOST_OFFLINE:
-	case ACC_HUB_HOST_OFFLINE:
-		/*
-		 * Clear data_active so that Type-C stack is able to call back for the data changed
-		 * event later
-		 */
-		chip->data_active = false;
-		switch_to_usbc_locked(pogo_transport);
-		pogo_transport_set_state(pogo_transport, HOST_DIRECT_ACC_OFFLINE, 0);
-		break;
-	default:
-		return;
+	if (deferred->acc_ldo_on) {
+		ret = pogo_transport_acc_regulator(pogo_transport, true);
+		if (ret)
+			logbuffer_log(pogo_transport->log, "%s: Failed to enable acc_detect %d",
+				      __func__, ret);
 	}
+
+	if (deferred->dock)
+		pogo_transport_extcon_sync(pogo_transport, true, deferred->sync_usb,
+					   deferred->sync_dock);
+}
+
+static struct pogo_transport *pogo_transport_from_sm(struct pogo_sm *sm)
+{
+	return container_of(sm, struct pogo_transport, sm);
 }
 
 /*
- * Called when device attribute "force_pogo" is written to 1
- *  - Triggered from event: EVENT_FORCE_POGO
+ * Return true, and re-arm the State Machine for the rest of the window, if the line debouncing
+ * delayed_state has not been stable for delay_ms since its last edge. If the pogo line has settled
+ * back in standby, delayed_state is dropped and the current state entered again instead.
  *
  * This function is guarded by (max77759_plat)->data_path_lock
  */
-static void pogo_transport_force_pogo(struct pogo_transport *pogo_transport)
+static bool pogo_transport_debounce_pending(struct pogo_sm *sm)
 {
-	struct max77759_plat *chip = pogo_transport->chip;
+	struct pogo_transport *pogo_transport = pogo_transport_from_sm(sm);
+	const struct pogo_bounce *bounce;
+	u64 deadline_ns, now_ns;
 
-	switch (pogo_transport->state) {
-	case HOST_DIRECT_DOCK_OFFLINE:
-		switch_to_hub_locked(pogo_transport);
-		/*
-		 * Set data_active so that once USB-C cable is detached later, Type-C stack is able
-		 * to call back for the data changed event
-		 */
-		chip->data_active = true;
-		pogo_transport_set_state(pogo_transport, DOCK_HUB_HOST_OFFLINE, 0);
+	switch (sm->delayed_line) {
+	case DELAY_POGO:
+		bounce = &pogo_transport->pogo_bounce;
+		break;
+	case DELAY_ACC:
+		bounce = &pogo_transport->acc_bounce;
 		break;
 	default:
-		return;
+		return false;
 	}
+
+	deadline_ns = READ_ONCE(bounce->last_edge_ns) + (u64)sm->delay_ms * NSEC_PER_MSEC;
+	now_ns = ktime_get_ns();
+	if (now_ns >= deadline_ns) {
+		/* pogo_gpio is active low */
+		if (sm->delayed_line == DELAY_POGO && gpio_get_value(pogo_transport->pogo_gpio)) {
+			logbuffer_log(pogo_transport->log, "%s dropped, pogo in standby",
+				      pogo_states[sm->delayed_state]);
+			sm->delayed_state = INVALID_STATE;
+			sm->delayed_line = DELAY_NONE;
+		}
+		return false;
+	}
+
+	kthread_mod_delayed_work(pogo_transport->wq, &pogo_transport->state_machine,
+				 nsecs_to_jiffies(deadline_ns - now_ns) + 1);
+	return true;
 }
 
 /*
- * Call this function to:
- *  - Disable POGO OVP
- *  - Disable Accessory Detection IRQ
- *  - Disable POGO Voltage Detection IRQ
- *  - Enable POGO Vout by voting 1 to charger_mode_votable
- *
- *  This function is guarded by (max77759_plat)->data_path_lock
+ * struct pogo_sm_ops of the board. The State Machine only calls them from
+ * pogo_transport_dispatch() and pogo_transport_state_machine_work(), so they are all guarded by
+ * (max77759_plat)->data_path_lock.
  */
-static void pogo_transport_skip_acc_detection(struct pogo_transport *pogo_transport)
+static bool pogo_transport_sm_docked(struct pogo_sm *sm)
 {
-	int ret;
+	/* pogo_gpio is active low */
+	return !gpio_get_value(pogo_transport_from_sm(sm)->pogo_gpio);
+}
 
-	logbuffer_log(pogo_transport->log, "%s: Skip enabling comparator logic, enable vout",
-		      __func__);
+static bool pogo_transport_sm_force_pogo(struct pogo_sm *sm)
+{
+	return pogo_transport_from_sm(sm)->force_pogo;
+}
 
-	/*
-	 * Disable OVP to prevent the voltage going through POGO_VIN. OVP will be re-enabled once
-	 * we vote GBMS_POGO_VIN and GBMS gets the votable result.
-	 */
-	if (pogo_transport->pogo_ovp_en_gpio >= 0)
-		gpio_set_value_cansleep(pogo_transport->pogo_ovp_en_gpio,
-					!pogo_transport->pogo_ovp_en_active_state);
+static bool pogo_transport_sm_mfg_acc_test(struct pogo_sm *sm)
+{
+	return pogo_transport_from_sm(sm)->mfg_acc_test;
+}
 
-	if (pogo_transport->acc_irq_enabled) {
-		disable_irq(pogo_transport->pogo_acc_irq);
-		pogo_transport->acc_irq_enabled = false;
+static unsigned int pogo_transport_sm_delay_ms(struct pogo_sm *sm, enum pogo_delay delay)
+{
+	return pogo_transport_delay_ms(pogo_transport_from_sm(sm), delay);
+}
+
+static void pogo_transport_sm_schedule(struct pogo_sm *sm, unsigned int delay_ms)
+{
+	struct pogo_transport *pogo_transport = pogo_transport_from_sm(sm);
+
+	kthread_mod_delayed_work(pogo_transport->wq, &pogo_transport->state_machine,
+				 msecs_to_jiffies(delay_ms));
+}
+
+static void pogo_transport_sm_dispatched(struct pogo_sm *sm, enum pogo_input input,
+					 const struct pogo_transition *t)
+{
+	struct pogo_transport *pogo_transport = pogo_transport_from_sm(sm);
+
+	trace_pogo_transport_dispatch(pogo_transport->dev, pogo_states[sm->state],
+				      pogo_inputs[input], pogo_states[t->next], t->actions);
+
+	if (t->next == INVALID_STATE && !t->actions && input < INPUT_ENTER)
+		logbuffer_log(pogo_transport->log, "%s ignored in %s", pogo_inputs[input],
+			      pogo_states[sm->state]);
+}
+
+static void pogo_transport_sm_state_changed(struct pogo_sm *sm, unsigned int delay_ms,
+					    bool debounced)
+{
+	struct pogo_transport *pogo_transport = pogo_transport_from_sm(sm);
+
+	if (delay_ms && !debounced) {
+		trace_pogo_transport_set_state(pogo_transport->dev, pogo_states[sm->state],
+					       pogo_states[sm->delayed_state], delay_ms);
+		pogo_transport_blog(pogo_transport, BLOG_PENDING_STATE, sm->state,
+				    sm->delayed_state, delay_ms, 0);
+		return;
 	}
 
-	if (pogo_transport->pogo_irq_enabled) {
-		disable_irq(pogo_transport->pogo_irq);
-		pogo_transport->pogo_irq_enabled = false;
+	if (debounced) {
+		pogo_transport_blog(pogo_transport, BLOG_DELAYED_STATE, sm->prev_state, sm->state,
+				    delay_ms, pogo_transport->lc);
+		trace_pogo_transport_delayed_state(pogo_transport->dev, pogo_states[sm->prev_state],
+						   pogo_states[sm->state], delay_ms);
+	} else {
+		trace_pogo_transport_set_state(pogo_transport->dev, pogo_states[sm->prev_state],
+					       pogo_states[sm->state], 0);
+		pogo_transport_blog(pogo_transport, BLOG_STATE, sm->prev_state, sm->state,
+				    pogo_transport->lc, 0);
 	}
 
-	ret = gvotable_cast_long_vote(pogo_transport->charger_mode_votable,
-				      POGO_VOTER, GBMS_POGO_VOUT, 1);
-	if (ret)
-		logbuffer_log(pogo_transport->log, "%s: Failed to vote VOUT, ret %d", __func__,
-			      ret);
+	pogo_transport_stats_state(pogo_transport, sm->prev_state, sm->state);
+	pogo_transport_snapshot_changed(pogo_transport);
 }
 
-/*
- * Called when device attribute "hall1_s" is written to non-zero
- *  - If accessory_detection_enabled == ENABLED, it won't involve the State transition.
- *    Enable the Accessory Detection IRQ and the regulator for the later detection process.
- *  - If accessory_detection_enabled == HALL_ONLY, transition to related ACC states
- *  - Triggered from event: EVENT_HES_H1S_CHANGED
- *
- * This function is guarded by (max77759_plat)->data_path_lock
- */
-static void pogo_transport_hes_acc_detected(struct pogo_transport *pogo_transport)
+static void pogo_transport_sm_toggle_hub_mux(struct pogo_sm *sm)
 {
-	struct max77759_plat *chip = pogo_transport->chip;
-	int ret;
+	pogo_transport_toggle_hub_mux(pogo_transport_from_sm(sm));
+}
 
-	if (pogo_transport->accessory_detection_enabled == ENABLED) {
-		switch (pogo_transport->state) {
-		case STANDBY:
-		case DEVICE_HUB:
-		case DEVICE_DIRECT:
-		case AUDIO_DIRECT:
-		case AUDIO_HUB:
-		case HOST_DIRECT:
-			/*
-			 * Disable OVP to prevent the voltage going through POGO_VIN. OVP will be
-			 * re-enabled once we vote GBMS_POGO_VIN and GBMS gets the votable result.
-			 */
-			if (pogo_transport->pogo_ovp_en_gpio >= 0)
-				gpio_set_value_cansleep(pogo_transport->pogo_ovp_en_gpio,
-							!pogo_transport->pogo_ovp_en_active_state);
+static void pogo_transport_sm_skip_acc_detection(struct pogo_sm *sm)
+{
+	pogo_transport_skip_acc_detection(pogo_transport_from_sm(sm));
+}
 
-			if (!pogo_transport->acc_irq_enabled) {
-				enable_irq(pogo_transport->pogo_acc_irq);
-				pogo_transport->acc_irq_enabled = true;
-			}
+static void pogo_transport_sm_enable_acc_detection(struct pogo_sm *sm)
+{
+	pogo_transport_enable_acc_detection(pogo_transport_from_sm(sm));
+}
 
-			ret = pogo_transport_acc_regulator(pogo_transport, true);
-			if (ret)
-				logbuffer_log(pogo_transport->log, "%s: Failed to enable acc_detect %d",
-					      __func__, ret);
-			break;
-		default:
-			break;
-		}
-	} else if (pogo_transport->accessory_detection_enabled == HALL_ONLY) {
-		switch (pogo_transport->state) {
-		case STANDBY:
-			pogo_transport_skip_acc_detection(pogo_transport);
-			if (!pogo_transport->mfg_acc_test)
-				switch_to_pogo_locked(pogo_transport);
-			pogo_transport_set_state(pogo_transport, ACC_DIRECT, 0);
-			break;
-		case DEVICE_DIRECT:
-		case AUDIO_DIRECT:
-			pogo_transport_skip_acc_detection(pogo_transport);
-			switch_to_hub_locked(pogo_transport);
-			/*
-			 * switch_to_hub_locked cleared data_active. Since there is still a USB-C
-			 * accessory attached, set data_active.
-			 */
-			chip->data_active = true;
-			pogo_transport_set_state(pogo_transport, ACC_DEVICE_HUB, 0);
-			break;
-		case DEVICE_HUB:
-			pogo_transport_skip_acc_detection(pogo_transport);
-			pogo_transport_set_state(pogo_transport, ACC_DEVICE_HUB, 0);
-			break;
-		case AUDIO_HUB:
-			pogo_transport_skip_acc_detection(pogo_transport);
-			pogo_transport_set_state(pogo_transport, ACC_AUDIO_HUB, 0);
-			break;
-		case HOST_DIRECT:
-			pogo_transport_skip_acc_detection(pogo_transport);
-			if (pogo_transport->force_pogo) {
-				switch_to_pogo_locked(pogo_transport);
-				/*
-				 * Set data_active so that once USB-C cable is detached later,
-				 * Type-C stack is able to call back for the data changed event
-				 */
-				chip->data_active = true;
-				pogo_transport_set_state(pogo_transport, ACC_DIRECT_HOST_OFFLINE,
-							 0);
-			} else {
-				pogo_transport_set_state(pogo_transport, HOST_DIRECT_ACC_OFFLINE,
-							 0);
-			}
-			break;
-		default:
-			break;
-		}
-	}
+static void pogo_transport_sm_acc_debounced(struct pogo_sm *sm)
+{
+	pogo_transport_acc_debounced(pogo_transport_from_sm(sm));
 }
 
-/*
- * Called when device attribute "hall1_s" is written to 0
- * - Triggered from event: EVENT_HES_H1S_CHANGED
- *
- * This function is guarded by (max77759_plat)->data_path_lock
- */
-static void pogo_transport_hes_acc_detached(struct pogo_transport *pogo_transport)
+static void pogo_transport_sm_acc_ldo_off(struct pogo_sm *sm)
 {
-	struct max77759_plat *chip = pogo_transport->chip;
+	struct pogo_transport *pogo_transport = pogo_transport_from_sm(sm);
+	int ret;
 
-	switch (pogo_transport->state) {
-	case STANDBY_ACC_DEBOUNCED:
-		pogo_transport_reset_acc_detection(pogo_transport);
-		pogo_transport_set_state(pogo_transport, STANDBY, 0);
-		break;
-	case DEVICE_DIRECT_ACC_DEBOUNCED:
-		pogo_transport_reset_acc_detection(pogo_transport);
-		pogo_transport_set_state(pogo_transport, DEVICE_DIRECT, 0);
-		break;
-	case DEVICE_HUB_ACC_DEBOUNCED:
-		pogo_transport_reset_acc_detection(pogo_transport);
-		pogo_transport_set_state(pogo_transport, DEVICE_HUB, 0);
-		break;
-	case AUDIO_DIRECT_ACC_DEBOUNCED:
-		pogo_transport_reset_acc_detection(pogo_transport);
-		pogo_transport_set_state(pogo_transport, AUDIO_DIRECT, 0);
-		break;
-	case AUDIO_HUB_ACC_DEBOUNCED:
-		pogo_transport_reset_acc_detection(pogo_transport);
-		pogo_transport_set_state(pogo_transport, AUDIO_HUB, 0);
-		break;
-	case HOST_DIRECT_ACC_DEBOUNCED:
-		pogo_transport_reset_acc_detection(pogo_transport);
-		pogo_transport_set_state(pogo_transport, HOST_DIRECT, 0);
-		break;
-	case ACC_DIRECT:
-	case ACC_HUB:
-		pogo_transport_reset_acc_detection(pogo_transport);
-		switch_to_usbc_locked(pogo_transport);
-		pogo_transport_set_state(pogo_transport, STANDBY, 0);
-		break;
-	case ACC_DEVICE_HUB:
-		pogo_transport_reset_acc_detection(pogo_transport);
-		pogo_transport_set_state(pogo_transport, DEVICE_HUB, 0);
-		break;
-	case ACC_AUDIO_HUB:
-		pogo_transport_reset_acc_detection(pogo_transport);
-		pogo_transport_set_state(pogo_transport, AUDIO_HUB, 0);
-		break;
-	case HOST_DIRECT_ACC_OFFLINE:
-		pogo_transport_reset_acc_detection(pogo_transport);
-		pogo_transport_set_state(pogo_transport, HOST_DIRECT, 0);
-		break;
-	case ACC_DIRECT_HOST_OFFLINE:
-	case ACC_HUB_HOST_OFFLINE:
-		pogo_transport_reset_acc_detection(pogo_transport);
-		/* Clear data_active so that Type-C stack is able to enable the USB data later */
-		chip->data_active = false;
-		switch_to_usbc_locked(pogo_transport);
-		pogo_transport_set_state(pogo_transport, HOST_DIRECT, 0);
-		break;
-	default:
-		break;
-	}
+	ret = pogo_transport_acc_regulator(pogo_transport, false);
+	if (ret)
+		logbuffer_log(pogo_transport->log, "%s: Failed to disable acc_detect %d", __func__,
+			      ret);
 }
 
-/*
- * Called when Accessory Detection IRQ is active
- *  - Triggered from event: EVENT_ACC_GPIO_ACTIVE
- *
- * This function is guarded by (max77759_plat)->data_path_lock
- */
-static void pogo_transport_acc_debouncing(struct pogo_transport *pogo_transport)
+static void pogo_transport_sm_reset_acc_detection(struct pogo_sm *sm)
 {
-	switch (pogo_transport->state) {
-	case STANDBY:
-	case STANDBY_ACC_DEBOUNCED:
-		pogo_transport_set_state(pogo_transport, STANDBY_ACC_DEBOUNCED,
-					 pogo_transport->pogo_acc_gpio_debounce_ms);
-		break;
-	case DEVICE_DIRECT:
-	case DEVICE_DIRECT_ACC_DEBOUNCED:
-		pogo_transport_set_state(pogo_transport, DEVICE_DIRECT_ACC_DEBOUNCED,
-					 pogo_transport->pogo_acc_gpio_debounce_ms);
-		break;
-	case DEVICE_HUB:
-	case DEVICE_HUB_ACC_DEBOUNCED:
-		pogo_transport_set_state(pogo_transport, DEVICE_HUB_ACC_DEBOUNCED,
-					 pogo_transport->pogo_acc_gpio_debounce_ms);
-		break;
-	case AUDIO_DIRECT:
-	case AUDIO_DIRECT_ACC_DEBOUNCED:
-		pogo_transport_set_state(pogo_transport, AUDIO_DIRECT_ACC_DEBOUNCED,
-					 pogo_transport->pogo_acc_gpio_debounce_ms);
-		break;
-	case AUDIO_HUB:
-	case AUDIO_HUB_ACC_DEBOUNCED:
-		pogo_transport_set_state(pogo_transport, AUDIO_HUB_ACC_DEBOUNCED,
-					 pogo_transport->pogo_acc_gpio_debounce_ms);
-		break;
-	case HOST_DIRECT:
-	case HOST_DIRECT_ACC_DEBOUNCED:
-		pogo_transport_set_state(pogo_transport, HOST_DIRECT_ACC_DEBOUNCED,
-					 pogo_transport->pogo_acc_gpio_debounce_ms);
-		break;
-	default:
-		break;
-	}
+	pogo_transport_reset_acc_detection(pogo_transport_from_sm(sm));
 }
 
-/*
- * Called when POGO Voltage Detection IRQ is active while Accessory Detection regulator is enabled.
- *  - Triggered from event: EVENT_ACC_CONNECTED
- *
- * This function is guarded by (max77759_plat)->data_path_lock
- */
-static void pogo_transport_acc_connected(struct pogo_transport *pogo_transport)
+static void pogo_transport_sm_set_data_active(struct pogo_sm *sm, bool active)
 {
-	struct max77759_plat *chip = pogo_transport->chip;
-	int ret;
-
-	/*
-	 * FIXME: is it possible that when acc regulator is enabled and pogo irq become active
-	 * because 12V input through pogo pin? e.g. keep magnet closed to the device and then
-	 * docking on korlan?
-	 */
+	pogo_transport_from_sm(sm)->chip->data_active = active;
+}
 
-	switch (pogo_transport->state) {
-	case STANDBY_ACC_DEBOUNCED:
-		ret = pogo_transport_acc_regulator(pogo_transport, false);
-		if (ret)
-			logbuffer_log(pogo_transport->log, "%s: Failed to disable acc_detect %d",
-				      __func__, ret);
+static void pogo_transport_sm_switch_path(struct pogo_sm *sm, enum pogo_data_path path)
+{
+	struct pogo_transport *pogo_transport = pogo_transport_from_sm(sm);
 
-		if (!pogo_transport->mfg_acc_test)
-			switch_to_pogo_locked(pogo_transport);
-		pogo_transport_set_state(pogo_transport, ACC_DIRECT, 0);
+	switch (path) {
+	case PATH_USBC:
+		switch_to_usbc_locked(pogo_transport);
 		break;
-	case DEVICE_DIRECT_ACC_DEBOUNCED:
-	case AUDIO_DIRECT_ACC_DEBOUNCED:
-		ret = pogo_transport_acc_regulator(pogo_transport, false);
-		if (ret)
-			logbuffer_log(pogo_transport->log, "%s: Failed to disable acc_detect %d",
-				      __func__, ret);
-
-		switch_to_hub_locked(pogo_transport);
-		/*
-		 * switch_to_hub_locked cleared data_active. Since there is still a USB-C accessory
-		 * attached, set data_active.
-		 */
-		chip->data_active = true;
-		pogo_transport_set_state(pogo_transport, ACC_DEVICE_HUB, 0);
+	case PATH_POGO:
+		switch_to_pogo_locked(pogo_transport);
 		break;
-	case DEVICE_HUB_ACC_DEBOUNCED:
-		ret = pogo_transport_acc_regulator(pogo_transport, false);
-		if (ret)
-			logbuffer_log(pogo_transport->log, "%s: Failed to disable acc_detect %d",
-				      __func__, ret);
-
-		pogo_transport_set_state(pogo_transport, ACC_DEVICE_HUB, 0);
+	case PATH_HUB:
+		switch_to_hub_locked(pogo_transport);
 		break;
-	case AUDIO_HUB_ACC_DEBOUNCED:
-		ret = pogo_transport_acc_regulator(pogo_transport, false);
-		if (ret)
-			logbuffer_log(pogo_transport->log, "%s: Failed to disable acc_detect %d",
-				      __func__, ret);
+	}
+}
 
-		pogo_transport_set_state(pogo_transport, ACC_AUDIO_HUB, 0);
-		break;
-	case HOST_DIRECT_ACC_DEBOUNCED:
-		ret = pogo_transport_acc_regulator(pogo_transport, false);
-		if (ret)
-			logbuffer_log(pogo_transport->log, "%s: Failed to disable acc_detect %d",
-				      __func__, ret);
+static void pogo_transport_sm_update_polarity(struct pogo_sm *sm)
+{
+	struct pogo_transport *pogo_transport = pogo_transport_from_sm(sm);
 
-		if (pogo_transport->force_pogo) {
-			switch_to_pogo_locked(pogo_transport);
-			/*
-			 * Set data_active so that once USB-C cable is detached later, Type-C stack
-			 * is able to call back for the data changed event
-			 */
-			chip->data_active = true;
-			pogo_transport_set_state(pogo_transport, ACC_DIRECT_HOST_OFFLINE, 0);
-		} else {
-			pogo_transport_set_state(pogo_transport, HOST_DIRECT_ACC_OFFLINE, 0);
-		}
-		break;
-	default:
-		break;
-	}
+	pogo_transport_update_polarity(pogo_transport, (int)pogo_transport->polarity, true);
+	ssphy_restart_control(pogo_transport, true);
+	pogo_transport_hub_ssphy_restarted_locked(pogo_transport);
 }
 
-/*
- * Called when a USB device with AUDIO Class is enumerated.
- *  - Triggered from event: EVENT_AUDIO_DEV_ATTACHED
- *
- * This function is guarded by (max77759_plat)->data_path_lock
- */
-static void pogo_transport_audio_dev_attached(struct pogo_transport *pogo_transport)
+static void pogo_transport_sm_dock(struct pogo_sm *sm)
 {
-	switch (pogo_transport->state) {
-	case DOCK_DEVICE_HUB:
-		pogo_transport_set_state(pogo_transport, DOCK_AUDIO_HUB, 0);
-		break;
-	case DEVICE_DIRECT:
-		pogo_transport_set_state(pogo_transport, AUDIO_DIRECT, 0);
-		break;
-	case ACC_DEVICE_HUB:
-		pogo_transport_set_state(pogo_transport, ACC_AUDIO_HUB, 0);
-		break;
-	case LC_DEVICE_DIRECT:
-		pogo_transport_set_state(pogo_transport, LC_AUDIO_DIRECT, 0);
-		break;
-	default:
-		break;
+	struct pogo_transport *pogo_transport = pogo_transport_from_sm(sm);
+
+	if (pogo_transport->deferring) {
+		/* Set the cables under the lock; only the notification is deferred */
+		pogo_transport->deferred.dock = true;
+		pogo_transport->deferred.sync_usb |=
+			pogo_transport_extcon_set(pogo_transport, EXTCON_USB, true);
+		pogo_transport->deferred.sync_dock |=
+			pogo_transport_extcon_set(pogo_transport, EXTCON_DOCK, true);
+	} else {
+		update_extcon_dev(pogo_transport, true, true);
 	}
 }
 
+static const struct pogo_sm_ops pogo_transport_sm_ops = {
+	.docked = pogo_transport_sm_docked,
+	.force_pogo = pogo_transport_sm_force_pogo,
+	.mfg_acc_test = pogo_transport_sm_mfg_acc_test,
+	.delay_ms = pogo_transport_sm_delay_ms,
+	.debounce_pending = pogo_transport_debounce_pending,
+	.schedule = pogo_transport_sm_schedule,
+	.dispatched = pogo_transport_sm_dispatched,
+	.state_changed = pogo_transport_sm_state_changed,
+	.toggle_hub_mux = pogo_transport_sm_toggle_hub_mux,
+	.skip_acc_detection = pogo_transport_sm_skip_acc_detection,
+	.enable_acc_detection = pogo_transport_sm_enable_acc_detection,
+	.acc_debounced = pogo_transport_sm_acc_debounced,
+	.acc_ldo_off = pogo_transport_sm_acc_ldo_off,
+	.reset_acc_detection = pogo_transport_sm_reset_acc_detection,
+	.set_data_active = pogo_transport_sm_set_data_active,
+	.switch_path = pogo_transport_sm_switch_path,
+	.update_polarity = pogo_transport_sm_update_polarity,
+	.dock = pogo_transport_sm_dock,
+};
+
 /*
- * Called when the detected orientation on USB-C port is changed.
- *  - Triggered from event: EVENT_USBC_ORIENTATION
+ * Feed @input to the State Machine: run the actions and move to the next state listed in
+ * pogo_transitions.
  *
  * This function is guarded by (max77759_plat)->data_path_lock
  */
-static void pogo_transport_usbc_orientation_changed(struct pogo_transport *pogo_transport)
+static void pogo_transport_dispatch(struct pogo_transport *pogo_transport, enum pogo_input input)
 {
-	/*
-	 * TODO: It is possible that USB-C is toggling between CC2 and Open. We may need to wait for
-	 * the orientation being settled and then update the ssphy.
-	 */
-	switch (pogo_transport->state) {
-	/* usbc being connected while hub is enabled */
-	case DOCK_HUB:
-	case ACC_HUB:
-	/* usbc being disconnected while hub is enabled */
-	case DOCK_DEVICE_HUB:
-	case DOCK_AUDIO_HUB:
-	case DOCK_HUB_HOST_OFFLINE:
-	case ACC_DEVICE_HUB:
-	case ACC_AUDIO_HUB:
-		pogo_transport_update_polarity(pogo_transport, (int)pogo_transport->polarity, true);
-		ssphy_restart_control(pogo_transport, true);
-		break;
-	default:
-		break;
-	}
+	pogo_sm_dispatch(&pogo_transport->sm, input);
 }
 
-static void pogo_transport_lc_clear(struct pogo_transport *pogo_transport)
+/* Main loop of the State Machine, see pogo_sm_run() */
+static void pogo_transport_state_machine_work(struct kthread_work *work)
 {
+	struct pogo_transport *pogo_transport =
+			container_of(container_of(work, struct kthread_delayed_work, work),
+			     struct pogo_transport, state_machine);
 	struct max77759_plat *chip = pogo_transport->chip;
+	struct pogo_transport_deferred deferred;
+	u64 start_ns;
+	bool ran;
 
-	switch (pogo_transport->state) {
-	case LC:
-		pogo_transport_skip_acc_detection(pogo_transport);
-		if (!pogo_transport->mfg_acc_test)
-			switch_to_pogo_locked(pogo_transport);
-		pogo_transport_set_state(pogo_transport, ACC_DIRECT, 0);
-		break;
-	case LC_DEVICE_DIRECT:
-		pogo_transport_skip_acc_detection(pogo_transport);
-		if (!pogo_transport->mfg_acc_test) {
-			switch_to_hub_locked(pogo_transport);
-			chip->data_active = true;
-		}
-		pogo_transport_set_state(pogo_transport, ACC_DEVICE_HUB, 0);
-		break;
-	case LC_AUDIO_DIRECT:
-		pogo_transport_skip_acc_detection(pogo_transport);
-		if (!pogo_transport->mfg_acc_test) {
-			switch_to_hub_locked(pogo_transport);
-			chip->data_active = true;
-		}
-		pogo_transport_set_state(pogo_transport, ACC_AUDIO_HUB, 0);
-		break;
-	case LC_ALL_OFFLINE:
-		pogo_transport_skip_acc_detection(pogo_transport);
-		pogo_transport_set_state(pogo_transport, ACC_DIRECT_HOST_OFFLINE, 0);
-		break;
-	case LC_HOST_DIRECT:
-		pogo_transport_skip_acc_detection(pogo_transport);
-		if (!pogo_transport->mfg_acc_test) {
-			switch_to_pogo_locked(pogo_transport);
-			chip->data_active = true;
-		}
-		pogo_transport_set_state(pogo_transport, HOST_DIRECT_ACC_OFFLINE, 0);
-		break;
-	default:
-		break;
-	}
+	mutex_lock(&chip->data_path_lock);
+	start_ns = ktime_get_ns();
+	pogo_transport_defer_begin(pogo_transport);
+
+	ran = pogo_sm_run(&pogo_transport->sm);
+	if (ran && !pogo_transport->sm.delayed_state)
+		pogo_transport_hub_wake_locked(pogo_transport);
+
+	pogo_transport_defer_end(pogo_transport, &deferred);
+	if (ran)
+		pogo_transport_timing_record(&pogo_transport->state_machine_timing, start_ns);
+	mutex_unlock(&chip->data_path_lock);
+
+	pogo_transport_defer_apply(pogo_transport, &deferred);
 }
 
-static void pogo_transport_lc(struct pogo_transport *pogo_transport)
+#define ACC_CHARGER_PSY_RETRY_COUNT 5
+#define ACC_CHARGER_PSY_RETRY_TIMEOUT_MS 100
+/*
+ * Return acc_charger_psy, looking it up by name only if there is no cached handle or the cached
+ * one went stale.
+ *
+ * This function is guarded by (max77759_plat)->data_path_lock
+ */
+static struct power_supply *pogo_transport_acc_charger_psy(struct pogo_transport *pogo_transport)
 {
-	switch (pogo_transport->state) {
-	case ACC_DIRECT:
-	case ACC_HUB:
-		switch_to_usbc_locked(pogo_transport);
-		pogo_transport_reset_acc_detection(pogo_transport);
-		pogo_transport_set_state(pogo_transport, LC, 0);
-		break;
-	case ACC_DEVICE_HUB:
-		switch_to_usbc_locked(pogo_transport);
-		pogo_transport_reset_acc_detection(pogo_transport);
-		pogo_transport_set_state(pogo_transport, LC_DEVICE_DIRECT, 0);
-		break;
-	case ACC_AUDIO_HUB:
-		switch_to_usbc_locked(pogo_transport);
-		pogo_transport_reset_acc_detection(pogo_transport);
-		pogo_transport_set_state(pogo_transport, LC_AUDIO_DIRECT, 0);
-		break;
-	case ACC_DIRECT_HOST_OFFLINE:
-	case ACC_HUB_HOST_OFFLINE:
-		switch_to_pogo_locked(pogo_transport);
-		pogo_transport_reset_acc_detection(pogo_transport);
-		pogo_transport_set_state(pogo_transport, LC_ALL_OFFLINE, 0);
-		break;
-	case HOST_DIRECT_ACC_OFFLINE:
-		pogo_transport_reset_acc_detection(pogo_transport);
-		pogo_transport_set_state(pogo_transport, LC_HOST_DIRECT, 0);
-		break;
-	default:
-		break;
+	if (READ_ONCE(pogo_transport->acc_charger_psy_stale)) {
+		WRITE_ONCE(pogo_transport->acc_charger_psy_stale, false);
+		if (pogo_transport->acc_charger_psy) {
+			power_supply_put(pogo_transport->acc_charger_psy);
+			WRITE_ONCE(pogo_transport->acc_charger_psy, NULL);
+		}
 	}
+
+	if (!pogo_transport->acc_charger_psy)
+		WRITE_ONCE(pogo_transport->acc_charger_psy,
+			   power_supply_get_by_name(pogo_transport->acc_charger_psy_name));
+
+	return pogo_transport->acc_charger_psy;
 }
 
-#define ACC_CHARGER_PSY_RETRY_COUNT 5
-#define ACC_CHARGER_PSY_RETRY_TIMEOUT_MS 100
+/*
+ * Read the status and capacity of acc_charger_psy once. Returns -EAGAIN if either of them could
+ * not be read; the caller is expected to retry later.
+ *
+ * This function is guarded by (max77759_plat)->data_path_lock
+ */
 static int pogo_transport_acc_charger_status(struct pogo_transport *pogo_transport,
 					     union power_supply_propval *acc_charger_status,
 					     union power_supply_propval *acc_charger_capacity)
 {
-	int ret, count;
-	bool retry;
+	struct power_supply *psy;
+	bool retry = false;
+	int ret;
 
 	if (pogo_transport->pogo_acc_gpio <= 0 || !pogo_transport->acc_charger_psy_name)
 		return -EINVAL;
 
-	for (count = 0; count < ACC_CHARGER_PSY_RETRY_COUNT; count++) {
-		retry = false;
-
-		pogo_transport->acc_charger_psy = power_supply_get_by_name(
-				pogo_transport->acc_charger_psy_name);
-		if (IS_ERR_OR_NULL(pogo_transport->acc_charger_psy)) {
-			logbuffer_logk(pogo_transport->log, LOGLEVEL_ERR,
-				       "acc_charger psy delayed get failed");
-			return -ENODEV;
-		}
-
-		ret = power_supply_get_property(pogo_transport->acc_charger_psy,
-						POWER_SUPPLY_PROP_STATUS, acc_charger_status);
-		if (ret) {
-			logbuffer_log(pogo_transport->log,
-				      "Failed to read acc_charger status (%d), count %d", ret,
-				      count);
-			acc_charger_status->intval = POWER_SUPPLY_STATUS_UNKNOWN;
-			retry = true;
-		}
-
-		ret = power_supply_get_property(pogo_transport->acc_charger_psy,
-						POWER_SUPPLY_PROP_CAPACITY, acc_charger_capacity);
-		if (ret) {
-			logbuffer_log(pogo_transport->log,
-				      "Failed to read acc_charger capacity (%d), count %d", ret,
-				      count);
-			acc_charger_capacity->intval = 0;
-			retry = true;
-		}
+	psy = pogo_transport_acc_charger_psy(pogo_transport);
+	if (!psy) {
+		logbuffer_logk(pogo_transport->log, LOGLEVEL_ERR,
+			       "acc_charger psy delayed get failed");
+		return -ENODEV;
+	}
 
-		if (!retry)
-			break;
+	ret = power_supply_get_property(psy, POWER_SUPPLY_PROP_STATUS, acc_charger_status);
+	if (ret == -ENODEV) {
+		/* The supply was unregistered; drop the handle and look it up next time */
+		logbuffer_log(pogo_transport->log, "acc_charger psy gone");
+		WRITE_ONCE(pogo_transport->acc_charger_psy_stale, true);
+		return -ENODEV;
+	} else if (ret) {
+		logbuffer_log(pogo_transport->log,
+			      "Failed to read acc_charger status (%d), count %u", ret,
+			      pogo_transport->acc_charger_retry);
+		acc_charger_status->intval = POWER_SUPPLY_STATUS_UNKNOWN;
+		retry = true;
+	}
 
-		mdelay(ACC_CHARGER_PSY_RETRY_TIMEOUT_MS);
+	ret = power_supply_get_property(psy, POWER_SUPPLY_PROP_CAPACITY, acc_charger_capacity);
+	if (ret) {
+		logbuffer_log(pogo_transport->log,
+			      "Failed to read acc_charger capacity (%d), count %u", ret,
+			      pogo_transport->acc_charger_retry);
+		acc_charger_capacity->intval = 0;
+		retry = true;
 	}
 
-	return 0;
+	return retry ? -EAGAIN : 0;
 }
 
 #define ACC_CHARGER_SOC_FULL 100
 #define ACC_CHARGER_NOT_PRESENT 0
-static bool lc_acc_charging_ended(struct pogo_transport *pogo_transport)
+static bool lc_acc_charging_ended(struct pogo_transport *pogo_transport, int ret,
+				  union power_supply_propval acc_charger_status,
+				  union power_supply_propval acc_charger_capacity)
 {
-	union power_supply_propval acc_charger_status = {.intval = POWER_SUPPLY_STATUS_UNKNOWN};
-	union power_supply_propval acc_charger_capacity = {0};
 	u64 now, elapsed_sec;
 	bool charging_ended;
-	int ret;
 
-	ret = pogo_transport_acc_charger_status(pogo_transport, &acc_charger_status,
-						&acc_charger_capacity);
 	logbuffer_log(pogo_transport->log, "ret:%d charger_status:%d cap:%d", ret,
 		      acc_charger_status.intval, acc_charger_capacity.intval);
 
+	pogo_transport->acc_charger_status = acc_charger_status.intval;
+	pogo_transport->acc_charger_capacity = acc_charger_capacity.intval;
+	pogo_transport->acc_charger_cached = !ret;
+
 	if (ret < 0) {
 		/*
 		 * It is expected that pogo Vout will be turned off. So it is safe to reset the
@@ -2195,10 +2914,87 @@ static bool lc_acc_charging_ended(struct pogo_transport *pogo_transport)
 	return charging_ended;
 }
 
+static void pogo_transport_set_lc_stage(struct pogo_transport *pogo_transport,
+					enum lc_stages stage)
+{
+	if (pogo_transport->lc_stage == stage)
+		return;
+
+	pogo_transport->lc_stage = stage;
+	pogo_transport_snapshot_changed(pogo_transport);
+}
+
+/*
+ * Time until the next check of the accessory charger in STAGE_VOUT_ENABLED. Without change
+ * notifications from acc_charger_psy, poll every lc_enable_ms. Otherwise changes are handled by
+ * acc_charger_work and the alarm only needs to expire the timeouts in lc_acc_charging_ended(),
+ * with lc_safety_check_ms as the upper bound.
+ */
+static unsigned long pogo_transport_lc_check_ms(struct pogo_transport *pogo_transport)
+{
+	u64 timeout_ns = pogo_transport->acc_charging_timeout_sec * NSEC_PER_SEC;
+	u64 begin_ns = 0, now;
+
+	if (!pogo_transport->acc_charger_nb_registered)
+		return pogo_transport->lc_enable_ms;
+
+	if (pogo_transport->acc_charger_status == POWER_SUPPLY_STATUS_CHARGING &&
+	    pogo_transport->acc_charger_capacity == ACC_CHARGER_SOC_FULL)
+		begin_ns = pogo_transport->acc_charging_full_begin_ns;
+	else if (pogo_transport->acc_charger_status == POWER_SUPPLY_STATUS_DISCHARGING &&
+		 pogo_transport->acc_charger_capacity == ACC_CHARGER_NOT_PRESENT)
+		begin_ns = pogo_transport->acc_discharging_begin_ns;
+
+	if (!pogo_transport->acc_charger_cached || !begin_ns)
+		return pogo_transport->lc_safety_check_ms;
+
+	now = ktime_get_boottime_ns();
+	if (now - begin_ns >= timeout_ns)
+		return 0;
+
+	return min_t(u64, pogo_transport->lc_safety_check_ms,
+		     div_u64(begin_ns + timeout_ns - now, NSEC_PER_MSEC) + 1);
+}
+
+/*
+ * Turn off pogo Vout if the accessory is done charging. Otherwise, schedule the next check.
+ *
+ * This function is guarded by (max77759_plat)->data_path_lock
+ */
+static void pogo_transport_lc_check_acc_charging(struct pogo_transport *pogo_transport)
+{
+	union power_supply_propval acc_charger_status = {.intval = POWER_SUPPLY_STATUS_UNKNOWN};
+	union power_supply_propval acc_charger_capacity = {0};
+	int ret;
+
+	ret = pogo_transport_acc_charger_status(pogo_transport, &acc_charger_status,
+						&acc_charger_capacity);
+	if (ret == -EAGAIN && ++pogo_transport->acc_charger_retry < ACC_CHARGER_PSY_RETRY_COUNT) {
+		kthread_mod_delayed_work(pogo_transport->wq, &pogo_transport->lc_retry_work,
+					 msecs_to_jiffies(ACC_CHARGER_PSY_RETRY_TIMEOUT_MS));
+		return;
+	}
+
+	/* Out of retries, evaluate with the defaults filled in for what was not read */
+	if (ret == -EAGAIN)
+		ret = 0;
+	pogo_transport->acc_charger_retry = 0;
+
+	if (lc_acc_charging_ended(pogo_transport, ret, acc_charger_status, acc_charger_capacity)) {
+		pogo_transport_dispatch(pogo_transport, INPUT_LC);
+		pogo_transport_set_lc_stage(pogo_transport, STAGE_VOUT_DISABLED);
+		alarm_start_relative(&pogo_transport->lc_check_alarm,
+				     ms_to_ktime(pogo_transport->lc_disable_ms));
+	} else {
+		pogo_transport_set_lc_stage(pogo_transport, STAGE_VOUT_ENABLED);
+		alarm_start_relative(&pogo_transport->lc_check_alarm,
+				     ms_to_ktime(pogo_transport_lc_check_ms(pogo_transport)));
+	}
+}
+
 static void pogo_transport_lc_stage_transition(struct pogo_transport *pogo_transport)
 {
 	struct max77759_plat *chip = pogo_transport->chip;
-	bool acc_charging_ended;
 
 	logbuffer_log(pogo_transport->log, "stage:%u lc:%u wait_for_suspend:%u",
 		      pogo_transport->lc_stage, pogo_transport->lc,
@@ -2215,153 +3011,348 @@ static void pogo_transport_lc_stage_transition(struct pogo_transport *pogo_trans
 			break;
 
 		if (!pogo_transport->acc_charger_psy_name) {
-			pogo_transport_lc(pogo_transport);
-			pogo_transport->lc_stage = STAGE_VOUT_DISABLED;
+			pogo_transport_dispatch(pogo_transport, INPUT_LC);
+			pogo_transport_set_lc_stage(pogo_transport, STAGE_VOUT_DISABLED);
 			break;
 		}
 
-		acc_charging_ended = lc_acc_charging_ended(pogo_transport);
-		if (acc_charging_ended) {
-			pogo_transport_lc(pogo_transport);
-			pogo_transport->lc_stage = STAGE_VOUT_DISABLED;
-			alarm_start_relative(&pogo_transport->lc_check_alarm,
-					     ms_to_ktime(pogo_transport->lc_disable_ms));
-		} else {
-			pogo_transport->lc_stage = STAGE_VOUT_ENABLED;
-			alarm_start_relative(&pogo_transport->lc_check_alarm,
-					     ms_to_ktime(pogo_transport->lc_enable_ms));
-		}
+		pogo_transport_lc_check_acc_charging(pogo_transport);
 		break;
 	case STAGE_VOUT_DISABLED:
-		pogo_transport_lc_clear(pogo_transport);
-		pogo_transport->lc_stage = STAGE_VOUT_ENABLED;
+		pogo_transport_dispatch(pogo_transport, INPUT_LC_CLEAR);
+		pogo_transport_set_lc_stage(pogo_transport, STAGE_VOUT_ENABLED);
+		/* Ignore acc_charger_psy changes until the accessory has booted up */
+		pogo_transport->acc_charger_cached = false;
 		alarm_start_relative(&pogo_transport->lc_check_alarm,
 				     ms_to_ktime(pogo_transport->lc_bootup_ms));
 		break;
 	case STAGE_VOUT_ENABLED:
-		acc_charging_ended = lc_acc_charging_ended(pogo_transport);
-		if (acc_charging_ended) {
-			pogo_transport_lc(pogo_transport);
-			pogo_transport->lc_stage = STAGE_VOUT_DISABLED;
-			alarm_start_relative(&pogo_transport->lc_check_alarm,
-					     ms_to_ktime(pogo_transport->lc_disable_ms));
+		pogo_transport_lc_check_acc_charging(pogo_transport);
+		break;
+	default:
+		break;
+	}
+
+	mutex_unlock(&chip->data_path_lock);
+}
+
+/* Indexed by the bit number of the event */
+static const char * const pogo_event_names[EVENT_TYPES] = {
+	"POGO_IRQ",
+	"USBC_DATA_CHANGE",
+	"ENABLE_USB_DATA",
+	"HES_H1S_CHANGED",
+	"ACC_GPIO_ACTIVE",
+	"ACC_CONNECTED",
+	"AUDIO_DEV_ATTACHED",
+	"USBC_ORIENTATION",
+	"LC_STATUS_CHANGED",
+	"USB_SUSPEND",
+	"FORCE_POGO",
+};
+
+static enum pogo_event_coalesce pogo_transport_event_coalesce(unsigned long event)
+{
+	switch (event) {
+	/* Every toggle is a transition of its own, e.g. H1S on/off/on while magnets settle */
+	case EVENT_USBC_DATA_CHANGE:
+	case EVENT_HES_H1S_CHANGED:
+	case EVENT_LC_STATUS_CHANGED:
+		return COALESCE_NONE;
+	/* The handler acts on the current level of the input or the event is a plain request */
+	default:
+		return COALESCE_LATEST;
+	}
+}
+
+static void pogo_transport_event_snapshot(struct pogo_transport *pogo_transport,
+					  struct pogo_event_entry *entry)
+{
+	entry->ts_ns = ktime_get_boottime_ns();
+	entry->usbc_data_role = READ_ONCE(pogo_transport->usbc_data_role);
+	entry->usbc_data_active = READ_ONCE(pogo_transport->usbc_data_active);
+	entry->hall1_s_state = READ_ONCE(pogo_transport->hall1_s_state);
+	entry->lc = READ_ONCE(pogo_transport->lc);
+}
+
+/*
+ * Multi-producer push into event_ring. Returns false if the ring is full. Safe from any context as
+ * the slot is reserved with a cmpxchg on event_ring_head and published through its seq.
+ */
+static bool pogo_transport_event_push(struct pogo_transport *pogo_transport, unsigned long event)
+{
+	struct pogo_event_entry *entry;
+	int pos = atomic_read(&pogo_transport->event_ring_head);
+	int diff;
+
+	for (;;) {
+		entry = &pogo_transport->event_ring[(unsigned int)pos % POGO_EVENT_RING_SIZE];
+		diff = atomic_read_acquire(&entry->seq) - pos;
+		if (diff == 0) {
+			if (atomic_try_cmpxchg_relaxed(&pogo_transport->event_ring_head, &pos,
+						       pos + 1))
+				break;
+		} else if (diff < 0) {
+			/* The handler has not consumed the entry queued a lap ago */
+			return false;
+		} else {
+			pos = atomic_read(&pogo_transport->event_ring_head);
+		}
+	}
+
+	entry->event = event;
+	pogo_transport_event_snapshot(pogo_transport, entry);
+	atomic_set_release(&entry->seq, pos + 1);
+	trace_pogo_transport_queue_event(pogo_transport->dev, event, pos, false);
+
+	return true;
+}
+
+/* Single consumer; called from event_work only */
+static bool pogo_transport_event_pop(struct pogo_transport *pogo_transport,
+				     struct pogo_event_entry *out)
+{
+	unsigned int tail = pogo_transport->event_ring_tail;
+	struct pogo_event_entry *entry = &pogo_transport->event_ring[tail % POGO_EVENT_RING_SIZE];
+
+	if (atomic_read_acquire(&entry->seq) != (int)(tail + 1))
+		return false;
+
+	out->event = entry->event;
+	out->ts_ns = entry->ts_ns;
+	out->usbc_data_role = entry->usbc_data_role;
+	out->usbc_data_active = entry->usbc_data_active;
+	out->hall1_s_state = entry->hall1_s_state;
+	out->lc = entry->lc;
+	atomic_set_release(&entry->seq, tail + POGO_EVENT_RING_SIZE);
+	pogo_transport->event_ring_tail = tail + 1;
+
+	return true;
+}
+
+/* Returns true if @event is still published in event_ring behind the entry just popped */
+static bool pogo_transport_event_queued(struct pogo_transport *pogo_transport, unsigned long event)
+{
+	unsigned int pos = pogo_transport->event_ring_tail;
+	struct pogo_event_entry *entry;
+
+	for (;; pos++) {
+		entry = &pogo_transport->event_ring[pos % POGO_EVENT_RING_SIZE];
+		if (atomic_read_acquire(&entry->seq) != (int)(pos + 1))
+			return false;
+		if (entry->event == event)
+			return true;
+	}
+}
+
+/*
+ * This function is guarded by (max77759_plat)->data_path_lock
+ */
+static void pogo_transport_handle_event(struct pogo_transport *pogo_transport,
+					const struct pogo_event_entry *entry)
+{
+	enum pogo_state state = pogo_transport->sm.state;
+
+	switch (entry->event) {
+	case EVENT_POGO_IRQ: {
+		int pogo_gpio = gpio_get_value(pogo_transport->pogo_gpio);
+
+		logbuffer_log(pogo_transport->log, "EV:POGO_IRQ %s", pogo_gpio ?
+			      "STANDBY" : "ACTIVE");
+		if (pogo_gpio) {
+			/*
+			 * Pogo irq in standy implies undocked. Signal userspace before
+			 * altering data path.
+			 */
+			update_extcon_dev(pogo_transport, false, false);
+			pogo_transport_dispatch(pogo_transport, INPUT_POGO_STANDBY);
+		} else {
+			pogo_transport->hub_wake_pending = true;
+			pogo_transport_dispatch(pogo_transport, INPUT_POGO_ACTIVE);
+		}
+		break;
+	}
+	case EVENT_USBC_ORIENTATION:
+		logbuffer_log(pogo_transport->log, "EV:ORIENTATION %u", pogo_transport->polarity);
+		/*
+		 * TODO: It is possible that USB-C is toggling between CC2 and Open. We may
+		 * need to wait for the orientation being settled and then update the ssphy.
+		 */
+		pogo_transport_dispatch(pogo_transport, INPUT_USBC_ORIENTATION);
+		break;
+	case EVENT_USBC_DATA_CHANGE:
+		logbuffer_log(pogo_transport->log, "EV:DATA_CHANGE usbc-role %u usbc-active %u",
+			      entry->usbc_data_role, entry->usbc_data_active);
+		pogo_transport->hub_wake_pending = true;
+		if (entry->usbc_data_role == TYPEC_HOST) {
+			if (entry->usbc_data_active) {
+				pogo_transport_dispatch(pogo_transport, INPUT_USBC_HOST_ON);
+			} else {
+				pogo_transport_dispatch(pogo_transport, INPUT_USBC_HOST_OFF);
+				pogo_transport->ss_udev_attached = false;
+			}
 		} else {
+			if (entry->usbc_data_active)
+				pogo_transport_dispatch(pogo_transport, INPUT_USBC_DEVICE_ON);
+			else
+				pogo_transport_dispatch(pogo_transport, INPUT_USBC_DEVICE_OFF);
+		}
+		break;
+	case EVENT_ENABLE_USB_DATA:
+		logbuffer_log(pogo_transport->log, "EV:ENABLE_USB");
+		pogo_transport_dispatch(pogo_transport, INPUT_ENABLE_USB_DATA);
+		break;
+	case EVENT_FORCE_POGO:
+		logbuffer_log(pogo_transport->log, "EV:FORCE_POGO");
+		pogo_transport_dispatch(pogo_transport, INPUT_FORCE_POGO);
+		break;
+	case EVENT_HES_H1S_CHANGED:
+		logbuffer_log(pogo_transport->log, "EV:H1S state %d", entry->hall1_s_state);
+		if (!entry->hall1_s_state) {
+			pogo_transport_hub_speculate_miss_locked(pogo_transport, "detach");
+			pogo_transport_dispatch(pogo_transport, INPUT_HES_DETACH);
+			break;
+		}
+
+		pogo_transport->hub_wake_pending = true;
+		if (pogo_transport->accessory_detection_enabled == ENABLED ||
+		    pogo_transport->accessory_detection_enabled == HALL_ONLY)
+			pogo_transport_hub_speculate_locked(pogo_transport);
+
+		if (pogo_transport->accessory_detection_enabled == ENABLED)
+			pogo_transport_dispatch(pogo_transport, INPUT_HES_ATTACH);
+		else if (pogo_transport->accessory_detection_enabled != HALL_ONLY)
+			logbuffer_log(pogo_transport->log, "EV:H1S acc detection disabled");
+		else if (pogo_transport->force_pogo)
+			pogo_transport_dispatch(pogo_transport, INPUT_HES_ATTACH_HALL_ONLY_FP);
+		else
+			pogo_transport_dispatch(pogo_transport, INPUT_HES_ATTACH_HALL_ONLY);
+		break;
+	case EVENT_ACC_GPIO_ACTIVE:
+		logbuffer_log(pogo_transport->log, "EV:ACC_GPIO_ACTIVE, H1S %d",
+			      pogo_transport->hall1_s_state);
+		/* b/288341638 step to debouncing only if H1S stays active */
+		if (pogo_transport->hall1_s_state)
+			pogo_transport_dispatch(pogo_transport, INPUT_ACC_DEBOUNCING);
+		else
+			pogo_transport_dispatch(pogo_transport, INPUT_HES_DETACH);
+		break;
+	case EVENT_ACC_CONNECTED:
+		logbuffer_log(pogo_transport->log, "EV:ACC_CONNECTED");
+		/*
+		 * FIXME: is it possible that when acc regulator is enabled and pogo irq
+		 * become active because 12V input through pogo pin? e.g. keep magnet
+		 * closed to the device and then docking on korlan?
+		 */
+		pogo_transport_dispatch(pogo_transport, pogo_transport->force_pogo ?
+					INPUT_ACC_CONNECTED_FP : INPUT_ACC_CONNECTED);
+		break;
+	case EVENT_AUDIO_DEV_ATTACHED:
+		logbuffer_log(pogo_transport->log, "EV:AUDIO_ATTACHED");
+		pogo_transport_dispatch(pogo_transport, INPUT_AUDIO_DEV_ATTACHED);
+		break;
+	case EVENT_USB_SUSPEND:
+		logbuffer_log(pogo_transport->log, "EV:USB_SUSPEND stage %u",
+			      pogo_transport->lc_stage);
+		if (pogo_transport->lc && pogo_transport->lc_stage == STAGE_WAIT_FOR_SUSPEND)
+			alarm_start_relative(&pogo_transport->lc_check_alarm, 0);
+		break;
+	case EVENT_LC_STATUS_CHANGED:
+		logbuffer_log(pogo_transport->log, "EV:LC %u", entry->lc);
+		if (entry->lc) {
+			if (bus_suspend(pogo_transport))
+				pogo_transport->wait_for_suspend = false;
+			pogo_transport_set_lc_stage(pogo_transport, STAGE_WAIT_FOR_SUSPEND);
+			pogo_transport->acc_charger_retry = 0;
 			alarm_start_relative(&pogo_transport->lc_check_alarm,
-					     ms_to_ktime(pogo_transport->lc_enable_ms));
+					     ms_to_ktime(pogo_transport->lc_delay_check_ms));
+		} else {
+			if (pogo_transport->lc_stage == STAGE_VOUT_DISABLED)
+				pogo_transport_dispatch(pogo_transport, INPUT_LC_CLEAR);
+			pogo_transport_set_lc_stage(pogo_transport, STAGE_UNKNOWN);
+			pogo_transport->wait_for_suspend = true;
 		}
 		break;
 	default:
+		logbuffer_log(pogo_transport->log, "EV:unknown %#lx", entry->event);
 		break;
 	}
 
-	mutex_unlock(&chip->data_path_lock);
+	/*
+	 * Pogo going active, H1S attach and USB-C data changes may use the hub. Ungate it after the
+	 * decision: here if the state did not move, or in state_machine_work once it has settled.
+	 */
+	if (pogo_transport->sm.state == state && !pogo_transport->sm.delayed_state)
+		pogo_transport_hub_wake_locked(pogo_transport);
+}
+
+/*
+ * Return the next event to handle: first event_ring in arrival order with the coalescing rules
+ * applied, then the events that overflowed into event_map, one bit at a time from @overflow.
+ */
+static bool pogo_transport_event_next(struct pogo_transport *pogo_transport,
+				      struct pogo_event_entry *entry, unsigned long *overflow)
+{
+	unsigned int bit;
+
+	while (pogo_transport_event_pop(pogo_transport, entry)) {
+		bit = __ffs(entry->event);
+		if (bit < EVENT_TYPES) {
+			/* Popped outside data_path_lock */
+			spin_lock(&pogo_transport->stats_lock);
+			pogo_transport_timing_add(&pogo_transport->queue_delay[bit],
+						  ktime_get_boottime_ns() - entry->ts_ns);
+			spin_unlock(&pogo_transport->stats_lock);
+		}
+		if (pogo_transport_event_coalesce(entry->event) == COALESCE_LATEST &&
+		    pogo_transport_event_queued(pogo_transport, entry->event))
+			continue;
+		return true;
+	}
+
+	if (!*overflow) {
+		spin_lock(&pogo_transport->pogo_event_lock);
+		*overflow = pogo_transport->event_map;
+		pogo_transport->event_map = 0;
+		spin_unlock(&pogo_transport->pogo_event_lock);
+		if (!*overflow)
+			return false;
+	}
+
+	/* Events in event_map lost their order; handle them with the current inputs */
+	bit = __ffs(*overflow);
+	*overflow &= ~BIT(bit);
+	entry->event = BIT(bit);
+	pogo_transport_event_snapshot(pogo_transport, entry);
+
+	return true;
 }
 
+/*
+ * Each event is decided under data_path_lock, which is shared with TCPC, and its slow side effects
+ * are applied after the lock is released, before the next event is decided.
+ */
 static void pogo_transport_event_handler(struct kthread_work *work)
 {
 	struct pogo_transport *pogo_transport = container_of(work, struct pogo_transport,
 							     event_work);
 	struct max77759_plat *chip = pogo_transport->chip;
-	unsigned long events;
-
-	mutex_lock(&chip->data_path_lock);
-	spin_lock(&pogo_transport->pogo_event_lock);
-	while (pogo_transport->event_map) {
-		events = pogo_transport->event_map;
-		pogo_transport->event_map = 0;
-
-		spin_unlock(&pogo_transport->pogo_event_lock);
-
-		if (events & EVENT_POGO_IRQ) {
-			int pogo_gpio = gpio_get_value(pogo_transport->pogo_gpio);
-
-			logbuffer_log(pogo_transport->log, "EV:POGO_IRQ %s", pogo_gpio ?
-				      "STANDBY" : "ACTIVE");
-			if (pogo_gpio)
-				pogo_transport_pogo_irq_standby(pogo_transport);
-			else
-				pogo_transport_pogo_irq_active(pogo_transport);
-		}
-		if (events & EVENT_USBC_ORIENTATION) {
-			logbuffer_log(pogo_transport->log, "EV:ORIENTATION %u",
-				      pogo_transport->polarity);
-			pogo_transport_usbc_orientation_changed(pogo_transport);
-		}
-		if (events & EVENT_USBC_DATA_CHANGE) {
-			logbuffer_log(pogo_transport->log, "EV:DATA_CHANGE usbc-role %u usbc-active %u",
-				      pogo_transport->usbc_data_role,
-				      pogo_transport->usbc_data_active);
-			if (pogo_transport->usbc_data_role == TYPEC_HOST) {
-				if (pogo_transport->usbc_data_active)
-					pogo_transport_usbc_host_on(pogo_transport);
-				else
-					pogo_transport_usbc_host_off(pogo_transport);
-			} else {
-				if (pogo_transport->usbc_data_active)
-					pogo_transport_usbc_device_on(pogo_transport);
-				else
-					pogo_transport_usbc_device_off(pogo_transport);
-			}
-		}
-		if (events & EVENT_ENABLE_USB_DATA) {
-			logbuffer_log(pogo_transport->log, "EV:ENABLE_USB");
-			pogo_transport_enable_usb_data(pogo_transport);
-		}
-		if (events & EVENT_FORCE_POGO) {
-			logbuffer_log(pogo_transport->log, "EV:FORCE_POGO");
-			pogo_transport_force_pogo(pogo_transport);
-		}
-		if (events & EVENT_HES_H1S_CHANGED) {
-			logbuffer_log(pogo_transport->log, "EV:H1S state %d",
-				      pogo_transport->hall1_s_state);
-			if (pogo_transport->hall1_s_state)
-				pogo_transport_hes_acc_detected(pogo_transport);
-			else
-				pogo_transport_hes_acc_detached(pogo_transport);
-		}
-		if (events & EVENT_ACC_GPIO_ACTIVE) {
-			logbuffer_log(pogo_transport->log, "EV:ACC_GPIO_ACTIVE, H1S %d",
-				      pogo_transport->hall1_s_state);
-			/* b/288341638 step to debouncing only if H1S stays active */
-			if (pogo_transport->hall1_s_state)
-				pogo_transport_acc_debouncing(pogo_transport);
-			else
-				pogo_transport_hes_acc_detached(pogo_transport);
-		}
-		if (events & EVENT_ACC_CONNECTED) {
-			logbuffer_log(pogo_transport->log, "EV:ACC_CONNECTED");
-			pogo_transport_acc_connected(pogo_transport);
-		}
-		if (events & EVENT_AUDIO_DEV_ATTACHED) {
-			logbuffer_log(pogo_transport->log, "EV:AUDIO_ATTACHED");
-			pogo_transport_audio_dev_attached(pogo_transport);
-		}
-		if (events & EVENT_USB_SUSPEND) {
-			logbuffer_log(pogo_transport->log, "EV:USB_SUSPEND stage %u",
-				      pogo_transport->lc_stage);
-			if (pogo_transport->lc &&
-			    pogo_transport->lc_stage == STAGE_WAIT_FOR_SUSPEND)
-				alarm_start_relative(&pogo_transport->lc_check_alarm, 0);
-		}
-		if (events & EVENT_LC_STATUS_CHANGED) {
-			logbuffer_log(pogo_transport->log, "EV:LC %u", pogo_transport->lc);
-			if (pogo_transport->lc) {
-				if (bus_suspend(pogo_transport))
-					pogo_transport->wait_for_suspend = false;
-				pogo_transport->lc_stage = STAGE_WAIT_FOR_SUSPEND;
-				alarm_start_relative(&pogo_transport->lc_check_alarm,
-						ms_to_ktime(pogo_transport->lc_delay_check_ms));
-			} else {
-				if (pogo_transport->lc_stage == STAGE_VOUT_DISABLED)
-					pogo_transport_lc_clear(pogo_transport);
-				pogo_transport->lc_stage = STAGE_UNKNOWN;
-				pogo_transport->wait_for_suspend = true;
-			}
-		}
-		spin_lock(&pogo_transport->pogo_event_lock);
+	struct pogo_transport_deferred deferred;
+	struct pogo_event_entry entry;
+	unsigned long overflow = 0;
+	u64 start_ns;
+
+	while (pogo_transport_event_next(pogo_transport, &entry, &overflow)) {
+		mutex_lock(&chip->data_path_lock);
+		start_ns = ktime_get_ns();
+		pogo_transport_defer_begin(pogo_transport);
+		pogo_transport_handle_event(pogo_transport, &entry);
+		pogo_transport_defer_end(pogo_transport, &deferred);
+		pogo_transport_timing_record(&pogo_transport->event_handler_timing, start_ns);
+		mutex_unlock(&chip->data_path_lock);
+
+		pogo_transport_defer_apply(pogo_transport, &deferred);
 	}
-	spin_unlock(&pogo_transport->pogo_event_lock);
-	mutex_unlock(&chip->data_path_lock);
 }
 
 static void pogo_transport_queue_event(struct pogo_transport *pogo_transport, unsigned long event)
@@ -2370,14 +3361,18 @@ static void pogo_transport_queue_event(struct pogo_transport *pogo_transport, un
 
 	pm_wakeup_event(pogo_transport->dev, POGO_TIMEOUT_MS);
 	/*
-	 * Print the event number derived from the bit position; e.g. BIT(0) -> 0
-	 * Note that ffs() only return the least significant set bit.
+	 * Log the event number derived from the bit position; e.g. BIT(0) -> 0
+	 * Note that __ffs() only return the least significant set bit.
 	 */
-	logbuffer_log(pogo_transport->log, "QUEUE EVENT %d", ffs((int)event) - 1);
-
-	spin_lock_irqsave(&pogo_transport->pogo_event_lock, flags);
-	pogo_transport->event_map |= event;
-	spin_unlock_irqrestore(&pogo_transport->pogo_event_lock, flags);
+	pogo_transport_blog(pogo_transport, BLOG_QUEUE_EVENT, __ffs(event), 0, 0, 0);
+
+	if (!pogo_transport_event_push(pogo_transport, event)) {
+		atomic_inc(&pogo_transport->event_ring_overflow);
+		spin_lock_irqsave(&pogo_transport->pogo_event_lock, flags);
+		pogo_transport->event_map |= event;
+		trace_pogo_transport_queue_event(pogo_transport->dev, event, 0, true);
+		spin_unlock_irqrestore(&pogo_transport->pogo_event_lock, flags);
+	}
 
 	kthread_queue_work(pogo_transport->wq, &pogo_transport->event_work);
 }
@@ -2389,6 +3384,92 @@ static void lc_check_alarm_work_item(struct kthread_work *work)
 	pogo_transport_lc_stage_transition(pogo_transport);
 }
 
+static void lc_retry_work_item(struct kthread_work *work)
+{
+	struct pogo_transport *pogo_transport =
+			container_of(container_of(work, struct kthread_delayed_work, work),
+				     struct pogo_transport, lc_retry_work);
+
+	pogo_transport_lc_stage_transition(pogo_transport);
+}
+
+/*
+ * Re-evaluate the charging status as soon as acc_charger_psy reports a different status or
+ * capacity rather than waiting for lc_check_alarm.
+ */
+static void pogo_transport_acc_charger_work(struct kthread_work *work)
+{
+	struct pogo_transport *pogo_transport = container_of(work, struct pogo_transport,
+							     acc_charger_work);
+	union power_supply_propval acc_charger_status = {.intval = POWER_SUPPLY_STATUS_UNKNOWN};
+	union power_supply_propval acc_charger_capacity = {0};
+	struct max77759_plat *chip = pogo_transport->chip;
+
+	mutex_lock(&chip->data_path_lock);
+
+	if (!pogo_transport->lc || pogo_transport->lc_stage != STAGE_VOUT_ENABLED ||
+	    !pogo_transport->acc_charger_cached)
+		goto unlock;
+
+	if (pogo_transport_acc_charger_status(pogo_transport, &acc_charger_status,
+					      &acc_charger_capacity))
+		goto unlock;
+
+	if (acc_charger_status.intval == pogo_transport->acc_charger_status &&
+	    acc_charger_capacity.intval == pogo_transport->acc_charger_capacity)
+		goto unlock;
+
+	logbuffer_log(pogo_transport->log, "acc_charger changed status:%d cap:%d",
+		      acc_charger_status.intval, acc_charger_capacity.intval);
+	pogo_transport_lc_check_acc_charging(pogo_transport);
+
+unlock:
+	mutex_unlock(&chip->data_path_lock);
+}
+
+static int pogo_transport_acc_charger_notify(struct notifier_block *nb, unsigned long event,
+					     void *data)
+{
+	struct pogo_transport *pogo_transport = container_of(nb, struct pogo_transport,
+							     acc_charger_nb);
+	struct power_supply *psy = data;
+
+	if (event != PSY_EVENT_PROP_CHANGED)
+		return NOTIFY_OK;
+
+	if (!psy->desc->name || strcmp(psy->desc->name, pogo_transport->acc_charger_psy_name))
+		return NOTIFY_OK;
+
+	/* A new supply registered under the same name; the cached handle is no longer valid */
+	if (psy != READ_ONCE(pogo_transport->acc_charger_psy))
+		WRITE_ONCE(pogo_transport->acc_charger_psy_stale, true);
+
+	if (!pogo_transport->lc)
+		return NOTIFY_OK;
+
+	kthread_queue_work(pogo_transport->wq, &pogo_transport->acc_charger_work);
+
+	return NOTIFY_OK;
+}
+
+static int pogo_transport_pogo_psy_notify(struct notifier_block *nb, unsigned long event,
+					  void *data)
+{
+	struct pogo_transport *pogo_transport = container_of(nb, struct pogo_transport,
+							     pogo_psy_nb);
+
+	if (event != PSY_EVENT_PROP_CHANGED || data != pogo_transport->pogo_psy)
+		return NOTIFY_OK;
+
+	if (!READ_ONCE(pogo_transport->voltage_qual_start_ns) &&
+	    !READ_ONCE(pogo_transport->voltage_read_pending))
+		return NOTIFY_OK;
+
+	kthread_mod_delayed_work(pogo_transport->wq, &pogo_transport->voltage_qual_work, 0);
+
+	return NOTIFY_OK;
+}
+
 static enum alarmtimer_restart lc_check_alarm_handler(struct alarm *alarm, ktime_t time)
 {
 	struct pogo_transport *pogo_transport = container_of(alarm, struct pogo_transport,
@@ -2404,6 +3485,85 @@ static enum alarmtimer_restart lc_check_alarm_handler(struct alarm *alarm, ktime
 /* Events triggering                                                       */
 /*-------------------------------------------------------------------------*/
 
+/*
+ * Called from the hard IRQ handler of @storm. Return true, with the line masked and the unmask
+ * scheduled, if the edge rate is above irq_storm_threshold.
+ */
+static bool pogo_transport_irq_storm(struct pogo_transport *pogo_transport,
+				     struct pogo_irq_storm *storm, u64 now_ns)
+{
+	unsigned long threshold = READ_ONCE(pogo_transport->irq_storm_threshold);
+
+	if (!threshold)
+		return false;
+
+	if (now_ns - storm->window_start_ns > POGO_IRQ_STORM_WINDOW_MS * NSEC_PER_MSEC) {
+		storm->window_start_ns = now_ns;
+		storm->edges = 0;
+	}
+
+	if (++storm->edges <= threshold)
+		return false;
+
+	disable_irq_nosync(storm->irq);
+	storm->masked = true;
+	if (storm->unmask_ns && now_ns - storm->unmask_ns < POGO_IRQ_STORM_QUIET_MS * NSEC_PER_MSEC)
+		storm->backoff_ms = min_t(u32, storm->backoff_ms * 2,
+					  POGO_IRQ_STORM_BACKOFF_MAX_MS);
+	else
+		storm->backoff_ms = POGO_IRQ_STORM_BACKOFF_MIN_MS;
+	atomic_inc(&storm->episodes);
+	trace_pogo_transport_irq_storm(pogo_transport->dev, storm->name, true, storm->edges,
+				       storm->backoff_ms);
+	kthread_mod_delayed_work(pogo_transport->wq, &storm->work,
+				 msecs_to_jiffies(storm->backoff_ms));
+
+	return true;
+}
+
+static void pogo_transport_irq_storm_work(struct kthread_work *work)
+{
+	struct pogo_irq_storm *storm =
+		container_of(container_of(work, struct kthread_delayed_work, work),
+			     struct pogo_irq_storm, work);
+	struct pogo_transport *pogo_transport = storm->pogo_transport;
+
+	if (!storm->masked)
+		return;
+
+	logbuffer_log(pogo_transport->log, "%s irq storm: unmasked after %u ms", storm->name,
+		      storm->backoff_ms);
+	trace_pogo_transport_irq_storm(pogo_transport->dev, storm->name, false, storm->edges,
+				       storm->backoff_ms);
+	storm->masked = false;
+	storm->unmask_ns = ktime_get_ns();
+	storm->window_start_ns = storm->unmask_ns;
+	storm->edges = 0;
+	enable_irq(storm->irq);
+
+	/* Edges were dropped while masked; wake the threaded handler to read the current level */
+	irq_wake_thread(storm->irq, pogo_transport);
+}
+
+static void pogo_transport_init_irq_storm(struct pogo_transport *pogo_transport,
+					  struct pogo_irq_storm *storm, const char *name, int irq)
+{
+	storm->pogo_transport = pogo_transport;
+	storm->name = name;
+	storm->irq = irq;
+	kthread_init_delayed_work(&storm->work, pogo_transport_irq_storm_work);
+}
+
+/* Must be called with irq_storm_threshold cleared, so that the line cannot be masked again */
+static void pogo_transport_cancel_irq_storm(struct pogo_irq_storm *storm)
+{
+	if (!storm->name)
+		return;
+
+	synchronize_irq(storm->irq);
+	kthread_cancel_delayed_work_sync(&storm->work);
+}
+
 static irqreturn_t pogo_acc_irq(int irq, void *dev_id)
 {
 	struct pogo_transport *pogo_transport = dev_id;
@@ -2414,8 +3574,8 @@ static irqreturn_t pogo_acc_irq(int irq, void *dev_id)
 	 */
 	pogo_transport->acc_gpio_result_cache = gpio_get_value(pogo_transport->pogo_acc_gpio);
 
-	logbuffer_log(pogo_transport->log, "Pogo acc threaded irq running, acc_detect %u",
-		      pogo_transport->acc_gpio_result_cache);
+	pogo_transport_blog(pogo_transport, BLOG_ACC_IRQ, pogo_transport->acc_gpio_result_cache, 0,
+			    0, 0);
 
 	if (pogo_transport->state_machine_enabled) {
 		if (pogo_transport->acc_gpio_result_cache)
@@ -2425,7 +3585,7 @@ static irqreturn_t pogo_acc_irq(int irq, void *dev_id)
 
 	if (pogo_transport->acc_gpio_result_cache)
 		pogo_transport_event(pogo_transport, EVENT_POGO_ACC_DEBOUNCED,
-				     pogo_transport->pogo_acc_gpio_debounce_ms);
+				     pogo_transport_delay_ms(pogo_transport, DELAY_ACC));
 	else
 		kthread_cancel_delayed_work_sync(&pogo_transport->pogo_accessory_debounce_work);
 
@@ -2436,9 +3596,16 @@ static irqreturn_t pogo_acc_isr(int irq, void *dev_id)
 {
 	struct pogo_transport *pogo_transport = dev_id;
 
-	logbuffer_log(pogo_transport->log, "POGO ACC IRQ triggered");
+	u64 now_ns = ktime_get_ns();
+
+	pogo_transport_bounce_edge(&pogo_transport->acc_bounce, now_ns);
+	pogo_transport_blog(pogo_transport, BLOG_ACC_ISR, 0, 0, 0, 0);
+	trace_pogo_transport_irq(pogo_transport->dev, "acc");
 	pm_wakeup_event(pogo_transport->dev, POGO_TIMEOUT_MS);
 
+	if (pogo_transport_irq_storm(pogo_transport, &pogo_transport->acc_storm, now_ns))
+		return IRQ_HANDLED;
+
 	return IRQ_WAKE_THREAD;
 }
 
@@ -2447,7 +3614,7 @@ static irqreturn_t pogo_irq(int irq, void *dev_id)
 	struct pogo_transport *pogo_transport = dev_id;
 	int pogo_gpio = gpio_get_value(pogo_transport->pogo_gpio);
 
-	logbuffer_log(pogo_transport->log, "Pogo threaded irq running, pogo_gpio %u", pogo_gpio);
+	pogo_transport_blog(pogo_transport, BLOG_POGO_IRQ, pogo_gpio, 0, 0, 0);
 
 	if (pogo_transport->acc_detect_ldo &&
 	    regulator_is_enabled(pogo_transport->acc_detect_ldo) > 0) {
@@ -2490,8 +3657,7 @@ dock_detection:
 		 * Vote GBMS_POGO_VIN to notify BMS that there is input voltage on pogo power and
 		 * it is over the threshold if pogo_gpio (ACTIVE_LOW) is in active state (0)
 		 */
-		ret = gvotable_cast_long_vote(pogo_transport->charger_mode_votable, POGO_VOTER,
-					      GBMS_POGO_VIN, !pogo_gpio);
+		ret = pogo_transport_vote_charger_mode(pogo_transport, GBMS_POGO_VIN, !pogo_gpio);
 		if (ret)
 			logbuffer_log(pogo_transport->log, "%s: Failed to vote VIN, ret %d",
 				      __func__, ret);
@@ -2501,7 +3667,7 @@ dock_detection:
 		pogo_transport_queue_event(pogo_transport, EVENT_POGO_IRQ);
 	else
 		pogo_transport_event(pogo_transport, EVENT_DOCKING, !pogo_gpio ?
-				     POGO_PSY_DEBOUNCE_MS : 0);
+				     pogo_transport_delay_ms(pogo_transport, DELAY_POGO) : 0);
 	return IRQ_HANDLED;
 }
 
@@ -2509,9 +3675,16 @@ static irqreturn_t pogo_isr(int irq, void *dev_id)
 {
 	struct pogo_transport *pogo_transport = dev_id;
 
-	logbuffer_log(pogo_transport->log, "POGO IRQ triggered");
+	u64 now_ns = ktime_get_ns();
+
+	pogo_transport_bounce_edge(&pogo_transport->pogo_bounce, now_ns);
+	pogo_transport_blog(pogo_transport, BLOG_POGO_ISR, 0, 0, 0, 0);
+	trace_pogo_transport_irq(pogo_transport->dev, "pogo");
 	pm_wakeup_event(pogo_transport->dev, POGO_TIMEOUT_MS);
 
+	if (pogo_transport_irq_storm(pogo_transport, &pogo_transport->pogo_storm, now_ns))
+		return IRQ_HANDLED;
+
 	return IRQ_WAKE_THREAD;
 }
 
@@ -2537,6 +3710,7 @@ static void orientation_changed(void *data)
 
 	if (pogo_transport->polarity != chip->polarity) {
 		pogo_transport->polarity = chip->polarity;
+		pogo_transport_snapshot_changed(pogo_transport);
 		if (pogo_transport->state_machine_enabled)
 			pogo_transport_queue_event(pogo_transport, EVENT_USBC_ORIENTATION);
 		else
@@ -2553,6 +3727,9 @@ static void usb_bus_suspend_resume(void *data, bool main_hcd, bool suspend)
 	else
 		pogo_transport->shared_hcd_suspend = suspend;
 
+	if (suspend)
+		pogo_transport_hub_idle_check(pogo_transport);
+
 	/* TODO: mutex lock to protect the read/set of lc and wait_for_suspend */
 	if (!pogo_transport->lc)
 		return;
@@ -2606,6 +3783,43 @@ skip_audio_check:
 		pogo_transport_queue_event(pogo_transport, EVENT_AUDIO_DEV_ATTACHED);
 }
 
+static void pogo_transport_hub_enumerated(struct pogo_transport *pogo_transport, const char *from,
+					  struct pogo_transport_timing *timing, u64 since_ns)
+{
+	u64 elapsed_ns = ktime_get_boottime_ns() - since_ns;
+
+	logbuffer_log(pogo_transport->log, "hub enumerated %llu ms after %s",
+		      div_u64(elapsed_ns, NSEC_PER_MSEC), from);
+
+	spin_lock(&pogo_transport->stats_lock);
+	pogo_transport_timing_add(timing, elapsed_ns);
+	spin_unlock(&pogo_transport->stats_lock);
+}
+
+/* Something enumerated behind the hub; stop the watchdog and account for the recovery */
+static void pogo_transport_hub_udev_added(struct pogo_transport *pogo_transport)
+{
+	bool expected;
+	u64 switch_ns, reset_ns;
+	int step;
+
+	expected = xchg(&pogo_transport->hub_enum_expected, false);
+	switch_ns = xchg(&pogo_transport->hub_switch_ns, 0);
+	reset_ns = xchg(&pogo_transport->hub_reset_ns, 0);
+	step = atomic_xchg(&pogo_transport->hub_recover_step, 0);
+	if (expected && step > 0 && step <= HUB_RECOVER_STEPS) {
+		atomic_inc(&pogo_transport->hub_recover_success[step - 1]);
+		logbuffer_log(pogo_transport->log, "hub recovered by %s",
+			      pogo_hub_recover_names[step - 1]);
+	}
+	if (switch_ns)
+		pogo_transport_hub_enumerated(pogo_transport, "switch",
+					      &pogo_transport->hub_power_enum_timing, switch_ns);
+	else if (reset_ns)
+		pogo_transport_hub_enumerated(pogo_transport, "reset",
+					      &pogo_transport->hub_reset_enum_timing, reset_ns);
+}
+
 /* notifier callback from usb core */
 static int pogo_transport_udev_notify(struct notifier_block *nb, unsigned long action, void *dev)
 {
@@ -2618,6 +3832,17 @@ static int pogo_transport_udev_notify(struct notifier_block *nb, unsigned long a
 		if (udev->bus->root_hub == udev)
 			break;
 
+		trace_pogo_transport_udev_add(pogo_transport->dev,
+					      le16_to_cpu(udev->descriptor.idVendor),
+					      le16_to_cpu(udev->descriptor.idProduct), udev->speed);
+
+		/* A udev on the USB-C port says nothing about the hub */
+		if (READ_ONCE(pogo_transport->pogo_hub_active))
+			pogo_transport_hub_udev_added(pogo_transport);
+
+		if (udev->descriptor.bDeviceClass != USB_CLASS_HUB)
+			atomic_inc(&pogo_transport->hub_udev_count);
+
 		pogo_transport_udev_add(pogo_transport, udev);
 		break;
 	case USB_DEVICE_REMOVE:
@@ -2625,70 +3850,375 @@ static int pogo_transport_udev_notify(struct notifier_block *nb, unsigned long a
 		if (udev->bus->root_hub == udev)
 			break;
 
+		if (udev->descriptor.bDeviceClass != USB_CLASS_HUB) {
+			atomic_dec_if_positive(&pogo_transport->hub_udev_count);
+			pogo_transport_hub_idle_check(pogo_transport);
+		}
+
 		logbuffer_log(pogo_transport->log, "udev removed %04X:%04X",
 			      le16_to_cpu(udev->descriptor.idVendor),
 			      le16_to_cpu(udev->descriptor.idProduct));
 		break;
 	}
 
-	return NOTIFY_OK;
+	return NOTIFY_OK;
+}
+
+#if IS_ENABLED(CONFIG_DEBUG_FS)
+static int mock_hid_connected_set(void *data, u64 val)
+{
+	struct pogo_transport *pogo_transport = data;
+
+	if (pogo_transport->state_machine_enabled) {
+		logbuffer_log(pogo_transport->log, "state machine enabled; ignore mock hid");
+		return 0;
+	}
+
+	pogo_transport->mock_hid_connected = !!val;
+
+	logbuffer_log(pogo_transport->log, "%s: %u", __func__, pogo_transport->mock_hid_connected);
+
+	if (pogo_transport->mock_hid_connected)
+		pogo_transport_event(pogo_transport, EVENT_FORCE_ACC_CONNECT, 0);
+	else
+		pogo_transport_event(pogo_transport, EVENT_HALL_SENSOR_ACC_UNDOCKED, 0);
+
+	return 0;
+}
+
+static int mock_hid_connected_get(void *data, u64 *val)
+{
+	struct pogo_transport *pogo_transport = data;
+
+	*val = (u64)pogo_transport->mock_hid_connected;
+
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(mock_hid_connected_fops, mock_hid_connected_get, mock_hid_connected_set,
+			"%llu\n");
+
+#define POGO_TRANSPORT_DEBUGFS_RW(_name)                                                        \
+static int _name##_set(void *data, u64 val)                                                     \
+{                                                                                               \
+	struct pogo_transport *pogo_transport  = data;                                          \
+	pogo_transport->_name = val;                                                          \
+	logbuffer_log(pogo_transport->log, "%s: %lu", __func__,                                 \
+		      pogo_transport->_name);                                                   \
+	return 0;                                                                               \
+}                                                                                               \
+static int _name##_get(void *data, u64 *val)                                                    \
+{                                                                                               \
+	struct pogo_transport *pogo_transport  = data;                                          \
+	*val = (u64)pogo_transport->_name;                                                      \
+	return 0;                                                                               \
+}                                                                                               \
+DEFINE_SIMPLE_ATTRIBUTE(_name##_fops, _name##_get, _name##_set, "%llu\n")
+POGO_TRANSPORT_DEBUGFS_RW(lc_delay_check_ms);
+POGO_TRANSPORT_DEBUGFS_RW(lc_enable_ms);
+POGO_TRANSPORT_DEBUGFS_RW(lc_disable_ms);
+POGO_TRANSPORT_DEBUGFS_RW(lc_bootup_ms);
+POGO_TRANSPORT_DEBUGFS_RW(lc_safety_check_ms);
+POGO_TRANSPORT_DEBUGFS_RW(acc_charging_timeout_sec);
+POGO_TRANSPORT_DEBUGFS_RW(hub_idle_ms);
+POGO_TRANSPORT_DEBUGFS_RW(hub_enum_timeout_ms);
+POGO_TRANSPORT_DEBUGFS_RW(hub_speculative);
+POGO_TRANSPORT_DEBUGFS_RW(adaptive_debounce);
+POGO_TRANSPORT_DEBUGFS_RW(debounce_margin_ms);
+POGO_TRANSPORT_DEBUGFS_RW(irq_storm_threshold);
+
+#define POGO_TRANSPORT_DEBUGFS_ATOMIC_RO(_name)                                                 \
+static int _name##_get(void *data, u64 *val)                                                    \
+{                                                                                               \
+	struct pogo_transport *pogo_transport  = data;                                          \
+	*val = (u64)atomic_read(&pogo_transport->_name);                                        \
+	return 0;                                                                               \
+}                                                                                               \
+DEFINE_SIMPLE_ATTRIBUTE(_name##_fops, _name##_get, NULL, "%llu\n")
+POGO_TRANSPORT_DEBUGFS_ATOMIC_RO(event_pool_hwm);
+POGO_TRANSPORT_DEBUGFS_ATOMIC_RO(event_pool_exhausted);
+POGO_TRANSPORT_DEBUGFS_ATOMIC_RO(event_ring_overflow);
+POGO_TRANSPORT_DEBUGFS_ATOMIC_RO(hub_spec_hits);
+POGO_TRANSPORT_DEBUGFS_ATOMIC_RO(hub_spec_misses);
+POGO_TRANSPORT_DEBUGFS_ATOMIC_RO(extcon_skipped);
+POGO_TRANSPORT_DEBUGFS_ATOMIC_RO(uevent_skipped);
+
+static void pogo_transport_timing_show(struct seq_file *s, const char *name,
+				       struct pogo_transport_timing *timing)
+{
+	int i;
+
+	seq_printf(s, "%s count:%llu avg_us:%llu max_us:%llu\n", name, timing->count,
+		   timing->count ? div64_u64(timing->total_ns, timing->count * NSEC_PER_USEC) : 0,
+		   div_u64(timing->max_ns, NSEC_PER_USEC));
+	seq_puts(s, "  hist_us:");
+	for (i = 0; i < POGO_TIMING_BUCKETS; i++)
+		seq_printf(s, " <%lu:%u", BIT(i), timing->hist[i]);
+	seq_puts(s, "\n");
+}
+
+static int handler_timing_show(struct seq_file *s, void *unused)
+{
+	struct pogo_transport *pogo_transport = s->private;
+	char name[32];
+	int i;
+
+	pogo_transport_timing_show(s, "update_pogo_transport", &pogo_transport->legacy_timing);
+	pogo_transport_timing_show(s, "event_handler", &pogo_transport->event_handler_timing);
+	pogo_transport_timing_show(s, "state_machine", &pogo_transport->state_machine_timing);
+	for (i = 0; i < EVENT_TYPES; i++) {
+		if (!pogo_transport->queue_delay[i].count)
+			continue;
+		scnprintf(name, sizeof(name), "queue_delay:%s", pogo_event_names[i]);
+		pogo_transport_timing_show(s, name, &pogo_transport->queue_delay[i]);
+	}
+	pogo_transport_timing_show(s, "hub_enum:power_up", &pogo_transport->hub_power_enum_timing);
+	pogo_transport_timing_show(s, "hub_enum:reset", &pogo_transport->hub_reset_enum_timing);
+
+	return 0;
+}
+
+static int handler_timing_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, handler_timing_show, inode->i_private);
+}
+
+/* Any write clears the statistics */
+static ssize_t handler_timing_write(struct file *file, const char __user *ubuf, size_t count,
+				   loff_t *ppos)
+{
+	struct pogo_transport *pogo_transport = ((struct seq_file *)file->private_data)->private;
+	struct max77759_plat *chip = pogo_transport->chip;
+
+	mutex_lock(&chip->data_path_lock);
+	memset(&pogo_transport->legacy_timing, 0, sizeof(pogo_transport->legacy_timing));
+	memset(&pogo_transport->event_handler_timing, 0,
+	       sizeof(pogo_transport->event_handler_timing));
+	memset(&pogo_transport->state_machine_timing, 0,
+	       sizeof(pogo_transport->state_machine_timing));
+	mutex_unlock(&chip->data_path_lock);
+
+	spin_lock(&pogo_transport->stats_lock);
+	memset(pogo_transport->queue_delay, 0, sizeof(pogo_transport->queue_delay));
+	memset(&pogo_transport->hub_power_enum_timing, 0,
+	       sizeof(pogo_transport->hub_power_enum_timing));
+	memset(&pogo_transport->hub_reset_enum_timing, 0,
+	       sizeof(pogo_transport->hub_reset_enum_timing));
+	spin_unlock(&pogo_transport->stats_lock);
+
+	return count;
+}
+
+static const struct file_operations handler_timing_fops = {
+	.owner = THIS_MODULE,
+	.open = handler_timing_open,
+	.read = seq_read,
+	.write = handler_timing_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int stats_open(struct inode *inode, struct file *file)
+{
+	struct pogo_transport *pogo_transport = inode->i_private;
+	struct pogo_transport_stats *snapshot;
+
+	snapshot = kvmalloc(sizeof(*snapshot), GFP_KERNEL);
+	if (!snapshot)
+		return -ENOMEM;
+
+	pogo_transport_stats_snapshot(pogo_transport, snapshot);
+	file->private_data = snapshot;
+
+	return 0;
+}
+
+/* Reads return struct pogo_transport_stats as of open() */
+static ssize_t stats_read(struct file *file, char __user *ubuf, size_t count, loff_t *ppos)
+{
+	return simple_read_from_buffer(ubuf, count, ppos, file->private_data,
+				       sizeof(struct pogo_transport_stats));
+}
+
+/* Any write resets the statistics */
+static ssize_t stats_write(struct file *file, const char __user *ubuf, size_t count,
+			   loff_t *ppos)
+{
+	struct pogo_transport *pogo_transport = file_inode(file)->i_private;
+
+	spin_lock(&pogo_transport->stats_lock);
+	pogo_transport_stats_reset_locked(pogo_transport, ktime_get_boottime_ns());
+	spin_unlock(&pogo_transport->stats_lock);
+
+	return count;
+}
+
+static int stats_release(struct inode *inode, struct file *file)
+{
+	kvfree(file->private_data);
+
+	return 0;
+}
+
+static const struct file_operations stats_fops = {
+	.owner = THIS_MODULE,
+	.open = stats_open,
+	.read = stats_read,
+	.write = stats_write,
+	.llseek = default_llseek,
+	.release = stats_release,
+};
+
+static int pogo_blog_cmp(const void *a, const void *b)
+{
+	const struct pogo_blog_entry *ea = a, *eb = b;
+
+	if (ea->ts_ns == eb->ts_ns)
+		return 0;
+	return ea->ts_ns < eb->ts_ns ? -1 : 1;
+}
+
+/* Merge the per-CPU rings by timestamp. Entries written while reading may be torn. */
+static int blog_show(struct seq_file *s, void *unused)
+{
+	struct pogo_transport *pogo_transport = s->private;
+	struct pogo_blog_entry *entries, *entry;
+	struct pogo_blog_ring *ring;
+	unsigned int head, n, count = 0;
+	char buf[POGO_BLOG_LINE];
+	int cpu;
+	u64 ts;
+
+	if (!pogo_transport->blog)
+		return -ENODEV;
+
+	entries = kvcalloc(num_possible_cpus() * POGO_BLOG_SIZE, sizeof(*entries), GFP_KERNEL);
+	if (!entries)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		ring = per_cpu_ptr(pogo_transport->blog, cpu);
+		head = READ_ONCE(ring->head);
+		for (n = min_t(unsigned int, head, POGO_BLOG_SIZE); n; n--) {
+			entry = &ring->entries[(head - n) % POGO_BLOG_SIZE];
+			if (entry->id != BLOG_NONE)
+				entries[count++] = *entry;
+		}
+	}
+
+	sort(entries, count, sizeof(*entries), pogo_blog_cmp, NULL);
+
+	for (n = 0; n < count; n++) {
+		ts = entries[n].ts_ns;
+		pogo_transport_blog_format(buf, sizeof(buf), &entries[n]);
+		seq_printf(s, "[%5llu.%06lu] %s\n", div_u64(ts, NSEC_PER_SEC),
+			   (unsigned long)(do_div(ts, NSEC_PER_SEC) / NSEC_PER_USEC), buf);
+	}
+
+	kvfree(entries);
+
+	return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(blog);
 
-#if IS_ENABLED(CONFIG_DEBUG_FS)
-static int mock_hid_connected_set(void *data, u64 val)
+static int hub_recovery_show(struct seq_file *s, void *unused)
 {
-	struct pogo_transport *pogo_transport = data;
+	struct pogo_transport *pogo_transport = s->private;
+	int i;
 
-	if (pogo_transport->state_machine_enabled) {
-		logbuffer_log(pogo_transport->log, "state machine enabled; ignore mock hid");
-		return 0;
-	}
+	for (i = 0; i < HUB_RECOVER_STEPS; i++)
+		seq_printf(s, "%s attempts:%d recovered:%d\n", pogo_hub_recover_names[i],
+			   atomic_read(&pogo_transport->hub_recover_attempts[i]),
+			   atomic_read(&pogo_transport->hub_recover_success[i]));
+	seq_printf(s, "exhausted:%d\n", atomic_read(&pogo_transport->hub_recover_exhausted));
 
-	pogo_transport->mock_hid_connected = !!val;
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hub_recovery);
 
-	logbuffer_log(pogo_transport->log, "%s: %u", __func__, pogo_transport->mock_hid_connected);
+static int irq_storm_show(struct seq_file *s, void *unused)
+{
+	struct pogo_transport *pogo_transport = s->private;
+	struct pogo_irq_storm *storms[] = {&pogo_transport->pogo_storm, &pogo_transport->acc_storm};
+	int i;
 
-	if (pogo_transport->mock_hid_connected)
-		pogo_transport_event(pogo_transport, EVENT_FORCE_ACC_CONNECT, 0);
-	else
-		pogo_transport_event(pogo_transport, EVENT_HALL_SENSOR_ACC_UNDOCKED, 0);
+	for (i = 0; i < ARRAY_SIZE(storms); i++) {
+		if (!storms[i]->name)
+			continue;
+		seq_printf(s, "%s episodes:%d masked:%u backoff_ms:%u\n", storms[i]->name,
+			   atomic_read(&storms[i]->episodes), READ_ONCE(storms[i]->masked),
+			   READ_ONCE(storms[i]->backoff_ms));
+	}
 
 	return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(irq_storm);
 
-static int mock_hid_connected_get(void *data, u64 *val)
+static void pogo_transport_bounce_show(struct seq_file *s, const char *name,
+				       const struct pogo_bounce *bounce, unsigned int debounce_ms)
 {
-	struct pogo_transport *pogo_transport = data;
+	unsigned int head;
+	u64 last_ns, edge_ns;
+	int i;
 
-	*val = (u64)pogo_transport->mock_hid_connected;
+	seq_printf(s, "%s samples:%u p99_ms:%u range_ms:%u-%u debounce_ms:%u\n", name,
+		   READ_ONCE(bounce->weight) / POGO_BOUNCE_WEIGHT,
+		   pogo_transport_bounce_p99_ms(bounce), bounce->min_ms, bounce->max_ms,
+		   debounce_ms);
+	/* Weights are in 1/POGO_BOUNCE_WEIGHT of a burst, as older sessions have decayed */
+	seq_puts(s, "  hist_ms:");
+	for (i = 0; i < POGO_BOUNCE_BUCKETS; i++) {
+		if (READ_ONCE(bounce->hist[i]))
+			seq_printf(s, " %d:%u", i, READ_ONCE(bounce->hist[i]));
+	}
+	/* Recent edges in us before the last one, oldest first */
+	seq_puts(s, "\n  edges_us:");
+	head = READ_ONCE(bounce->edge_head);
+	last_ns = READ_ONCE(bounce->last_edge_ns);
+	for (i = min_t(unsigned int, head, POGO_EDGE_BUF); i > 0; i--) {
+		edge_ns = READ_ONCE(bounce->edge_ns[(head - i) & (POGO_EDGE_BUF - 1)]);
+		seq_printf(s, " -%llu", div_u64(last_ns - edge_ns, NSEC_PER_USEC));
+	}
+	seq_puts(s, "\n");
+}
+
+static int bounce_hist_show(struct seq_file *s, void *unused)
+{
+	struct pogo_transport *pogo_transport = s->private;
+
+	pogo_transport_bounce_show(s, "pogo", &pogo_transport->pogo_bounce,
+				   pogo_transport_delay_ms(pogo_transport, DELAY_POGO));
+	pogo_transport_bounce_show(s, "acc", &pogo_transport->acc_bounce,
+				   pogo_transport_delay_ms(pogo_transport, DELAY_ACC));
 
 	return 0;
 }
 
-DEFINE_SIMPLE_ATTRIBUTE(mock_hid_connected_fops, mock_hid_connected_get, mock_hid_connected_set,
-			"%llu\n");
+static int bounce_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, bounce_hist_show, inode->i_private);
+}
 
-#define POGO_TRANSPORT_DEBUGFS_RW(_name)                                                        \
-static int _name##_set(void *data, u64 val)                                                     \
-{                                                                                               \
-	struct pogo_transport *pogo_transport  = data;                                          \
-	pogo_transport->_name = val;                                                          \
-	logbuffer_log(pogo_transport->log, "%s: %lu", __func__,                                 \
-		      pogo_transport->_name);                                                   \
-	return 0;                                                                               \
-}                                                                                               \
-static int _name##_get(void *data, u64 *val)                                                    \
-{                                                                                               \
-	struct pogo_transport *pogo_transport  = data;                                          \
-	*val = (u64)pogo_transport->_name;                                                      \
-	return 0;                                                                               \
-}                                                                                               \
-DEFINE_SIMPLE_ATTRIBUTE(_name##_fops, _name##_get, _name##_set, "%llu\n")
-POGO_TRANSPORT_DEBUGFS_RW(lc_delay_check_ms);
-POGO_TRANSPORT_DEBUGFS_RW(lc_enable_ms);
-POGO_TRANSPORT_DEBUGFS_RW(lc_disable_ms);
-POGO_TRANSPORT_DEBUGFS_RW(lc_bootup_ms);
-POGO_TRANSPORT_DEBUGFS_RW(acc_charging_timeout_sec);
+/* Any write clears the histograms and starts learning again */
+static ssize_t bounce_hist_write(struct file *file, const char __user *ubuf, size_t count,
+				 loff_t *ppos)
+{
+	struct pogo_transport *pogo_transport = ((struct seq_file *)file->private_data)->private;
+
+	pogo_transport_bounce_clear(&pogo_transport->pogo_bounce);
+	pogo_transport_bounce_clear(&pogo_transport->acc_bounce);
+
+	return count;
+}
+
+static const struct file_operations bounce_hist_fops = {
+	.owner = THIS_MODULE,
+	.open = bounce_hist_open,
+	.read = seq_read,
+	.write = bounce_hist_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
 
 /*-------------------------------------------------------------------------*/
 /* Initialization                                                          */
@@ -2712,8 +4242,37 @@ static void pogo_transport_init_debugfs(struct pogo_transport *pogo_transport)
 	debugfs_create_file("lc_enable_ms", 0644, dentry, pogo_transport, &lc_enable_ms_fops);
 	debugfs_create_file("lc_disable_ms", 0644, dentry, pogo_transport, &lc_disable_ms_fops);
 	debugfs_create_file("lc_bootup_ms", 0644, dentry, pogo_transport, &lc_bootup_ms_fops);
+	debugfs_create_file("lc_safety_check_ms", 0644, dentry, pogo_transport,
+			    &lc_safety_check_ms_fops);
 	debugfs_create_file("acc_charging_timeout_sec", 0644, dentry, pogo_transport,
 			    &acc_charging_timeout_sec_fops);
+	debugfs_create_file("hub_idle_ms", 0644, dentry, pogo_transport, &hub_idle_ms_fops);
+	debugfs_create_file("hub_enum_timeout_ms", 0644, dentry, pogo_transport,
+			    &hub_enum_timeout_ms_fops);
+	debugfs_create_file("hub_recovery", 0444, dentry, pogo_transport, &hub_recovery_fops);
+	debugfs_create_file("hub_speculative", 0644, dentry, pogo_transport,
+			    &hub_speculative_fops);
+	debugfs_create_file("hub_spec_hits", 0444, dentry, pogo_transport, &hub_spec_hits_fops);
+	debugfs_create_file("hub_spec_misses", 0444, dentry, pogo_transport,
+			    &hub_spec_misses_fops);
+	debugfs_create_file("extcon_skipped", 0444, dentry, pogo_transport, &extcon_skipped_fops);
+	debugfs_create_file("uevent_skipped", 0444, dentry, pogo_transport, &uevent_skipped_fops);
+	debugfs_create_file("adaptive_debounce", 0644, dentry, pogo_transport,
+			    &adaptive_debounce_fops);
+	debugfs_create_file("debounce_margin_ms", 0644, dentry, pogo_transport,
+			    &debounce_margin_ms_fops);
+	debugfs_create_file("bounce_hist", 0644, dentry, pogo_transport, &bounce_hist_fops);
+	debugfs_create_file("irq_storm_threshold", 0644, dentry, pogo_transport,
+			    &irq_storm_threshold_fops);
+	debugfs_create_file("irq_storm", 0444, dentry, pogo_transport, &irq_storm_fops);
+	debugfs_create_file("event_pool_hwm", 0444, dentry, pogo_transport, &event_pool_hwm_fops);
+	debugfs_create_file("event_pool_exhausted", 0444, dentry, pogo_transport,
+			    &event_pool_exhausted_fops);
+	debugfs_create_file("event_ring_overflow", 0444, dentry, pogo_transport,
+			    &event_ring_overflow_fops);
+	debugfs_create_file("handler_timing", 0644, dentry, pogo_transport, &handler_timing_fops);
+	debugfs_create_file("blog", 0444, dentry, pogo_transport, &blog_fops);
+	debugfs_create_file("stats", 0644, dentry, pogo_transport, &stats_fops);
 }
 #endif /* IS_ENABLED(CONFIG_DEBUG_FS) */
 
@@ -2741,6 +4300,89 @@ static int init_regulator(struct pogo_transport *pogo_transport)
 	return 0;
 }
 
+/*
+ * Run wq-pogo-transport as SCHED_FIFO and/or on a subset of CPUs so that dock events are not
+ * delayed behind CFS tasks under load. Failures leave the worker at its defaults.
+ */
+static void init_worker_sched(struct pogo_transport *pogo_transport)
+{
+	struct device_node *dn = pogo_transport->dev->of_node;
+	struct task_struct *task = pogo_transport->wq->task;
+	struct sched_attr attr = { .sched_policy = SCHED_FIFO };
+	cpumask_var_t cpus;
+	u32 prio = 0, cpu;
+	int ret, i, count;
+
+	if (modparam_wq_rt_priority > 0)
+		prio = modparam_wq_rt_priority;
+	else
+		of_property_read_u32(dn, "pogo-wq-rt-priority", &prio);
+
+	if (prio) {
+		attr.sched_priority = min_t(u32, prio, MAX_RT_PRIO - 1);
+		ret = sched_setattr_nocheck(task, &attr);
+		if (ret)
+			dev_warn(pogo_transport->dev, "Failed to set wq priority %u (%d)\n",
+				 attr.sched_priority, ret);
+		else
+			logbuffer_log(pogo_transport->log, "wq SCHED_FIFO priority %u",
+				      attr.sched_priority);
+	}
+
+	if (!zalloc_cpumask_var(&cpus, GFP_KERNEL))
+		return;
+
+	if (modparam_wq_cpus && *modparam_wq_cpus) {
+		ret = cpulist_parse(modparam_wq_cpus, cpus);
+		if (ret) {
+			dev_warn(pogo_transport->dev, "Invalid wq_cpus %s (%d)\n", modparam_wq_cpus,
+				 ret);
+			goto free_cpus;
+		}
+	} else {
+		count = of_property_count_u32_elems(dn, "pogo-wq-cpus");
+		for (i = 0; i < count; i++) {
+			if (!of_property_read_u32_index(dn, "pogo-wq-cpus", i, &cpu) &&
+			    cpu < nr_cpu_ids)
+				cpumask_set_cpu(cpu, cpus);
+		}
+	}
+
+	cpumask_and(cpus, cpus, cpu_possible_mask);
+	if (cpumask_empty(cpus))
+		goto free_cpus;
+
+	ret = set_cpus_allowed_ptr(task, cpus);
+	if (ret)
+		dev_warn(pogo_transport->dev, "Failed to set wq cpus %*pbl (%d)\n",
+			 cpumask_pr_args(cpus), ret);
+	else
+		logbuffer_log(pogo_transport->log, "wq cpus %*pbl", cpumask_pr_args(cpus));
+
+free_cpus:
+	free_cpumask_var(cpus);
+}
+
+static int init_event_pool(struct pogo_transport *pogo_transport)
+{
+	struct device *dev = pogo_transport->dev;
+	u32 size;
+
+	if (of_property_read_u32(dev->of_node, "pogo-event-pool-size", &size) || !size)
+		size = POGO_EVENT_POOL_SIZE;
+
+	pogo_transport->event_pool = devm_kcalloc(dev, size, sizeof(struct pogo_event),
+						  GFP_KERNEL);
+	pogo_transport->event_pool_map = devm_kcalloc(dev, BITS_TO_LONGS(size),
+						      sizeof(unsigned long), GFP_KERNEL);
+	if (!pogo_transport->event_pool || !pogo_transport->event_pool_map)
+		return -ENOMEM;
+
+	pogo_transport->event_pool_size = size;
+
+	return 0;
+}
+
 static int init_pogo_irqs(struct pogo_transport *pogo_transport)
 {
 	int ret;
@@ -2752,6 +4394,10 @@ static int init_pogo_irqs(struct pogo_transport *pogo_transport)
 		return -ENODEV;
 	}
 
+	pogo_transport->irq_storm_threshold = POGO_IRQ_STORM_THRESHOLD;
+	pogo_transport_init_irq_storm(pogo_transport, &pogo_transport->pogo_storm, "pogo",
+				      pogo_transport->pogo_irq);
+
 	ret = devm_request_threaded_irq(pogo_transport->dev, pogo_transport->pogo_irq, pogo_isr,
 					pogo_irq, (IRQF_SHARED | IRQF_ONESHOT |
 						   IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING),
@@ -2781,6 +4427,9 @@ static int init_pogo_irqs(struct pogo_transport *pogo_transport)
 		goto disable_status_irq_wake;
 	}
 
+	pogo_transport_init_irq_storm(pogo_transport, &pogo_transport->acc_storm, "acc",
+				      pogo_transport->pogo_acc_irq);
+
 	ret = devm_request_threaded_irq(pogo_transport->dev, pogo_transport->pogo_acc_irq,
 					pogo_acc_isr, pogo_acc_irq,
 					(IRQF_SHARED | IRQF_ONESHOT |
@@ -2802,15 +4451,54 @@ static int init_pogo_irqs(struct pogo_transport *pogo_transport)
 	return 0;
 
 free_acc_irq:
+	WRITE_ONCE(pogo_transport->irq_storm_threshold, 0);
+	pogo_transport_cancel_irq_storm(&pogo_transport->acc_storm);
 	devm_free_irq(pogo_transport->dev, pogo_transport->pogo_acc_irq, pogo_transport);
+	kthread_cancel_delayed_work_sync(&pogo_transport->acc_bounce.close_work);
 disable_status_irq_wake:
 	disable_irq_wake(pogo_transport->pogo_irq);
 free_status_irq:
+	WRITE_ONCE(pogo_transport->irq_storm_threshold, 0);
+	pogo_transport_cancel_irq_storm(&pogo_transport->pogo_storm);
 	devm_free_irq(pogo_transport->dev, pogo_transport->pogo_irq, pogo_transport);
+	kthread_cancel_delayed_work_sync(&pogo_transport->pogo_bounce.close_work);
 
 	return ret;
 }
 
+static void init_adaptive_debounce(struct pogo_transport *pogo_transport)
+{
+	struct device_node *dn = pogo_transport->dev->of_node;
+	u32 range[2];
+
+	pogo_transport->adaptive_debounce = of_property_read_bool(dn, "pogo-adaptive-debounce");
+	pogo_transport->debounce_margin_ms = POGO_DEBOUNCE_MARGIN_MS;
+
+	spin_lock_init(&pogo_transport->pogo_bounce.lock);
+	kthread_init_delayed_work(&pogo_transport->pogo_bounce.close_work,
+				  pogo_transport_bounce_close_work);
+	pogo_transport->pogo_bounce.wq = pogo_transport->wq;
+	spin_lock_init(&pogo_transport->acc_bounce.lock);
+	kthread_init_delayed_work(&pogo_transport->acc_bounce.close_work,
+				  pogo_transport_bounce_close_work);
+	pogo_transport->acc_bounce.wq = pogo_transport->wq;
+
+	/* <min max> of the learned debounce */
+	if (of_property_read_u32_array(dn, "pogo-debounce-range-ms", range, 2)) {
+		range[0] = POGO_PSY_DEBOUNCE_MIN_MS;
+		range[1] = POGO_PSY_DEBOUNCE_MAX_MS;
+	}
+	pogo_transport->pogo_bounce.min_ms = range[0];
+	pogo_transport->pogo_bounce.max_ms = max(range[0], range[1]);
+
+	if (of_property_read_u32_array(dn, "pogo-acc-debounce-range-ms", range, 2)) {
+		range[0] = POGO_ACC_GPIO_DEBOUNCE_MIN_MS;
+		range[1] = POGO_ACC_GPIO_DEBOUNCE_MAX_MS;
+	}
+	pogo_transport->acc_bounce.min_ms = range[0];
+	pogo_transport->acc_bounce.max_ms = max(range[0], range[1]);
+}
+
 static int init_acc_gpio(struct pogo_transport *pogo_transport)
 {
 	int ret;
@@ -2849,6 +4537,9 @@ static int init_acc_gpio(struct pogo_transport *pogo_transport)
 
 static int init_hub_gpio(struct pogo_transport *pogo_transport)
 {
+	u32 idle_ms = 0, enum_timeout_ms;
+	int ret;
+
 	pogo_transport->pogo_hub_sel_gpio = of_get_named_gpio(pogo_transport->dev->of_node,
 							      "pogo-hub-sel", 0);
 	if (pogo_transport->pogo_hub_sel_gpio < 0) {
@@ -2865,6 +4556,39 @@ static int init_hub_gpio(struct pogo_transport *pogo_transport)
 		return pogo_transport->pogo_hub_reset_gpio;
 	}
 
+	ret = devm_gpio_request(pogo_transport->dev, pogo_transport->pogo_hub_reset_gpio,
+				"pogo-hub-reset");
+	if (ret) {
+		dev_err(pogo_transport->dev, "failed to request pogo-hub-reset gpio, ret:%d\n",
+			ret);
+		return ret;
+	}
+
+	ret = gpio_direction_output(pogo_transport->pogo_hub_reset_gpio, 0);
+	if (ret) {
+		dev_err(pogo_transport->dev, "failed set pogo-hub-reset as output, ret:%d\n", ret);
+		return ret;
+	}
+
+	/* Optional; the hub stays powered while docked if unset */
+	of_property_read_u32(pogo_transport->dev->of_node, "pogo-hub-idle-ms", &idle_ms);
+	pogo_transport->hub_idle_ms = idle_ms;
+
+	if (of_property_read_u32(pogo_transport->dev->of_node, "pogo-hub-reset-assert-us",
+				 &pogo_transport->hub_reset_assert_us))
+		pogo_transport->hub_reset_assert_us = POGO_HUB_RESET_ASSERT_US;
+	if (of_property_read_u32(pogo_transport->dev->of_node, "pogo-hub-reset-settle-us",
+				 &pogo_transport->hub_reset_settle_us))
+		pogo_transport->hub_reset_settle_us = POGO_HUB_RESET_SETTLE_US;
+	if (of_property_read_u32(pogo_transport->dev->of_node, "pogo-hub-enum-timeout-ms",
+				 &enum_timeout_ms))
+		enum_timeout_ms = POGO_HUB_ENUM_TIMEOUT_MS;
+	pogo_transport->hub_enum_timeout_ms = enum_timeout_ms;
+
+	/* Opt-in; trades hub_ldo power on a missed attach for a faster dock */
+	pogo_transport->hub_speculative = of_property_read_bool(pogo_transport->dev->of_node,
+								"pogo-hub-speculative");
+
 	pogo_transport->hub_state = pinctrl_lookup_state(pogo_transport->pinctrl, "hub");
 	if (IS_ERR(pogo_transport->hub_state)) {
 		dev_err(pogo_transport->dev, "failed to find pinctrl hub ret:%ld\n",
@@ -3002,7 +4726,7 @@ static int pogo_transport_probe(struct platform_device *pdev)
 	struct i2c_client *data_client;
 	struct max77759_plat *chip;
 	char *pogo_psy_name;
-	int ret;
+	int ret, i;
 
 	data_np = of_parse_phandle(pdev->dev.of_node, "data-phandle", 0);
 	if (!data_np) {
@@ -3041,21 +4765,41 @@ static int pogo_transport_probe(struct platform_device *pdev)
 	}
 	platform_set_drvdata(pdev, pogo_transport);
 
+	/* Not fatal; the hot paths only log to logbuffer_verbose then */
+	pogo_transport->blog = devm_alloc_percpu(&pdev->dev, struct pogo_blog_ring);
+	if (!pogo_transport->blog)
+		dev_warn(pogo_transport->dev, "Failed to allocate binary log\n");
+
 	spin_lock_init(&pogo_transport->pogo_event_lock);
+	spin_lock_init(&pogo_transport->stats_lock);
+	pogo_transport_stats_reset_locked(pogo_transport, ktime_get_boottime_ns());
+	for (i = 0; i < POGO_EVENT_RING_SIZE; i++)
+		atomic_set(&pogo_transport->event_ring[i].seq, i);
 
 	pogo_transport->wq = kthread_create_worker(0, "wq-pogo-transport");
 	if (IS_ERR_OR_NULL(pogo_transport->wq)) {
 		ret = PTR_ERR(pogo_transport->wq);
 		goto unreg_logbuffer;
 	}
+	init_worker_sched(pogo_transport);
 
 	kthread_init_delayed_work(&pogo_transport->pogo_accessory_debounce_work,
 				  process_debounce_event);
 	kthread_init_delayed_work(&pogo_transport->state_machine,
 				  pogo_transport_state_machine_work);
+	pogo_transport->sm.ops = &pogo_transport_sm_ops;
+	kthread_init_delayed_work(&pogo_transport->hub_host_work, pogo_transport_hub_host_work);
+	kthread_init_delayed_work(&pogo_transport->uevent_work, pogo_transport_uevent_work);
+	kthread_init_delayed_work(&pogo_transport->hub_idle_work, pogo_transport_hub_idle_work);
+	kthread_init_delayed_work(&pogo_transport->hub_enum_work, pogo_transport_hub_enum_work);
+	kthread_init_delayed_work(&pogo_transport->hub_spec_work, pogo_transport_hub_spec_work);
+	kthread_init_delayed_work(&pogo_transport->voltage_qual_work,
+				  pogo_transport_voltage_qual_work);
 
 	alarm_init(&pogo_transport->lc_check_alarm, ALARM_BOOTTIME, lc_check_alarm_handler);
 	kthread_init_work(&pogo_transport->lc_work, lc_check_alarm_work_item);
+	kthread_init_delayed_work(&pogo_transport->lc_retry_work, lc_retry_work_item);
+	kthread_init_work(&pogo_transport->acc_charger_work, pogo_transport_acc_charger_work);
 	kthread_init_work(&pogo_transport->event_work, pogo_transport_event_handler);
 
 	dn = dev_of_node(pogo_transport->dev);
@@ -3069,6 +4813,10 @@ static int pogo_transport_probe(struct platform_device *pdev)
 	if (ret)
 		goto destroy_worker;
 
+	ret = init_event_pool(pogo_transport);
+	if (ret)
+		goto destroy_worker;
+
 	pogo_psy_name = (char *)of_get_property(dn, "pogo-psy-name", NULL);
 	if (!pogo_psy_name) {
 		dev_err(pogo_transport->dev, "pogo-psy-name not set\n");
@@ -3147,7 +4895,7 @@ static int pogo_transport_probe(struct platform_device *pdev)
 	}
 
 	if (pogo_transport->state_machine_enabled) {
-		pogo_transport_set_state(pogo_transport, STANDBY, 0);
+		pogo_sm_set_state(&pogo_transport->sm, STANDBY, 0);
 		pogo_transport->wait_for_suspend = true;
 		pogo_transport->lc_stage = STAGE_UNKNOWN;
 	}
@@ -3178,6 +4926,7 @@ static int pogo_transport_probe(struct platform_device *pdev)
 		pogo_transport->lc_disable_ms = LC_DISABLE_MS;
 		pogo_transport->lc_enable_ms = LC_ENABLE_MS;
 		pogo_transport->lc_bootup_ms = LC_BOOTUP_MS;
+		pogo_transport->lc_safety_check_ms = LC_SAFETY_CHECK_MS;
 		pogo_transport->acc_charging_timeout_sec = ACC_CHARGING_TIMEOUT_SEC;
 		pogo_transport->acc_charging_full_begin_ns = 0;
 		pogo_transport->acc_discharging_begin_ns = 0;
@@ -3186,12 +4935,33 @@ static int pogo_transport_probe(struct platform_device *pdev)
 	pogo_transport->disable_voltage_detection =
 		of_property_read_bool(dn, "disable-voltage-detection");
 
+	init_adaptive_debounce(pogo_transport);
+
 	ret = init_pogo_irqs(pogo_transport);
 	if (ret) {
 		dev_err(pogo_transport->dev, "init_pogo_irqs error:%d\n", ret);
 		goto psy_put;
 	}
 
+	pogo_transport->pogo_psy_nb.notifier_call = pogo_transport_pogo_psy_notify;
+	ret = power_supply_reg_notifier(&pogo_transport->pogo_psy_nb);
+	if (ret)
+		dev_err(pogo_transport->dev, "pogo_psy notifier failed, polling:%d\n", ret);
+	else
+		pogo_transport->pogo_psy_nb_registered = true;
+
+	if (pogo_transport->acc_charger_psy_name) {
+		pogo_transport->acc_charger_nb.notifier_call = pogo_transport_acc_charger_notify;
+		ret = power_supply_reg_notifier(&pogo_transport->acc_charger_nb);
+		if (ret)
+			dev_err(pogo_transport->dev, "acc_charger notifier failed, polling:%d\n",
+				ret);
+		else
+			pogo_transport->acc_charger_nb_registered = true;
+	}
+
+	init_hall_input(pogo_transport);
+
 #if IS_ENABLED(CONFIG_DEBUG_FS)
 	pogo_transport_init_debugfs(pogo_transport);
 #endif
@@ -3231,6 +5001,14 @@ static int pogo_transport_remove(struct platform_device *pdev)
 	int ret;
 
 	usb_unregister_notify(&pogo_transport->udev_nb);
+	if (pogo_transport->hall_handler_registered) {
+		input_unregister_handler(&pogo_transport->hall_handler);
+		kthread_cancel_work_sync(&pogo_transport->hall_work);
+	}
+	if (pogo_transport->pogo_psy_nb_registered)
+		power_supply_unreg_notifier(&pogo_transport->pogo_psy_nb);
+	if (pogo_transport->acc_charger_nb_registered)
+		power_supply_unreg_notifier(&pogo_transport->acc_charger_nb);
 
 #if IS_ENABLED(CONFIG_DEBUG_FS)
 	dentry = debugfs_lookup("pogo_transport", NULL);
@@ -3253,12 +5031,30 @@ static int pogo_transport_remove(struct platform_device *pdev)
 	    regulator_is_enabled(pogo_transport->acc_detect_ldo) > 0)
 		regulator_disable(pogo_transport->acc_detect_ldo);
 
+	/* Stop masking new storms and drop any pending unmask before the lines are freed */
+	WRITE_ONCE(pogo_transport->irq_storm_threshold, 0);
+	pogo_transport_cancel_irq_storm(&pogo_transport->pogo_storm);
+	pogo_transport_cancel_irq_storm(&pogo_transport->acc_storm);
+
 	if (pogo_transport->pogo_acc_irq > 0) {
 		disable_irq_wake(pogo_transport->pogo_acc_irq);
 		devm_free_irq(pogo_transport->dev, pogo_transport->pogo_acc_irq, pogo_transport);
 	}
 	disable_irq_wake(pogo_transport->pogo_irq);
 	devm_free_irq(pogo_transport->dev, pogo_transport->pogo_irq, pogo_transport);
+	kthread_cancel_delayed_work_sync(&pogo_transport->pogo_bounce.close_work);
+	kthread_cancel_delayed_work_sync(&pogo_transport->acc_bounce.close_work);
+	/* The notifiers are gone; stop the readers of the power_supply handles before the puts */
+	alarm_cancel(&pogo_transport->lc_check_alarm);
+	kthread_cancel_work_sync(&pogo_transport->lc_work);
+	kthread_cancel_delayed_work_sync(&pogo_transport->lc_retry_work);
+	kthread_cancel_work_sync(&pogo_transport->acc_charger_work);
+	kthread_cancel_delayed_work_sync(&pogo_transport->voltage_qual_work);
+	kthread_cancel_delayed_work_sync(&pogo_transport->hub_host_work);
+	kthread_cancel_delayed_work_sync(&pogo_transport->hub_idle_work);
+	kthread_cancel_delayed_work_sync(&pogo_transport->hub_enum_work);
+	kthread_cancel_delayed_work_sync(&pogo_transport->hub_spec_work);
+	kthread_cancel_delayed_work_sync(&pogo_transport->uevent_work);
 	if (pogo_transport->acc_charger_psy)
 		power_supply_put(pogo_transport->acc_charger_psy);
 	power_supply_put(pogo_transport->pogo_psy);
@@ -3316,6 +5112,7 @@ static ssize_t force_pogo_store(struct device *dev, struct device_attribute *att
 		return size;
 
 	pogo_transport->force_pogo = force_pogo;
+	pogo_transport_snapshot_changed(pogo_transport);
 	if (force_pogo && !pogo_transport->state_machine_enabled)
 		pogo_transport_event(pogo_transport, EVENT_MOVE_DATA_TO_POGO, 0);
 
@@ -3378,26 +5175,20 @@ static ssize_t enable_hub_show(struct device *dev, struct device_attribute *attr
 }
 static DEVICE_ATTR_RW(enable_hub);
 
-static ssize_t hall1_s_store(struct device *dev, struct device_attribute *attr, const char *buf,
-			     size_t size)
+/* Handle a HES1 South report from the hall1_s attribute or the hall sensor input device */
+static void pogo_transport_hall1_s(struct pogo_transport *pogo_transport, u8 enable_acc_detect)
 {
-	struct pogo_transport *pogo_transport = dev_get_drvdata(dev);
-	u8 enable_acc_detect;
-
 	if (!pogo_transport->acc_detect_ldo)
-		return size;
+		return;
 
 	if (!pogo_transport->accessory_detection_enabled) {
 		logbuffer_logk(pogo_transport->log, LOGLEVEL_INFO, "%s:Accessory detection disabled",
 			       __func__);
-		return size;
+		return;
 	}
 
-	if (kstrtou8(buf, 0, &enable_acc_detect))
-		return -EINVAL;
-
 	if (pogo_transport->hall1_s_state == !!enable_acc_detect)
-		return size;
+		return;
 
 	pogo_transport->hall1_s_state = !!enable_acc_detect;
 
@@ -3413,15 +5204,31 @@ static ssize_t hall1_s_store(struct device *dev, struct device_attribute *attr,
 	logbuffer_log(pogo_transport->log, "H1S: accessory detection %u, mfg %u", enable_acc_detect,
 		      pogo_transport->mfg_acc_test);
 
+	/* Accessory detached; age what was learned from this one */
+	if (!enable_acc_detect)
+		pogo_transport_bounce_decay(&pogo_transport->acc_bounce);
+
 	if (pogo_transport->state_machine_enabled) {
 		pogo_transport_queue_event(pogo_transport, EVENT_HES_H1S_CHANGED);
-		return size;
+		return;
 	}
 
 	if (enable_acc_detect)
 		pogo_transport_event(pogo_transport, EVENT_HALL_SENSOR_ACC_DETECTED, 0);
 	else
 		pogo_transport_event(pogo_transport, EVENT_HALL_SENSOR_ACC_UNDOCKED, 0);
+}
+
+static ssize_t hall1_s_store(struct device *dev, struct device_attribute *attr, const char *buf,
+			     size_t size)
+{
+	struct pogo_transport *pogo_transport = dev_get_drvdata(dev);
+	u8 enable_acc_detect;
+
+	if (kstrtou8(buf, 0, &enable_acc_detect))
+		return -EINVAL;
+
+	pogo_transport_hall1_s(pogo_transport, enable_acc_detect);
 
 	return size;
 }
@@ -3443,34 +5250,202 @@ static ssize_t hall1_n_store(struct device *dev, struct device_attribute *attr,
 }
 static DEVICE_ATTR_WO(hall1_n);
 
-static ssize_t hall2_s_store(struct device *dev, struct device_attribute *attr, const char *buf,
-			     size_t size)
+/* Handle a HES2 South (LC) report from the hall2_s attribute or the hall sensor input device */
+static void pogo_transport_hall2_s(struct pogo_transport *pogo_transport, u8 data)
 {
-	struct pogo_transport *pogo_transport = dev_get_drvdata(dev);
-	u8 data;
-
-	if (kstrtou8(buf, 0, &data))
-		return -EINVAL;
-
 	if (pogo_transport->lc == !!data)
-		return size;
+		return;
 
 	pogo_transport->lc = !!data;
+	pogo_transport_snapshot_changed(pogo_transport);
 
 	if (!pogo_transport->lc) {
 		alarm_cancel(&pogo_transport->lc_check_alarm);
 		kthread_cancel_work_sync(&pogo_transport->lc_work);
+		kthread_cancel_delayed_work_sync(&pogo_transport->lc_retry_work);
 	}
 
 	logbuffer_log(pogo_transport->log, "H2S: %u", pogo_transport->lc);
 
 	if (pogo_transport->state_machine_enabled)
 		pogo_transport_queue_event(pogo_transport, EVENT_LC_STATUS_CHANGED);
+}
+
+static ssize_t hall2_s_store(struct device *dev, struct device_attribute *attr, const char *buf,
+			     size_t size)
+{
+	struct pogo_transport *pogo_transport = dev_get_drvdata(dev);
+	u8 data;
+
+	if (kstrtou8(buf, 0, &data))
+		return -EINVAL;
+
+	pogo_transport_hall2_s(pogo_transport, data);
 
 	return size;
 }
 static DEVICE_ATTR_WO(hall2_s);
 
+/* Apply the latest hall sensor input values in process context */
+static void pogo_transport_hall_work(struct kthread_work *work)
+{
+	struct pogo_transport *pogo_transport =
+			container_of(work, struct pogo_transport, hall_work);
+	int value;
+
+	value = atomic_xchg(&pogo_transport->hall_value[HALL1_S], -1);
+	if (value >= 0)
+		pogo_transport_hall1_s(pogo_transport, value);
+
+	value = atomic_xchg(&pogo_transport->hall_value[HALL2_S], -1);
+	if (value >= 0)
+		pogo_transport_hall2_s(pogo_transport, value);
+}
+
+static void pogo_transport_hall_report(struct pogo_transport *pogo_transport, struct input_dev *dev,
+				       unsigned int type, unsigned int code, int value)
+{
+	int i;
+
+	for (i = 0; i < HALL_COUNT; i++) {
+		if (!pogo_transport->hall_input[i] ||
+		    strcmp(dev->name, pogo_transport->hall_input[i]) ||
+		    type != pogo_transport->hall_event[i][0] ||
+		    code != pogo_transport->hall_event[i][1])
+			continue;
+
+		atomic_set(&pogo_transport->hall_value[i], !!value);
+		kthread_queue_work(pogo_transport->wq, &pogo_transport->hall_work);
+	}
+}
+
+/* Called with the input device event lock held; hand the value over to hall_work */
+static void pogo_transport_hall_event(struct input_handle *handle, unsigned int type,
+				      unsigned int code, int value)
+{
+	struct pogo_transport *pogo_transport =
+			container_of(handle->handler, struct pogo_transport, hall_handler);
+
+	pogo_transport_hall_report(pogo_transport, handle->dev, type, code, value);
+}
+
+static bool pogo_transport_hall_match(struct input_handler *handler, struct input_dev *dev)
+{
+	struct pogo_transport *pogo_transport =
+			container_of(handler, struct pogo_transport, hall_handler);
+	int i;
+
+	if (!dev->name)
+		return false;
+
+	for (i = 0; i < HALL_COUNT; i++) {
+		if (pogo_transport->hall_input[i] &&
+		    !strcmp(dev->name, pogo_transport->hall_input[i]))
+			return true;
+	}
+
+	return false;
+}
+
+static int pogo_transport_hall_connect(struct input_handler *handler, struct input_dev *dev,
+				       const struct input_device_id *id)
+{
+	struct pogo_transport *pogo_transport =
+			container_of(handler, struct pogo_transport, hall_handler);
+	struct input_handle *handle;
+	int i, ret;
+
+	handle = kzalloc(sizeof(*handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "pogo-transport";
+
+	ret = input_register_handle(handle);
+	if (ret)
+		goto free_handle;
+
+	ret = input_open_device(handle);
+	if (ret)
+		goto unregister_handle;
+
+	logbuffer_log(pogo_transport->log, "hall input %s connected", dev->name);
+
+	/* Pick up a switch that is already closed, e.g. an accessory attached at boot */
+	for (i = 0; i < HALL_COUNT; i++) {
+		if (pogo_transport->hall_event[i][0] == EV_SW)
+			pogo_transport_hall_report(pogo_transport, dev, EV_SW,
+						   pogo_transport->hall_event[i][1],
+						   test_bit(pogo_transport->hall_event[i][1],
+							    dev->sw));
+	}
+
+	return 0;
+
+unregister_handle:
+	input_unregister_handle(handle);
+free_handle:
+	kfree(handle);
+	return ret;
+}
+
+static void pogo_transport_hall_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+/* Match every input device; pogo_transport_hall_match() filters them by name */
+static const struct input_device_id pogo_transport_hall_ids[] = {
+	{ .driver_info = 1 },
+	{ },
+};
+
+static void init_hall_input(struct pogo_transport *pogo_transport)
+{
+	static const char * const props[HALL_COUNT][2] = {
+		[HALL1_S] = {"pogo-hall1-s-input", "pogo-hall1-s-event"},
+		[HALL2_S] = {"pogo-hall2-s-input", "pogo-hall2-s-event"},
+	};
+	struct device_node *dn = pogo_transport->dev->of_node;
+	bool found = false;
+	int i, ret;
+
+	kthread_init_work(&pogo_transport->hall_work, pogo_transport_hall_work);
+	for (i = 0; i < HALL_COUNT; i++) {
+		atomic_set(&pogo_transport->hall_value[i], -1);
+		if (of_property_read_string(dn, props[i][0], &pogo_transport->hall_input[i]))
+			continue;
+
+		/* <type code>, e.g. <EV_SW SW_LID> */
+		if (of_property_read_u32_array(dn, props[i][1], pogo_transport->hall_event[i], 2)) {
+			dev_err(pogo_transport->dev, "%s missing, using sysfs\n", props[i][1]);
+			pogo_transport->hall_input[i] = NULL;
+			continue;
+		}
+		found = true;
+	}
+
+	if (!found)
+		return;
+
+	pogo_transport->hall_handler.event = pogo_transport_hall_event;
+	pogo_transport->hall_handler.match = pogo_transport_hall_match;
+	pogo_transport->hall_handler.connect = pogo_transport_hall_connect;
+	pogo_transport->hall_handler.disconnect = pogo_transport_hall_disconnect;
+	pogo_transport->hall_handler.name = "pogo-transport";
+	pogo_transport->hall_handler.id_table = pogo_transport_hall_ids;
+
+	ret = input_register_handler(&pogo_transport->hall_handler);
+	if (ret)
+		dev_err(pogo_transport->dev, "hall input handler failed, using sysfs:%d\n", ret);
+	else
+		pogo_transport->hall_handler_registered = true;
+}
+
 static ssize_t acc_detect_debounce_ms_store(struct device *dev, struct device_attribute *attr,
 					    const char *buf, size_t size)
 {
@@ -3498,6 +5473,47 @@ static ssize_t acc_detect_debounce_ms_show(struct device *dev, struct device_att
 }
 static DEVICE_ATTR_RW(acc_detect_debounce_ms);
 
+/*
+ * Consistent view of the driver state, one "key:value" per line. Pollable; notified, and gen
+ * bumped, whenever one of the values changes. Keys are only added, bumping
+ * POGO_SNAPSHOT_VERSION. -1 means absent.
+ */
+static ssize_t snapshot_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct pogo_transport *pogo_transport = dev_get_drvdata(dev);
+	struct max77759_plat *chip = pogo_transport->chip;
+	int hub_sel = -1, hub_reset = -1, hub_ldo = -1, acc_detect_ldo = -1;
+	ssize_t len;
+
+	mutex_lock(&chip->data_path_lock);
+	if (pogo_transport->hub_embedded) {
+		hub_sel = gpio_get_value(pogo_transport->pogo_hub_sel_gpio);
+		hub_reset = gpio_get_value(pogo_transport->pogo_hub_reset_gpio);
+	}
+	if (pogo_transport->hub_ldo)
+		hub_ldo = regulator_is_enabled(pogo_transport->hub_ldo) > 0;
+	if (pogo_transport->acc_detect_ldo)
+		acc_detect_ldo = regulator_is_enabled(pogo_transport->acc_detect_ldo) > 0;
+
+	len = sysfs_emit(buf,
+			 "version:%d\ngen:%llu\nstate:%s\npogo_usb_active:%u\npogo_hub_active:%u\n"
+			 "docked:%u\nforce_pogo:%u\ndata_mux:%d\nhub_sel:%d\nhub_reset:%d\n"
+			 "hub_ldo:%d\nacc_detect_ldo:%d\nvout:%u\npolarity:%d\n"
+			 "lc_stage:%d\nlc:%u\n",
+			 POGO_SNAPSHOT_VERSION, (u64)atomic64_read(&pogo_transport->snapshot_gen),
+			 pogo_states[pogo_transport->sm.state], pogo_transport->pogo_usb_active,
+			 pogo_transport->pogo_hub_active, pogo_transport->extcon_dock,
+			 pogo_transport->force_pogo,
+			 gpio_get_value(pogo_transport->pogo_data_mux_gpio), hub_sel, hub_reset,
+			 hub_ldo, acc_detect_ldo,
+			 !!READ_ONCE(pogo_transport->stats_rail_on_ns[STATS_RAIL_POGO_VOUT]),
+			 pogo_transport->polarity, pogo_transport->lc_stage, pogo_transport->lc);
+	mutex_unlock(&chip->data_path_lock);
+
+	return len;
+}
+static DEVICE_ATTR_RO(snapshot);
+
 static struct attribute *pogo_transport_attrs[] = {
 	&dev_attr_move_data_to_usb.attr,
 	&dev_attr_equal_priority.attr,
@@ -3508,6 +5524,7 @@ static struct attribute *pogo_transport_attrs[] = {
 	&dev_attr_hall1_n.attr,
 	&dev_attr_hall2_s.attr,
 	&dev_attr_acc_detect_debounce_ms.attr,
+	&dev_attr_snapshot.attr,
 	NULL,
 };
 ATTRIBUTE_GROUPS(pogo_transport);
@@ -0,0 +1,893 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (C) 2023, Google LLC
+ *
+ * Pogo management driver: states, inputs and the transition table of the State Machine, and the
+ * core that feeds inputs to it.
+ *
+ * The core only reaches the hardware through struct pogo_sm_ops and this header only depends on
+ * BIT() and static_assert(), so the same code runs in pogo_transport.c, in the KUnit test on a
+ * fake board and in the userspace simulator, see pogo_transport_sm_fake.h and pogo_sm_sim.c.
+ */
+
+#ifndef __POGO_TRANSPORT_SM_H__
+#define __POGO_TRANSPORT_SM_H__
+
+#ifdef __KERNEL__
+#include <linux/bits.h>
+#include <linux/build_bug.h>
+#include <linux/types.h>
+#else
+#include <assert.h>
+#include <stdbool.h>
+#ifndef BIT
+#define BIT(nr) (1UL << (nr))
+#endif
+#endif
+
+/*
+ * State Description:
+ *	INVALID_STATE,
+ *  (A)	STANDBY,			// Nothing attached, hub disabled
+ *	DOCKING_DEBOUNCED,		// STANDBY -> DOCK_HUB, pogo gpio
+ *	STANDBY_ACC_DEBOUNCED,		// STANDBY -> ACC_DIRECT, acc gpio
+ *  (B)	DOCK_HUB,			// Dock online, hub enabled
+ *  (C)	DOCK_DEVICE_HUB,		// Dock online, usb device online, hub enabled
+ *  (H)	DOCK_AUDIO_HUB,			// Dock online, usb audio online, hub enabled
+ *  (I)	AUDIO_HUB,			// Usb audio online, hub enabled
+ *	AUDIO_HUB_DOCKING_DEBOUNCED,	// AUDIO_HUB -> DOCK_AUDIO_HUB, pogo gpio
+ *	AUDIO_HUB_ACC_DEBOUNCED,	// AUDIO_HUB -> ACC_AUDIO_HUB, acc gpio
+ *  (D)	DEVICE_HUB,			// Usb device online, hub enabled
+ *      DEVICE_HUB_DOCKING_DEBOUNCED,   // DEVICE_HUB -> DOCK_DEVICE_HUB, pogo gpio
+ *      DEVICE_HUB_ACC_DEBOUNCED,	// DEVICE_HUB -> ACC_DEVICE_HUB, acc gpio
+ *  (E)	DEVICE_DIRECT,			// Usb device online, hub disabled
+ *	DEVICE_DOCKING_DEBOUNCED,	// DEVICE_DIRECT -> DOCK_DEVICE_HUB, pogo gpio
+ *	DEVICE_DIRECT_ACC_DEBOUNCED,	// DEVICE_DIRECT -> ACC_DEVICE_HUB, acc gpio
+ *  (F)	AUDIO_DIRECT,			// Usb audio online, hub disabled
+ *	AUDIO_DIRECT_DOCKING_DEBOUNCED,	// AUDIO_DIRECT -> AUDIO_DIRECT_DOCK_OFFLINE, pogo gpio
+ *	AUDIO_DIRECT_ACC_DEBOUNCED,	// AUDIO_DIRECT -> ACC_DEVICE_HUB, acc gpio
+ *  (G)	AUDIO_DIRECT_DOCK_OFFLINE,	// Usb audio online, dock offline, hub disabled
+ *  (J)	HOST_DIRECT,			// Usb host online, hub disabled
+ *	HOST_DIRECT_DOCKING_DEBOUNCED,	// HOST_DIRECT -> HOST_DIRECT_DOCK_OFFLINE, pogo gpio
+ *  (K)	HOST_DIRECT_DOCK_OFFLINE,	// Usb host online, dock offline, hub disabled
+ *      HOST_DIRECT_ACC_DEBOUNCED,	// HOST_DIRECT -> HOST_DIRECT_ACC_OFFLINE, acc gpio
+ *  (L)	DOCK_HUB_HOST_OFFLINE,		// Dock online, usb host offline, hub enabled
+ *  (M)	ACC_DIRECT,			// Acc online, hub disabled
+ *  (N)	ACC_DEVICE_HUB,			// Acc online, usb device online, hub enabled
+ *  (O)	ACC_HUB,			// Acc online, hub enabled
+ *  (T)	ACC_HUB_HOST_OFFLINE,		// Acc online, hub enabled, usb host offline
+ *  (P)	ACC_AUDIO_HUB,			// Acc online, usb audio online, hub enabled
+ *  (Q)	LC,				// Pogo Vout off
+ *  (U)	LC_DEVICE_DIRECT,		// Pogo Vout off, Usb device online, hub disabled
+ *  (V)	LC_AUDIO_DIRECT,		// Pogo Vout off, Usb audio online, hub disabled
+ *  (W)	LC_ALL_OFFLINE,			// Pogo Vout off, Usb host offline, hub disabled
+ *  (X)	LC_HOST_DIRECT,			// Pogo Vout off, USb host online, hub disabled
+ *  (R)	HOST_DIRECT_ACC_OFFLINE,	// Usb host online, acc offline, hub disabled
+ *  (S)	ACC_DIRECT_HOST_OFFLINE,	// Acc online, usb host offline
+ */
+
+#define FOREACH_STATE(S)			\
+	S(INVALID_STATE),			\
+	S(STANDBY),				\
+	S(DOCKING_DEBOUNCED),			\
+	S(STANDBY_ACC_DEBOUNCED),		\
+	S(DOCK_HUB),				\
+	S(DOCK_DEVICE_HUB),			\
+	S(DOCK_AUDIO_HUB),			\
+	S(AUDIO_HUB),				\
+	S(AUDIO_HUB_DOCKING_DEBOUNCED),		\
+	S(AUDIO_HUB_ACC_DEBOUNCED),		\
+	S(DEVICE_HUB),				\
+	S(DEVICE_HUB_DOCKING_DEBOUNCED),	\
+	S(DEVICE_HUB_ACC_DEBOUNCED),		\
+	S(DEVICE_DIRECT),			\
+	S(DEVICE_DOCKING_DEBOUNCED),		\
+	S(DEVICE_DIRECT_ACC_DEBOUNCED),		\
+	S(AUDIO_DIRECT),			\
+	S(AUDIO_DIRECT_DOCKING_DEBOUNCED),	\
+	S(AUDIO_DIRECT_ACC_DEBOUNCED),		\
+	S(AUDIO_DIRECT_DOCK_OFFLINE),		\
+	S(HOST_DIRECT),				\
+	S(HOST_DIRECT_DOCKING_DEBOUNCED),	\
+	S(HOST_DIRECT_DOCK_OFFLINE),		\
+	S(HOST_DIRECT_ACC_DEBOUNCED),		\
+	S(DOCK_HUB_HOST_OFFLINE),		\
+	S(ACC_DIRECT),				\
+	S(ACC_DEVICE_HUB),			\
+	S(ACC_HUB),				\
+	S(ACC_HUB_HOST_OFFLINE),		\
+	S(ACC_AUDIO_HUB),			\
+	S(LC),					\
+	S(LC_DEVICE_DIRECT),			\
+	S(LC_AUDIO_DIRECT),			\
+	S(LC_ALL_OFFLINE),			\
+	S(LC_HOST_DIRECT),			\
+	S(HOST_DIRECT_ACC_OFFLINE),		\
+	S(ACC_DIRECT_HOST_OFFLINE)
+
+#define GENERATE_ENUM(e)	e
+#define GENERATE_STRING(s)	#s
+
+enum pogo_state {
+	FOREACH_STATE(GENERATE_ENUM)
+};
+
+static const char * const pogo_states[] = {
+	FOREACH_STATE(GENERATE_STRING)
+};
+
+/*
+ * Inputs of the State Machine. *_FP are the variants taken when force_pogo is set. ENTER* are fed
+ * by the State Machine itself upon entering a state; ENTER_DOCKED* if pogo is docked.
+ */
+#define FOREACH_INPUT(I)			\
+	I(POGO_ACTIVE),				\
+	I(POGO_STANDBY),			\
+	I(USBC_HOST_ON),			\
+	I(USBC_HOST_OFF),			\
+	I(USBC_DEVICE_ON),			\
+	I(USBC_DEVICE_OFF),			\
+	I(ENABLE_USB_DATA),			\
+	I(FORCE_POGO),				\
+	I(HES_ATTACH),				\
+	I(HES_ATTACH_HALL_ONLY),		\
+	I(HES_ATTACH_HALL_ONLY_FP),		\
+	I(HES_DETACH),				\
+	I(ACC_DEBOUNCING),			\
+	I(ACC_CONNECTED),			\
+	I(ACC_CONNECTED_FP),			\
+	I(AUDIO_DEV_ATTACHED),			\
+	I(USBC_ORIENTATION),			\
+	I(LC),					\
+	I(LC_CLEAR),				\
+	I(ENTER),				\
+	I(ENTER_DOCKED),			\
+	I(ENTER_DOCKED_FP)
+
+#define GENERATE_INPUT_ENUM(e)	INPUT_##e
+
+enum pogo_input {
+	FOREACH_INPUT(GENERATE_INPUT_ENUM),
+	NR_POGO_INPUTS
+};
+
+static const char * const pogo_inputs[] = {
+	FOREACH_INPUT(GENERATE_STRING)
+};
+
+/*
+ * Actions taken on a transition, executed in the order of the bits below:
+ *  - ACT_TOGGLE_HUB_MUX: b/271669059 toggle the hub mux if a superspeed udev was attached
+ *  - ACT_SKIP_ACC: pogo_transport_skip_acc_detection()
+ *  - ACT_ACC_DETECT: pogo_transport_enable_acc_detection()
+ *  - ACT_ACC_VOUT: pogo_transport_acc_debounced()
+ *  - ACT_ACC_LDO_OFF: disable the regulator for Accessory Detection Logic
+ *  - ACT_RESET_ACC: pogo_transport_reset_acc_detection()
+ *  - ACT_DATA_INACTIVE: clear data_active so that Type-C stack is able to call back for the
+ *		       data changed event (and enable the USB data) later
+ *  - ACT_USBC/ACT_POGO/ACT_HUB: switch_to_{usbc,pogo,hub}_locked()
+ *  - ACT_DATA_ACTIVE: set data_active since a USB-C partner is still attached. It has to be set
+ *		       after the data path switch which clears it.
+ *  - ACT_RESET_ACC_LATE: pogo_transport_reset_acc_detection() once the data path has been
+ *			switched away from pogo
+ *  - ACT_POLARITY: update the orientation and restart the ssphy
+ *  - ACT_DOCK: push the dock detected notification
+ *
+ * ACT_UNLESS_MFG skips the data path switch and ACT_DATA_ACTIVE if mfg_acc_test is set.
+ */
+#define ACT_TOGGLE_HUB_MUX	BIT(0)
+#define ACT_SKIP_ACC		BIT(1)
+#define ACT_ACC_DETECT		BIT(2)
+#define ACT_ACC_VOUT		BIT(3)
+#define ACT_ACC_LDO_OFF		BIT(4)
+#define ACT_RESET_ACC		BIT(5)
+#define ACT_DATA_INACTIVE	BIT(6)
+#define ACT_USBC		BIT(7)
+#define ACT_POGO		BIT(8)
+#define ACT_HUB			BIT(9)
+#define ACT_DATA_ACTIVE		BIT(10)
+#define ACT_RESET_ACC_LATE	BIT(11)
+#define ACT_POLARITY		BIT(12)
+#define ACT_DOCK		BIT(13)
+#define ACT_UNLESS_MFG		BIT(14)
+
+enum pogo_delay {
+	DELAY_NONE,
+	DELAY_POGO,	/* POGO_PSY_DEBOUNCE_MS */
+	DELAY_ACC,	/* pogo_acc_gpio_debounce_ms */
+};
+
+struct pogo_transition {
+	/* INVALID_STATE: stay in the current state */
+	enum pogo_state next;
+	unsigned int actions;
+	enum pogo_delay delay;
+};
+
+#define NOP			{ .next = INVALID_STATE }
+#define TO(s)			{ .next = s }
+#define TO_ACT(s, a)		{ .next = s, .actions = a }
+#define TO_DELAYED(s, d)	{ .next = s, .delay = d }
+#define ACT(a)			{ .next = INVALID_STATE, .actions = a }
+
+/*
+ * Each state lists the transition of every input in the order of enum pogo_input. Leaving an
+ * input out of a row, or leaving a state without a row, fails the build. Columns:
+ *	POGO_ACTIVE, POGO_STANDBY,
+ *	USBC_HOST_ON, USBC_HOST_OFF, USBC_DEVICE_ON, USBC_DEVICE_OFF,
+ *	ENABLE_USB_DATA, FORCE_POGO,
+ *	HES_ATTACH, HES_ATTACH_HALL_ONLY, HES_ATTACH_HALL_ONLY_FP, HES_DETACH,
+ *	ACC_DEBOUNCING, ACC_CONNECTED, ACC_CONNECTED_FP,
+ *	AUDIO_DEV_ATTACHED, USBC_ORIENTATION,
+ *	LC, LC_CLEAR,
+ *	ENTER, ENTER_DOCKED, ENTER_DOCKED_FP
+ */
+#define POGO_ROW(pogo_active, pogo_standby, host_on, host_off, device_on, device_off,		\
+		 enable_usb_data, force_pogo, hes_attach, hes_attach_hall_only,			\
+		 hes_attach_hall_only_fp, hes_detach, acc_debouncing, acc_connected,		\
+		 acc_connected_fp, audio_dev_attached, usbc_orientation, lc, lc_clear, enter,	\
+		 enter_docked, enter_docked_fp)							\
+	{											\
+		[INPUT_POGO_ACTIVE] = pogo_active,						\
+		[INPUT_POGO_STANDBY] = pogo_standby,						\
+		[INPUT_USBC_HOST_ON] = host_on,							\
+		[INPUT_USBC_HOST_OFF] = host_off,						\
+		[INPUT_USBC_DEVICE_ON] = device_on,						\
+		[INPUT_USBC_DEVICE_OFF] = device_off,						\
+		[INPUT_ENABLE_USB_DATA] = enable_usb_data,					\
+		[INPUT_FORCE_POGO] = force_pogo,						\
+		[INPUT_HES_ATTACH] = hes_attach,						\
+		[INPUT_HES_ATTACH_HALL_ONLY] = hes_attach_hall_only,				\
+		[INPUT_HES_ATTACH_HALL_ONLY_FP] = hes_attach_hall_only_fp,			\
+		[INPUT_HES_DETACH] = hes_detach,						\
+		[INPUT_ACC_DEBOUNCING] = acc_debouncing,					\
+		[INPUT_ACC_CONNECTED] = acc_connected,						\
+		[INPUT_ACC_CONNECTED_FP] = acc_connected_fp,					\
+		[INPUT_AUDIO_DEV_ATTACHED] = audio_dev_attached,				\
+		[INPUT_USBC_ORIENTATION] = usbc_orientation,					\
+		[INPUT_LC] = lc,								\
+		[INPUT_LC_CLEAR] = lc_clear,							\
+		[INPUT_ENTER] = enter,								\
+		[INPUT_ENTER_DOCKED] = enter_docked,						\
+		[INPUT_ENTER_DOCKED_FP] = enter_docked_fp,					\
+	}
+
+/* POGO_ROW has to be updated along with enum pogo_input */
+static_assert(NR_POGO_INPUTS == 22);
+
+#define INVALID_STATE_TRANSITIONS								\
+	POGO_ROW(NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP, NOP,									\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP)
+
+#define STANDBY_TRANSITIONS									\
+	POGO_ROW(TO_DELAYED(DOCKING_DEBOUNCED, DELAY_POGO), TO(STANDBY),			\
+		 TO(DEVICE_DIRECT), NOP, TO(HOST_DIRECT), NOP,					\
+		 NOP, NOP,									\
+		 ACT(ACT_ACC_DETECT),								\
+		 TO_ACT(ACC_DIRECT, ACT_SKIP_ACC | ACT_POGO | ACT_UNLESS_MFG),			\
+		 TO_ACT(ACC_DIRECT, ACT_SKIP_ACC | ACT_POGO | ACT_UNLESS_MFG), NOP,		\
+		 TO_DELAYED(STANDBY_ACC_DEBOUNCED, DELAY_ACC), NOP, NOP,			\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP)
+
+#define DOCKING_DEBOUNCED_TRANSITIONS								\
+	POGO_ROW(NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP, NOP,									\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 TO(STANDBY), TO_ACT(DOCK_HUB, ACT_HUB), TO_ACT(DOCK_HUB, ACT_HUB))
+
+#define STANDBY_ACC_DEBOUNCED_TRANSITIONS							\
+	POGO_ROW(TO_DELAYED(DOCKING_DEBOUNCED, DELAY_POGO), NOP,				\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, TO_ACT(STANDBY, ACT_RESET_ACC),					\
+		 TO_DELAYED(STANDBY_ACC_DEBOUNCED, DELAY_ACC),					\
+		 TO_ACT(ACC_DIRECT, ACT_ACC_LDO_OFF | ACT_POGO | ACT_UNLESS_MFG),		\
+		 TO_ACT(ACC_DIRECT, ACT_ACC_LDO_OFF | ACT_POGO | ACT_UNLESS_MFG),		\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 ACT(ACT_ACC_VOUT), ACT(ACT_ACC_VOUT), ACT(ACT_ACC_VOUT))
+
+#define DOCK_HUB_TRANSITIONS									\
+	POGO_ROW(NOP, TO_ACT(STANDBY, ACT_USBC),						\
+		 TO_ACT(DOCK_DEVICE_HUB, ACT_DATA_ACTIVE), NOP,					\
+		 TO_ACT(DOCK_HUB_HOST_OFFLINE, ACT_DATA_ACTIVE), NOP,				\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP, NOP,									\
+		 NOP, ACT(ACT_POLARITY),							\
+		 NOP, NOP,									\
+		 ACT(ACT_DOCK), ACT(ACT_DOCK), ACT(ACT_DOCK))
+
+#define DOCK_DEVICE_HUB_TRANSITIONS								\
+	POGO_ROW(NOP, TO(DEVICE_HUB),								\
+		 NOP, TO_ACT(DOCK_HUB, ACT_DATA_INACTIVE), NOP, NOP,				\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP, NOP,									\
+		 TO(DOCK_AUDIO_HUB), ACT(ACT_POLARITY),						\
+		 NOP, NOP,									\
+		 ACT(ACT_DOCK), ACT(ACT_DOCK), ACT(ACT_DOCK))
+
+#define DOCK_AUDIO_HUB_TRANSITIONS								\
+	POGO_ROW(NOP, TO(AUDIO_HUB),								\
+		 NOP, TO_ACT(DOCK_HUB, ACT_DATA_INACTIVE), NOP, NOP,				\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP, NOP,									\
+		 NOP, ACT(ACT_POLARITY),							\
+		 NOP, NOP,									\
+		 ACT(ACT_DOCK), ACT(ACT_DOCK), ACT(ACT_DOCK))
+
+#define AUDIO_HUB_TRANSITIONS									\
+	POGO_ROW(TO_DELAYED(AUDIO_HUB_DOCKING_DEBOUNCED, DELAY_POGO), NOP,			\
+		 NOP, TO_ACT(STANDBY, ACT_USBC), NOP, NOP,					\
+		 NOP, NOP,									\
+		 ACT(ACT_ACC_DETECT), TO_ACT(ACC_AUDIO_HUB, ACT_SKIP_ACC),			\
+		 TO_ACT(ACC_AUDIO_HUB, ACT_SKIP_ACC), NOP,					\
+		 TO_DELAYED(AUDIO_HUB_ACC_DEBOUNCED, DELAY_ACC), NOP, NOP,			\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP)
+
+#define AUDIO_HUB_DOCKING_DEBOUNCED_TRANSITIONS							\
+	POGO_ROW(NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP, NOP,									\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 TO(AUDIO_HUB), TO(DOCK_AUDIO_HUB), TO(DOCK_AUDIO_HUB))
+
+#define AUDIO_HUB_ACC_DEBOUNCED_TRANSITIONS							\
+	POGO_ROW(TO_DELAYED(AUDIO_HUB_DOCKING_DEBOUNCED, DELAY_POGO), NOP,			\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, TO_ACT(AUDIO_HUB, ACT_RESET_ACC),				\
+		 TO_DELAYED(AUDIO_HUB_ACC_DEBOUNCED, DELAY_ACC),				\
+		 TO_ACT(ACC_AUDIO_HUB, ACT_ACC_LDO_OFF),					\
+		 TO_ACT(ACC_AUDIO_HUB, ACT_ACC_LDO_OFF),					\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 ACT(ACT_ACC_VOUT), ACT(ACT_ACC_VOUT), ACT(ACT_ACC_VOUT))
+
+#define DEVICE_HUB_TRANSITIONS									\
+	POGO_ROW(TO_DELAYED(DEVICE_HUB_DOCKING_DEBOUNCED, DELAY_POGO), NOP,			\
+		 NOP, TO_ACT(STANDBY, ACT_USBC), NOP, NOP,					\
+		 NOP, NOP,									\
+		 ACT(ACT_ACC_DETECT), TO_ACT(ACC_DEVICE_HUB, ACT_SKIP_ACC),			\
+		 TO_ACT(ACC_DEVICE_HUB, ACT_SKIP_ACC), NOP,					\
+		 TO_DELAYED(DEVICE_HUB_ACC_DEBOUNCED, DELAY_ACC), NOP, NOP,			\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP)
+
+#define DEVICE_HUB_DOCKING_DEBOUNCED_TRANSITIONS						\
+	POGO_ROW(NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP, NOP,									\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 TO(DEVICE_HUB), TO(DOCK_DEVICE_HUB), TO(DOCK_DEVICE_HUB))
+
+#define DEVICE_HUB_ACC_DEBOUNCED_TRANSITIONS							\
+	POGO_ROW(TO_DELAYED(DEVICE_HUB_DOCKING_DEBOUNCED, DELAY_POGO), NOP,			\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, TO_ACT(DEVICE_HUB, ACT_RESET_ACC),				\
+		 TO_DELAYED(DEVICE_HUB_ACC_DEBOUNCED, DELAY_ACC),				\
+		 TO_ACT(ACC_DEVICE_HUB, ACT_ACC_LDO_OFF),					\
+		 TO_ACT(ACC_DEVICE_HUB, ACT_ACC_LDO_OFF),					\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 ACT(ACT_ACC_VOUT), ACT(ACT_ACC_VOUT), ACT(ACT_ACC_VOUT))
+
+#define DEVICE_DIRECT_TRANSITIONS								\
+	POGO_ROW(TO_DELAYED(DEVICE_DOCKING_DEBOUNCED, DELAY_POGO), NOP,				\
+		 NOP, TO(STANDBY), NOP, NOP,							\
+		 NOP, NOP,									\
+		 ACT(ACT_ACC_DETECT),								\
+		 TO_ACT(ACC_DEVICE_HUB, ACT_SKIP_ACC | ACT_HUB | ACT_DATA_ACTIVE),		\
+		 TO_ACT(ACC_DEVICE_HUB, ACT_SKIP_ACC | ACT_HUB | ACT_DATA_ACTIVE), NOP,		\
+		 TO_DELAYED(DEVICE_DIRECT_ACC_DEBOUNCED, DELAY_ACC), NOP, NOP,			\
+		 TO(AUDIO_DIRECT), NOP,								\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP)
+
+#define DEVICE_DOCKING_DEBOUNCED_TRANSITIONS							\
+	POGO_ROW(NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP, NOP,									\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 TO(DEVICE_DIRECT), TO_ACT(DOCK_DEVICE_HUB, ACT_HUB | ACT_DATA_ACTIVE),		\
+		 TO_ACT(DOCK_DEVICE_HUB, ACT_HUB | ACT_DATA_ACTIVE))
+
+#define DEVICE_DIRECT_ACC_DEBOUNCED_TRANSITIONS							\
+	POGO_ROW(TO_DELAYED(DEVICE_DOCKING_DEBOUNCED, DELAY_POGO), NOP,				\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, TO_ACT(DEVICE_DIRECT, ACT_RESET_ACC),				\
+		 TO_DELAYED(DEVICE_DIRECT_ACC_DEBOUNCED, DELAY_ACC),				\
+		 TO_ACT(ACC_DEVICE_HUB, ACT_ACC_LDO_OFF | ACT_HUB | ACT_DATA_ACTIVE),		\
+		 TO_ACT(ACC_DEVICE_HUB, ACT_ACC_LDO_OFF | ACT_HUB | ACT_DATA_ACTIVE),		\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 ACT(ACT_ACC_VOUT), ACT(ACT_ACC_VOUT), ACT(ACT_ACC_VOUT))
+
+#define AUDIO_DIRECT_TRANSITIONS								\
+	POGO_ROW(TO_DELAYED(AUDIO_DIRECT_DOCKING_DEBOUNCED, DELAY_POGO), NOP,			\
+		 NOP, TO(STANDBY), NOP, NOP,							\
+		 NOP, NOP,									\
+		 ACT(ACT_ACC_DETECT),								\
+		 TO_ACT(ACC_DEVICE_HUB, ACT_SKIP_ACC | ACT_HUB | ACT_DATA_ACTIVE),		\
+		 TO_ACT(ACC_DEVICE_HUB, ACT_SKIP_ACC | ACT_HUB | ACT_DATA_ACTIVE), NOP,		\
+		 TO_DELAYED(AUDIO_DIRECT_ACC_DEBOUNCED, DELAY_ACC), NOP, NOP,			\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP)
+
+#define AUDIO_DIRECT_DOCKING_DEBOUNCED_TRANSITIONS						\
+	POGO_ROW(NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP, NOP,									\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 TO(AUDIO_DIRECT), TO(AUDIO_DIRECT_DOCK_OFFLINE),				\
+		 TO(AUDIO_DIRECT_DOCK_OFFLINE))
+
+#define AUDIO_DIRECT_ACC_DEBOUNCED_TRANSITIONS							\
+	POGO_ROW(TO_DELAYED(AUDIO_DIRECT_DOCKING_DEBOUNCED, DELAY_POGO), NOP,			\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, TO_ACT(AUDIO_DIRECT, ACT_RESET_ACC),				\
+		 TO_DELAYED(AUDIO_DIRECT_ACC_DEBOUNCED, DELAY_ACC),				\
+		 TO_ACT(ACC_DEVICE_HUB, ACT_ACC_LDO_OFF | ACT_HUB | ACT_DATA_ACTIVE),		\
+		 TO_ACT(ACC_DEVICE_HUB, ACT_ACC_LDO_OFF | ACT_HUB | ACT_DATA_ACTIVE),		\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 ACT(ACT_ACC_VOUT), ACT(ACT_ACC_VOUT), ACT(ACT_ACC_VOUT))
+
+#define AUDIO_DIRECT_DOCK_OFFLINE_TRANSITIONS							\
+	POGO_ROW(NOP, TO(AUDIO_DIRECT),								\
+		 NOP, TO_ACT(DOCK_HUB, ACT_HUB), NOP, NOP,					\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP, NOP,									\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 ACT(ACT_DOCK), ACT(ACT_DOCK), ACT(ACT_DOCK))
+
+#define HOST_DIRECT_TRANSITIONS									\
+	POGO_ROW(TO_DELAYED(HOST_DIRECT_DOCKING_DEBOUNCED, DELAY_POGO), NOP,			\
+		 NOP, NOP, NOP, TO(STANDBY),							\
+		 NOP, NOP,									\
+		 ACT(ACT_ACC_DETECT), TO_ACT(HOST_DIRECT_ACC_OFFLINE, ACT_SKIP_ACC),		\
+		 TO_ACT(ACC_DIRECT_HOST_OFFLINE, ACT_SKIP_ACC | ACT_POGO | ACT_DATA_ACTIVE),	\
+		 NOP,										\
+		 TO_DELAYED(HOST_DIRECT_ACC_DEBOUNCED, DELAY_ACC), NOP, NOP,			\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP)
+
+#define HOST_DIRECT_DOCKING_DEBOUNCED_TRANSITIONS						\
+	POGO_ROW(NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP, NOP,									\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 TO(HOST_DIRECT), TO(HOST_DIRECT_DOCK_OFFLINE),					\
+		 TO_ACT(DOCK_HUB_HOST_OFFLINE, ACT_HUB | ACT_DATA_ACTIVE))
+
+#define HOST_DIRECT_DOCK_OFFLINE_TRANSITIONS							\
+	POGO_ROW(NOP, TO(HOST_DIRECT),								\
+		 NOP, NOP, NOP, TO_ACT(DOCK_HUB, ACT_HUB),					\
+		 NOP, TO_ACT(DOCK_HUB_HOST_OFFLINE, ACT_HUB | ACT_DATA_ACTIVE),			\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP, NOP,									\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 ACT(ACT_DOCK), ACT(ACT_DOCK), ACT(ACT_DOCK))
+
+#define HOST_DIRECT_ACC_DEBOUNCED_TRANSITIONS							\
+	POGO_ROW(TO_DELAYED(HOST_DIRECT_DOCKING_DEBOUNCED, DELAY_POGO), NOP,			\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, TO_ACT(HOST_DIRECT, ACT_RESET_ACC),				\
+		 TO_DELAYED(HOST_DIRECT_ACC_DEBOUNCED, DELAY_ACC),				\
+		 TO_ACT(HOST_DIRECT_ACC_OFFLINE, ACT_ACC_LDO_OFF),				\
+		 TO_ACT(ACC_DIRECT_HOST_OFFLINE,						\
+			ACT_ACC_LDO_OFF | ACT_POGO | ACT_DATA_ACTIVE),				\
+		 NOP, NOP,									\
+		 NOP, NOP,									\
+		 ACT(ACT_ACC_VOUT), ACT(ACT_ACC_VOUT), ACT(ACT_ACC_VOUT))
+
+#define DOCK_HUB_HOST_OFFLINE_TRANSITIONS							\
+	POGO_ROW(NOP, TO_ACT(HOST_DIRECT, ACT_DATA_INACTIVE | ACT_USBC),			\
+		 NOP, NOP, NOP, TO_ACT(DOCK_HUB, ACT_DATA_INACTIVE),				\
+		 TO_ACT(HOST_DIRECT_DOCK_OFFLINE, ACT_DATA_INACTIVE | ACT_USBC), NOP,		\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP, NOP,									\
+		 NOP, ACT(ACT_POLARITY),							\
+		 NOP, NOP,									\
+		 ACT(ACT_DOCK), ACT(ACT_DOCK), ACT(ACT_DOCK))
+
+#define ACC_DIRECT_TRANSITIONS									\
+	POGO_ROW(NOP, NOP,									\
+		 TO_ACT(ACC_DEVICE_HUB, ACT_HUB | ACT_DATA_ACTIVE), NOP,			\
+		 TO_ACT(ACC_DIRECT_HOST_OFFLINE, ACT_DATA_ACTIVE), NOP,				\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, TO_ACT(STANDBY, ACT_RESET_ACC | ACT_USBC),			\
+		 NOP, NOP, NOP,									\
+		 NOP, NOP,									\
+		 TO_ACT(LC, ACT_USBC | ACT_RESET_ACC_LATE), NOP,				\
+		 NOP, NOP, NOP)
+
+#define ACC_DEVICE_HUB_TRANSITIONS								\
+	POGO_ROW(NOP, NOP,									\
+		 NOP, TO_ACT(ACC_HUB, ACT_TOGGLE_HUB_MUX | ACT_DATA_INACTIVE), NOP, NOP,	\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, TO_ACT(DEVICE_HUB, ACT_RESET_ACC),				\
+		 NOP, NOP, NOP,									\
+		 TO(ACC_AUDIO_HUB), ACT(ACT_POLARITY),						\
+		 TO_ACT(LC_DEVICE_DIRECT, ACT_USBC | ACT_RESET_ACC_LATE), NOP,			\
+		 NOP, NOP, NOP)
+
+#define ACC_HUB_TRANSITIONS									\
+	POGO_ROW(NOP, NOP,									\
+		 TO_ACT(ACC_DEVICE_HUB, ACT_DATA_ACTIVE), NOP,					\
+		 TO_ACT(ACC_HUB_HOST_OFFLINE, ACT_DATA_ACTIVE), NOP,				\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, TO_ACT(STANDBY, ACT_RESET_ACC | ACT_USBC),			\
+		 NOP, NOP, NOP,									\
+		 NOP, ACT(ACT_POLARITY),							\
+		 TO_ACT(LC, ACT_USBC | ACT_RESET_ACC_LATE), NOP,				\
+		 NOP, NOP, NOP)
+
+#define ACC_HUB_HOST_OFFLINE_TRANSITIONS							\
+	POGO_ROW(NOP, NOP,									\
+		 NOP, NOP, NOP, TO_ACT(ACC_HUB, ACT_DATA_INACTIVE),				\
+		 TO_ACT(HOST_DIRECT_ACC_OFFLINE, ACT_DATA_INACTIVE | ACT_USBC), NOP,		\
+		 NOP, NOP, NOP,									\
+		 TO_ACT(HOST_DIRECT, ACT_RESET_ACC | ACT_DATA_INACTIVE | ACT_USBC),		\
+		 NOP, NOP, NOP,									\
+		 NOP, NOP,									\
+		 TO_ACT(LC_ALL_OFFLINE, ACT_POGO | ACT_RESET_ACC_LATE), NOP,			\
+		 NOP, NOP, NOP)
+
+#define ACC_AUDIO_HUB_TRANSITIONS								\
+	POGO_ROW(NOP, NOP,									\
+		 NOP, TO_ACT(ACC_HUB, ACT_TOGGLE_HUB_MUX | ACT_DATA_INACTIVE), NOP, NOP,	\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, TO_ACT(AUDIO_HUB, ACT_RESET_ACC),				\
+		 NOP, NOP, NOP,									\
+		 NOP, ACT(ACT_POLARITY),							\
+		 TO_ACT(LC_AUDIO_DIRECT, ACT_USBC | ACT_RESET_ACC_LATE), NOP,			\
+		 NOP, NOP, NOP)
+
+#define LC_TRANSITIONS										\
+	POGO_ROW(NOP, NOP,									\
+		 TO_ACT(LC_DEVICE_DIRECT, ACT_DATA_ACTIVE), NOP,				\
+		 TO_ACT(LC_HOST_DIRECT, ACT_DATA_ACTIVE), NOP,					\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP, NOP,									\
+		 NOP, NOP,									\
+		 NOP, TO_ACT(ACC_DIRECT, ACT_SKIP_ACC | ACT_POGO | ACT_UNLESS_MFG),		\
+		 NOP, NOP, NOP)
+
+#define LC_DEVICE_DIRECT_TRANSITIONS								\
+	POGO_ROW(NOP, NOP,									\
+		 NOP, TO_ACT(LC, ACT_DATA_INACTIVE), NOP, NOP,					\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP, NOP,									\
+		 TO(LC_AUDIO_DIRECT), NOP,							\
+		 NOP,										\
+		 TO_ACT(ACC_DEVICE_HUB,								\
+			ACT_SKIP_ACC | ACT_HUB | ACT_DATA_ACTIVE | ACT_UNLESS_MFG),		\
+		 NOP, NOP, NOP)
+
+#define LC_AUDIO_DIRECT_TRANSITIONS								\
+	POGO_ROW(NOP, NOP,									\
+		 NOP, TO_ACT(LC, ACT_DATA_INACTIVE), NOP, NOP,					\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP, NOP,									\
+		 NOP, NOP,									\
+		 NOP,										\
+		 TO_ACT(ACC_AUDIO_HUB,								\
+			ACT_SKIP_ACC | ACT_HUB | ACT_DATA_ACTIVE | ACT_UNLESS_MFG),		\
+		 NOP, NOP, NOP)
+
+#define LC_ALL_OFFLINE_TRANSITIONS								\
+	POGO_ROW(NOP, NOP,									\
+		 NOP, NOP, NOP, TO_ACT(LC, ACT_DATA_INACTIVE),					\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP, NOP,									\
+		 NOP, NOP,									\
+		 NOP, TO_ACT(ACC_DIRECT_HOST_OFFLINE, ACT_SKIP_ACC),				\
+		 NOP, NOP, NOP)
+
+#define LC_HOST_DIRECT_TRANSITIONS								\
+	POGO_ROW(NOP, NOP,									\
+		 NOP, NOP, NOP, TO_ACT(LC, ACT_DATA_INACTIVE),					\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, NOP,								\
+		 NOP, NOP, NOP,									\
+		 NOP, NOP,									\
+		 NOP,										\
+		 TO_ACT(HOST_DIRECT_ACC_OFFLINE,						\
+			ACT_SKIP_ACC | ACT_POGO | ACT_DATA_ACTIVE | ACT_UNLESS_MFG),		\
+		 NOP, NOP, NOP)
+
+#define HOST_DIRECT_ACC_OFFLINE_TRANSITIONS							\
+	POGO_ROW(NOP, NOP,									\
+		 NOP, NOP, NOP, TO_ACT(ACC_DIRECT, ACT_POGO),					\
+		 NOP, NOP,									\
+		 NOP, NOP, NOP, TO_ACT(HOST_DIRECT, ACT_RESET_ACC),				\
+		 NOP, NOP, NOP,									\
+		 NOP, NOP,									\
+		 TO_ACT(LC_HOST_DIRECT, ACT_RESET_ACC_LATE), NOP,				\
+		 NOP, NOP, NOP)
+
+#define ACC_DIRECT_HOST_OFFLINE_TRANSITIONS							\
+	POGO_ROW(NOP, NOP,									\
+		 NOP, NOP, NOP, TO_ACT(ACC_DIRECT, ACT_DATA_INACTIVE),				\
+		 TO_ACT(HOST_DIRECT_ACC_OFFLINE, ACT_DATA_INACTIVE | ACT_USBC), NOP,		\
+		 NOP, NOP, NOP,									\
+		 TO_ACT(HOST_DIRECT, ACT_RESET_ACC | ACT_DATA_INACTIVE | ACT_USBC),		\
+		 NOP, NOP, NOP,									\
+		 NOP, NOP,									\
+		 TO_ACT(LC_ALL_OFFLINE, ACT_POGO | ACT_RESET_ACC_LATE), NOP,			\
+		 NOP, NOP, NOP)
+
+#define GENERATE_TRANSITIONS(s)	[s] = s##_TRANSITIONS
+
+static const struct pogo_transition pogo_transitions[][NR_POGO_INPUTS] = {
+	FOREACH_STATE(GENERATE_TRANSITIONS)
+};
+
+#undef NOP
+#undef TO
+#undef TO_ACT
+#undef TO_DELAYED
+#undef ACT
+
+static inline const struct pogo_transition *pogo_transition_get(enum pogo_state state,
+								enum pogo_input input)
+{
+	return &pogo_transitions[state][input];
+}
+
+/* Data paths of ACT_USBC, ACT_POGO and ACT_HUB */
+enum pogo_data_path {
+	PATH_USBC,
+	PATH_POGO,
+	PATH_HUB,
+};
+
+struct pogo_sm;
+
+/*
+ * Hardware side of the State Machine. pogo_transport.c implements it on the GPIOs, regulators,
+ * votables and extcon of the board; the test and the simulator on the fake board of
+ * pogo_transport_sm_fake.h. Called with (max77759_plat)->data_path_lock held in the driver.
+ */
+struct pogo_sm_ops {
+	/* Inputs sampled by the core */
+	bool (*docked)(struct pogo_sm *sm);
+	bool (*force_pogo)(struct pogo_sm *sm);
+	bool (*mfg_acc_test)(struct pogo_sm *sm);
+	/* Debounce of @delay in ms, 0 to move right away */
+	unsigned int (*delay_ms)(struct pogo_sm *sm, enum pogo_delay delay);
+	/* Return true, with pogo_sm_run() re-armed, if delayed_state is still debouncing */
+	bool (*debounce_pending)(struct pogo_sm *sm);
+	/* Call pogo_sm_run() in @delay_ms */
+	void (*schedule)(struct pogo_sm *sm, unsigned int delay_ms);
+
+	/* Bookkeeping: @input was looked up, and the state moved or delayed_state was armed */
+	void (*dispatched)(struct pogo_sm *sm, enum pogo_input input,
+			   const struct pogo_transition *t);
+	void (*state_changed)(struct pogo_sm *sm, unsigned int delay_ms, bool debounced);
+
+	/* Side effects of the ACT_* bits, called in the order listed there */
+	void (*toggle_hub_mux)(struct pogo_sm *sm);
+	void (*skip_acc_detection)(struct pogo_sm *sm);
+	void (*enable_acc_detection)(struct pogo_sm *sm);
+	void (*acc_debounced)(struct pogo_sm *sm);
+	void (*acc_ldo_off)(struct pogo_sm *sm);
+	void (*reset_acc_detection)(struct pogo_sm *sm);
+	void (*set_data_active)(struct pogo_sm *sm, bool active);
+	void (*switch_path)(struct pogo_sm *sm, enum pogo_data_path path);
+	void (*update_polarity)(struct pogo_sm *sm);
+	void (*dock)(struct pogo_sm *sm);
+};
+
+struct pogo_sm {
+	const struct pogo_sm_ops *ops;
+	enum pogo_state state;
+	enum pogo_state prev_state;
+	/* Entered by pogo_sm_run() once delayed_line has been stable for delay_ms */
+	enum pogo_state delayed_state;
+	enum pogo_delay delayed_line;
+	unsigned int delay_ms;
+	/* When true, pogo_sm_run() enters the states moved to without being scheduled */
+	bool running;
+};
+
+/* Execute @actions of a transition. See ACT_* for the order. */
+static inline void pogo_sm_run_actions(struct pogo_sm *sm, unsigned int actions)
+{
+	const struct pogo_sm_ops *ops = sm->ops;
+
+	if (actions & ACT_TOGGLE_HUB_MUX)
+		ops->toggle_hub_mux(sm);
+
+	if (actions & ACT_SKIP_ACC)
+		ops->skip_acc_detection(sm);
+
+	if (actions & ACT_ACC_DETECT)
+		ops->enable_acc_detection(sm);
+
+	if (actions & ACT_ACC_VOUT)
+		ops->acc_debounced(sm);
+
+	if (actions & ACT_ACC_LDO_OFF)
+		ops->acc_ldo_off(sm);
+
+	if (actions & ACT_RESET_ACC)
+		ops->reset_acc_detection(sm);
+
+	if (actions & ACT_DATA_INACTIVE)
+		ops->set_data_active(sm, false);
+
+	if (!(actions & ACT_UNLESS_MFG) || !ops->mfg_acc_test(sm)) {
+		if (actions & ACT_USBC)
+			ops->switch_path(sm, PATH_USBC);
+		else if (actions & ACT_POGO)
+			ops->switch_path(sm, PATH_POGO);
+		else if (actions & ACT_HUB)
+			ops->switch_path(sm, PATH_HUB);
+
+		if (actions & ACT_DATA_ACTIVE)
+			ops->set_data_active(sm, true);
+	}
+
+	if (actions & ACT_RESET_ACC_LATE)
+		ops->reset_acc_detection(sm);
+
+	if (actions & ACT_POLARITY)
+		ops->update_polarity(sm);
+
+	if (actions & ACT_DOCK)
+		ops->dock(sm);
+}
+
+/* Move to @state, or arm delayed_state to move there in @delay_ms */
+static inline void pogo_sm_set_state(struct pogo_sm *sm, enum pogo_state state,
+				     unsigned int delay_ms)
+{
+	if (delay_ms) {
+		sm->delayed_state = state;
+		sm->delay_ms = delay_ms;
+		sm->ops->state_changed(sm, delay_ms, false);
+		sm->ops->schedule(sm, delay_ms);
+		return;
+	}
+
+	sm->delayed_state = INVALID_STATE;
+	sm->delayed_line = DELAY_NONE;
+	sm->prev_state = sm->state;
+	sm->state = state;
+	sm->ops->state_changed(sm, 0, false);
+
+	if (!sm->running)
+		sm->ops->schedule(sm, 0);
+}
+
+/* Feed @input to the State Machine: run the actions and move to the next state */
+static inline void pogo_sm_dispatch(struct pogo_sm *sm, enum pogo_input input)
+{
+	const struct pogo_transition *t = pogo_transition_get(sm->state, input);
+	unsigned int delay_ms;
+
+	sm->ops->dispatched(sm, input, t);
+
+	if (t->next == INVALID_STATE && !t->actions)
+		return;
+
+	/*
+	 * A standby edge of the pogo line being debounced only re-enters the current state, which
+	 * would drop the pending timer for the next active edge to arm it again. Keep the timer;
+	 * debounce_pending() checks the level the line settled on when it fires.
+	 */
+	if (input == INPUT_POGO_STANDBY && sm->delayed_line == DELAY_POGO &&
+	    t->next == sm->state && !t->actions && t->delay == DELAY_NONE)
+		return;
+
+	pogo_sm_run_actions(sm, t->actions);
+
+	if (t->next == INVALID_STATE)
+		return;
+
+	delay_ms = sm->ops->delay_ms(sm, t->delay);
+
+	/*
+	 * A bouncing line re-enters the same debounced state on every edge. Leave the pending
+	 * timer alone instead of re-arming it; debounce_pending() checks the edge timestamps when
+	 * it fires.
+	 */
+	if (delay_ms && sm->delayed_state == t->next && sm->delayed_line == t->delay) {
+		sm->delay_ms = delay_ms;
+		return;
+	}
+
+	sm->delayed_line = delay_ms ? t->delay : DELAY_NONE;
+	pogo_sm_set_state(sm, t->next, delay_ms);
+}
+
+/* The actions upon entering each state */
+static inline void pogo_sm_enter(struct pogo_sm *sm)
+{
+	if (!sm->ops->docked(sm))
+		pogo_sm_dispatch(sm, INPUT_ENTER);
+	else if (sm->ops->force_pogo(sm))
+		pogo_sm_dispatch(sm, INPUT_ENTER_DOCKED_FP);
+	else
+		pogo_sm_dispatch(sm, INPUT_ENTER_DOCKED);
+}
+
+/*
+ * Main loop of the State Machine: land delayed_state, then enter states until the State Machine
+ * settles or arms another delayed_state. Return false if delayed_state is still debouncing.
+ */
+static inline bool pogo_sm_run(struct pogo_sm *sm)
+{
+	enum pogo_state prev_state;
+
+	if (sm->delayed_state && sm->ops->debounce_pending(sm))
+		return false;
+
+	sm->running = true;
+
+	if (sm->delayed_state) {
+		sm->prev_state = sm->state;
+		sm->state = sm->delayed_state;
+		sm->delayed_state = INVALID_STATE;
+		sm->delayed_line = DELAY_NONE;
+		sm->ops->state_changed(sm, sm->delay_ms, true);
+	}
+
+	do {
+		prev_state = sm->state;
+		pogo_sm_enter(sm);
+	} while (sm->state != prev_state && !sm->delayed_state);
+
+	sm->running = false;
+
+	return true;
+}
+
+#endif /* __POGO_TRANSPORT_SM_H__ */
@@ -0,0 +1,418 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (C) 2023, Google LLC
+ *
+ * Pogo management driver: a fake board for the State Machine core of pogo_transport_sm.h.
+ *
+ * struct pogo_sm_ops is implemented on plain fields. The pogo and accessory lines are levels set by
+ * the caller, the GPIOs, regulators, the VOUT vote, the IRQ enables and the extcon cables are
+ * outputs written the way pogo_transport.c drives them, and time only moves in
+ * pogo_fake_advance(). Every write is counted so that a sequence can be checked for its side
+ * effects as well as for the states it goes through. Used by the KUnit test and by pogo_sm_sim.c.
+ */
+
+#ifndef __POGO_TRANSPORT_SM_FAKE_H__
+#define __POGO_TRANSPORT_SM_FAKE_H__
+
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/string.h>
+#else
+#include <stddef.h>
+#include <string.h>
+#ifndef container_of
+#define container_of(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+#endif
+#endif
+
+#include "pogo_transport_sm.h"
+
+/* run_at_ms when no pogo_sm_run() is pending */
+#define POGO_FAKE_IDLE		(~0ULL)
+
+/* Debounce of the lines until the caller sets its own, as in pogo_transport.c */
+#define POGO_FAKE_POGO_DEBOUNCE_MS	2000
+#define POGO_FAKE_ACC_DEBOUNCE_MS	10
+
+struct pogo_fake_counters {
+	unsigned int gpio_writes;
+	unsigned int regulator_toggles;
+	unsigned int votes;
+	unsigned int irq_toggles;
+	unsigned int extcon_changes;
+	unsigned int path_switches;
+	unsigned int polarity_updates;
+	unsigned int dispatches;
+	unsigned int transitions;
+	unsigned int runs;
+};
+
+struct pogo_fake_board {
+	struct pogo_sm sm;
+
+	/* Inputs: levels of the lines, true when active */
+	bool pogo_active;
+	bool acc_active;
+	bool force_pogo;
+	bool mfg_acc_test;
+	/* A superspeed device is enumerated behind the hub, see ACT_TOGGLE_HUB_MUX */
+	bool ss_udev_attached;
+	unsigned int pogo_debounce_ms;
+	unsigned int acc_debounce_ms;
+
+	/* Time in ms, the last edge of each line and the pending pogo_sm_run() */
+	unsigned long long now_ms;
+	unsigned long long pogo_edge_ms;
+	unsigned long long acc_edge_ms;
+	unsigned long long run_at_ms;
+
+	/* Outputs */
+	bool data_mux;		/* USB_MUX_POGO_SEL, 1 for pogo */
+	bool hub_sel;		/* USB_MUX_HUB_SEL, 1 for the hub */
+	bool hub_ldo;
+	bool acc_ldo;
+	bool vout;		/* GBMS_POGO_VOUT vote */
+	bool ovp_off;		/* OVP disabled ahead of POGO_VIN */
+	bool pogo_irq;
+	bool acc_irq;
+	bool host;		/* EXTCON_USB_HOST of the pogo or hub path */
+	bool data_active;
+	bool usb;		/* EXTCON_USB of the dock */
+	bool dock;		/* EXTCON_DOCK */
+
+	/* States entered since the last input of the caller, and the longest such chain */
+	unsigned int path_len;
+	unsigned int max_path_len;
+	struct pogo_fake_counters count;
+};
+
+static inline struct pogo_fake_board *pogo_fake_from_sm(struct pogo_sm *sm)
+{
+	return container_of(sm, struct pogo_fake_board, sm);
+}
+
+static inline void pogo_fake_gpio(struct pogo_fake_board *board, bool *gpio, bool value)
+{
+	*gpio = value;
+	board->count.gpio_writes++;
+}
+
+/* Regulators, IRQs and extcon cables only count when they change, as in pogo_transport.c */
+static inline void pogo_fake_regulator(struct pogo_fake_board *board, bool *ldo, bool enable)
+{
+	if (*ldo == enable)
+		return;
+
+	*ldo = enable;
+	board->count.regulator_toggles++;
+}
+
+static inline void pogo_fake_irq(struct pogo_fake_board *board, bool *irq, bool enable)
+{
+	if (*irq == enable)
+		return;
+
+	*irq = enable;
+	board->count.irq_toggles++;
+}
+
+static inline void pogo_fake_extcon(struct pogo_fake_board *board, bool *cable, bool state)
+{
+	if (*cable == state)
+		return;
+
+	*cable = state;
+	board->count.extcon_changes++;
+}
+
+static inline void pogo_fake_vote(struct pogo_fake_board *board, bool vout)
+{
+	board->vout = vout;
+	board->count.votes++;
+}
+
+static inline bool pogo_fake_docked(struct pogo_sm *sm)
+{
+	return pogo_fake_from_sm(sm)->pogo_active;
+}
+
+static inline bool pogo_fake_force_pogo(struct pogo_sm *sm)
+{
+	return pogo_fake_from_sm(sm)->force_pogo;
+}
+
+static inline bool pogo_fake_mfg_acc_test(struct pogo_sm *sm)
+{
+	return pogo_fake_from_sm(sm)->mfg_acc_test;
+}
+
+static inline unsigned int pogo_fake_delay_ms(struct pogo_sm *sm, enum pogo_delay delay)
+{
+	struct pogo_fake_board *board = pogo_fake_from_sm(sm);
+
+	switch (delay) {
+	case DELAY_POGO:
+		return board->pogo_debounce_ms;
+	case DELAY_ACC:
+		return board->acc_debounce_ms;
+	default:
+		return 0;
+	}
+}
+
+/* pogo_transport_debounce_pending() on the edge timestamps of the fake lines */
+static inline bool pogo_fake_debounce_pending(struct pogo_sm *sm)
+{
+	struct pogo_fake_board *board = pogo_fake_from_sm(sm);
+	unsigned long long deadline_ms;
+
+	switch (sm->delayed_line) {
+	case DELAY_POGO:
+		deadline_ms = board->pogo_edge_ms + sm->delay_ms;
+		break;
+	case DELAY_ACC:
+		deadline_ms = board->acc_edge_ms + sm->delay_ms;
+		break;
+	default:
+		return false;
+	}
+
+	if (board->now_ms >= deadline_ms) {
+		if (sm->delayed_line == DELAY_POGO && !board->pogo_active) {
+			sm->delayed_state = INVALID_STATE;
+			sm->delayed_line = DELAY_NONE;
+		}
+		return false;
+	}
+
+	board->run_at_ms = deadline_ms;
+	return true;
+}
+
+static inline void pogo_fake_schedule(struct pogo_sm *sm, unsigned int delay_ms)
+{
+	struct pogo_fake_board *board = pogo_fake_from_sm(sm);
+
+	board->run_at_ms = board->now_ms + delay_ms;
+}
+
+static inline void pogo_fake_dispatched(struct pogo_sm *sm, enum pogo_input input,
+					const struct pogo_transition *t)
+{
+	pogo_fake_from_sm(sm)->count.dispatches++;
+}
+
+static inline void pogo_fake_state_changed(struct pogo_sm *sm, unsigned int delay_ms,
+					   bool debounced)
+{
+	struct pogo_fake_board *board = pogo_fake_from_sm(sm);
+
+	if (delay_ms && !debounced)
+		return;
+
+	board->count.transitions++;
+	if (++board->path_len > board->max_path_len)
+		board->max_path_len = board->path_len;
+}
+
+static inline void pogo_fake_toggle_hub_mux(struct pogo_sm *sm)
+{
+	struct pogo_fake_board *board = pogo_fake_from_sm(sm);
+
+	if (!board->ss_udev_attached)
+		return;
+
+	pogo_fake_gpio(board, &board->hub_sel, false);
+	pogo_fake_gpio(board, &board->hub_sel, true);
+}
+
+static inline void pogo_fake_skip_acc_detection(struct pogo_sm *sm)
+{
+	struct pogo_fake_board *board = pogo_fake_from_sm(sm);
+
+	pogo_fake_gpio(board, &board->ovp_off, true);
+	pogo_fake_irq(board, &board->acc_irq, false);
+	pogo_fake_irq(board, &board->pogo_irq, false);
+	pogo_fake_vote(board, true);
+}
+
+static inline void pogo_fake_enable_acc_detection(struct pogo_sm *sm)
+{
+	struct pogo_fake_board *board = pogo_fake_from_sm(sm);
+
+	pogo_fake_gpio(board, &board->ovp_off, true);
+	pogo_fake_irq(board, &board->acc_irq, true);
+	pogo_fake_regulator(board, &board->acc_ldo, true);
+}
+
+static inline void pogo_fake_acc_debounced(struct pogo_sm *sm)
+{
+	struct pogo_fake_board *board = pogo_fake_from_sm(sm);
+
+	/* debounce fail; leave the IRQ and regulator enabled */
+	if (!board->acc_active)
+		return;
+
+	pogo_fake_irq(board, &board->acc_irq, false);
+	pogo_fake_vote(board, true);
+}
+
+static inline void pogo_fake_acc_ldo_off(struct pogo_sm *sm)
+{
+	struct pogo_fake_board *board = pogo_fake_from_sm(sm);
+
+	pogo_fake_regulator(board, &board->acc_ldo, false);
+}
+
+static inline void pogo_fake_reset_acc_detection(struct pogo_sm *sm)
+{
+	struct pogo_fake_board *board = pogo_fake_from_sm(sm);
+
+	pogo_fake_vote(board, false);
+	pogo_fake_regulator(board, &board->acc_ldo, false);
+	pogo_fake_irq(board, &board->acc_irq, false);
+	pogo_fake_irq(board, &board->pogo_irq, true);
+}
+
+static inline void pogo_fake_set_data_active(struct pogo_sm *sm, bool active)
+{
+	pogo_fake_from_sm(sm)->data_active = active;
+}
+
+/* disable_and_bypass_hub() */
+static inline void pogo_fake_bypass_hub(struct pogo_fake_board *board)
+{
+	pogo_fake_gpio(board, &board->hub_sel, false);
+	pogo_fake_regulator(board, &board->hub_ldo, false);
+}
+
+/* switch_to_{usbc,pogo,hub}_locked(); the hub host is turned on without the off-wait */
+static inline void pogo_fake_switch_path(struct pogo_sm *sm, enum pogo_data_path path)
+{
+	struct pogo_fake_board *board = pogo_fake_from_sm(sm);
+
+	board->count.path_switches++;
+
+	switch (path) {
+	case PATH_USBC:
+		pogo_fake_extcon(board, &board->host, false);
+		pogo_fake_bypass_hub(board);
+		pogo_fake_gpio(board, &board->data_mux, false);
+		break;
+	case PATH_POGO:
+		board->data_active = false;
+		pogo_fake_bypass_hub(board);
+		pogo_fake_gpio(board, &board->data_mux, true);
+		pogo_fake_extcon(board, &board->host, true);
+		break;
+	case PATH_HUB:
+		board->data_active = false;
+		pogo_fake_regulator(board, &board->hub_ldo, true);
+		pogo_fake_gpio(board, &board->data_mux, false);
+		pogo_fake_gpio(board, &board->hub_sel, true);
+		pogo_fake_extcon(board, &board->host, true);
+		break;
+	}
+}
+
+static inline void pogo_fake_update_polarity(struct pogo_sm *sm)
+{
+	pogo_fake_from_sm(sm)->count.polarity_updates++;
+}
+
+static inline void pogo_fake_dock(struct pogo_sm *sm)
+{
+	struct pogo_fake_board *board = pogo_fake_from_sm(sm);
+
+	pogo_fake_extcon(board, &board->usb, true);
+	pogo_fake_extcon(board, &board->dock, true);
+}
+
+static const struct pogo_sm_ops pogo_fake_ops = {
+	.docked = pogo_fake_docked,
+	.force_pogo = pogo_fake_force_pogo,
+	.mfg_acc_test = pogo_fake_mfg_acc_test,
+	.delay_ms = pogo_fake_delay_ms,
+	.debounce_pending = pogo_fake_debounce_pending,
+	.schedule = pogo_fake_schedule,
+	.dispatched = pogo_fake_dispatched,
+	.state_changed = pogo_fake_state_changed,
+	.toggle_hub_mux = pogo_fake_toggle_hub_mux,
+	.skip_acc_detection = pogo_fake_skip_acc_detection,
+	.enable_acc_detection = pogo_fake_enable_acc_detection,
+	.acc_debounced = pogo_fake_acc_debounced,
+	.acc_ldo_off = pogo_fake_acc_ldo_off,
+	.reset_acc_detection = pogo_fake_reset_acc_detection,
+	.set_data_active = pogo_fake_set_data_active,
+	.switch_path = pogo_fake_switch_path,
+	.update_polarity = pogo_fake_update_polarity,
+	.dock = pogo_fake_dock,
+};
+
+/* Move time forward by @ms, running pogo_sm_run() whenever it is due */
+static inline void pogo_fake_advance(struct pogo_fake_board *board, unsigned int ms)
+{
+	unsigned long long until_ms = board->now_ms + ms;
+
+	while (board->run_at_ms <= until_ms) {
+		board->now_ms = board->run_at_ms;
+		board->run_at_ms = POGO_FAKE_IDLE;
+		board->count.runs++;
+		pogo_sm_run(&board->sm);
+	}
+
+	board->now_ms = until_ms;
+}
+
+/* Power up in STANDBY with the pogo IRQ enabled, as probe leaves the board */
+static inline void pogo_fake_init(struct pogo_fake_board *board)
+{
+	memset(board, 0, sizeof(*board));
+	board->sm.ops = &pogo_fake_ops;
+	board->pogo_debounce_ms = POGO_FAKE_POGO_DEBOUNCE_MS;
+	board->acc_debounce_ms = POGO_FAKE_ACC_DEBOUNCE_MS;
+	board->pogo_irq = true;
+	board->run_at_ms = POGO_FAKE_IDLE;
+	pogo_sm_set_state(&board->sm, STANDBY, 0);
+	pogo_fake_advance(board, 0);
+	board->path_len = 0;
+	board->max_path_len = 0;
+	memset(&board->count, 0, sizeof(board->count));
+}
+
+/* An event of the driver feeds @input; the State Machine then runs on the same worker */
+static inline void pogo_fake_dispatch(struct pogo_fake_board *board, enum pogo_input input)
+{
+	board->path_len = 0;
+	pogo_sm_dispatch(&board->sm, input);
+	pogo_fake_advance(board, 0);
+}
+
+/*
+ * Edge of the pogo line. As EVENT_POGO_IRQ, it is lost while the IRQ is disabled and a standby
+ * edge drops the dock notification before the State Machine sees it.
+ */
+static inline void pogo_fake_pogo_edge(struct pogo_fake_board *board, bool active)
+{
+	board->pogo_active = active;
+	board->pogo_edge_ms = board->now_ms;
+	if (!board->pogo_irq)
+		return;
+
+	if (!active) {
+		pogo_fake_extcon(board, &board->usb, false);
+		pogo_fake_extcon(board, &board->dock, false);
+	}
+	pogo_fake_dispatch(board, active ? INPUT_POGO_ACTIVE : INPUT_POGO_STANDBY);
+}
+
+/* Edge of the accessory line. As EVENT_ACC_GPIO_ACTIVE with H1S attached, only active edges act */
+static inline void pogo_fake_acc_edge(struct pogo_fake_board *board, bool active)
+{
+	board->acc_active = active;
+	board->acc_edge_ms = board->now_ms;
+	if (board->acc_irq && active)
+		pogo_fake_dispatch(board, INPUT_ACC_DEBOUNCING);
+}
+
+#endif /* __POGO_TRANSPORT_SM_FAKE_H__ */
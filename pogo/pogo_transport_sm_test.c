@@ -0,0 +1,485 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright (C) 2023, Google LLC
+ *
+ * KUnit tests for the State Machine of the Pogo management driver
+ *
+ * The State Machine core of pogo_transport_sm.h, the same pogo_sm_dispatch() and pogo_sm_run() the
+ * driver calls, runs on the fake board of pogo_transport_sm_fake.h. The cases check the states and
+ * the GPIO, regulator, VOUT vote, IRQ and extcon outputs after each step, and when the debounce
+ * timers fire. The power_supply handles of the driver are not reached from the State Machine.
+ */
+
+#include <kunit/test.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+
+#include "pogo_transport_sm_fake.h"
+
+/* Longest chain of states one input may go through, a debounce that lands included */
+#define POGO_SM_MAX_PATH		2U
+/* Average budget of one pogo_sm_dispatch() with the State Machine run that follows it */
+#define POGO_SM_DISPATCH_BUDGET_NS	10000
+#define POGO_SM_BUDGET_CYCLES		1000
+
+/* The enums are compared as int to please __typecheck() */
+#define EXPECT_STATE(test, state, expected)						\
+	KUNIT_EXPECT_EQ_MSG(test, (int)(state), (int)(expected), "%s, expected %s",	\
+			    pogo_states[state], pogo_states[expected])
+
+/* USB_MUX_POGO_SEL, USB_MUX_HUB_SEL, hub_ldo and the host cable of @path */
+static void pogo_sm_expect_path(struct kunit *test, const struct pogo_fake_board *board,
+				enum pogo_data_path path)
+{
+	KUNIT_EXPECT_EQ(test, (int)board->data_mux, (int)(path == PATH_POGO));
+	KUNIT_EXPECT_EQ(test, (int)board->hub_sel, (int)(path == PATH_HUB));
+	KUNIT_EXPECT_EQ(test, (int)board->hub_ldo, (int)(path == PATH_HUB));
+	KUNIT_EXPECT_EQ(test, (int)board->host, (int)(path != PATH_USBC));
+}
+
+/* Drive @board from STANDBY to ACC_DIRECT through the accessory detection */
+static void pogo_sm_attach_acc(struct kunit *test, struct pogo_fake_board *board)
+{
+	unsigned long long edge_ms;
+
+	pogo_fake_dispatch(board, INPUT_HES_ATTACH);
+	EXPECT_STATE(test, board->sm.state, STANDBY);
+	KUNIT_EXPECT_TRUE(test, board->ovp_off);
+	KUNIT_EXPECT_TRUE(test, board->acc_irq);
+	KUNIT_EXPECT_TRUE(test, board->acc_ldo);
+	KUNIT_EXPECT_FALSE(test, board->vout);
+
+	edge_ms = board->now_ms;
+	pogo_fake_acc_edge(board, true);
+	EXPECT_STATE(test, board->sm.state, STANDBY);
+	EXPECT_STATE(test, board->sm.delayed_state, STANDBY_ACC_DEBOUNCED);
+	KUNIT_EXPECT_EQ(test, (int)board->sm.delayed_line, (int)DELAY_ACC);
+	KUNIT_EXPECT_EQ(test, board->run_at_ms, edge_ms + board->acc_debounce_ms);
+
+	pogo_fake_advance(board, board->acc_debounce_ms);
+	EXPECT_STATE(test, board->sm.state, STANDBY_ACC_DEBOUNCED);
+	KUNIT_EXPECT_TRUE(test, board->vout);
+	KUNIT_EXPECT_FALSE(test, board->acc_irq);
+
+	pogo_fake_dispatch(board, INPUT_ACC_CONNECTED);
+	EXPECT_STATE(test, board->sm.state, ACC_DIRECT);
+	KUNIT_EXPECT_FALSE(test, board->acc_ldo);
+	KUNIT_EXPECT_TRUE(test, board->vout);
+	pogo_sm_expect_path(test, board, PATH_POGO);
+}
+
+static void pogo_sm_dock_undock(struct kunit *test)
+{
+	struct pogo_fake_board board;
+
+	pogo_fake_init(&board);
+	pogo_sm_expect_path(test, &board, PATH_USBC);
+
+	pogo_fake_pogo_edge(&board, true);
+	EXPECT_STATE(test, board.sm.state, STANDBY);
+	EXPECT_STATE(test, board.sm.delayed_state, DOCKING_DEBOUNCED);
+	KUNIT_EXPECT_EQ(test, (int)board.sm.delayed_line, (int)DELAY_POGO);
+	KUNIT_EXPECT_EQ(test, board.count.path_switches, 0U);
+
+	/* Nothing moves until the debounce has run its full course */
+	pogo_fake_advance(&board, board.pogo_debounce_ms - 1);
+	EXPECT_STATE(test, board.sm.state, STANDBY);
+	KUNIT_EXPECT_EQ(test, board.count.gpio_writes, 0U);
+
+	pogo_fake_advance(&board, 1);
+	EXPECT_STATE(test, board.sm.state, DOCK_HUB);
+	pogo_sm_expect_path(test, &board, PATH_HUB);
+	KUNIT_EXPECT_TRUE(test, board.dock);
+	KUNIT_EXPECT_TRUE(test, board.usb);
+	KUNIT_EXPECT_EQ(test, board.run_at_ms, POGO_FAKE_IDLE);
+
+	pogo_fake_dispatch(&board, INPUT_USBC_ORIENTATION);
+	EXPECT_STATE(test, board.sm.state, DOCK_HUB);
+	KUNIT_EXPECT_EQ(test, board.count.polarity_updates, 1U);
+
+	pogo_fake_pogo_edge(&board, false);
+	EXPECT_STATE(test, board.sm.state, STANDBY);
+	EXPECT_STATE(test, board.sm.delayed_state, INVALID_STATE);
+	pogo_sm_expect_path(test, &board, PATH_USBC);
+	KUNIT_EXPECT_FALSE(test, board.dock);
+	KUNIT_EXPECT_FALSE(test, board.usb);
+	KUNIT_EXPECT_EQ(test, board.count.regulator_toggles, 2U);
+}
+
+/*
+ * A standby edge of the pogo line keeps the pending timer, and the line is found back in standby
+ * when it fires: the dock is dropped without touching the data path.
+ */
+static void pogo_sm_dock_bounce(struct kunit *test)
+{
+	struct pogo_fake_board board;
+	unsigned long long run_at_ms;
+
+	pogo_fake_init(&board);
+
+	pogo_fake_pogo_edge(&board, true);
+	run_at_ms = board.run_at_ms;
+	pogo_fake_advance(&board, 5);
+	pogo_fake_pogo_edge(&board, false);
+	EXPECT_STATE(test, board.sm.state, STANDBY);
+	EXPECT_STATE(test, board.sm.delayed_state, DOCKING_DEBOUNCED);
+	KUNIT_EXPECT_EQ(test, board.run_at_ms, run_at_ms);
+
+	pogo_fake_advance(&board, board.pogo_debounce_ms);
+	EXPECT_STATE(test, board.sm.state, STANDBY);
+	EXPECT_STATE(test, board.sm.delayed_state, INVALID_STATE);
+	KUNIT_EXPECT_EQ(test, board.count.path_switches, 0U);
+	KUNIT_EXPECT_EQ(test, board.count.gpio_writes, 0U);
+	KUNIT_EXPECT_EQ(test, board.count.regulator_toggles, 0U);
+}
+
+/*
+ * Every active edge of a bouncing pogo line re-enters the same debounced state. The timer is not
+ * re-armed by the edges; once it fires, it waits for the rest of the window from the last edge.
+ */
+static void pogo_sm_dock_rebounce(struct kunit *test)
+{
+	struct pogo_fake_board board;
+	unsigned int debounce_ms;
+
+	pogo_fake_init(&board);
+	debounce_ms = board.pogo_debounce_ms;
+
+	pogo_fake_pogo_edge(&board, true);
+	pogo_fake_advance(&board, 500);
+	pogo_fake_pogo_edge(&board, false);
+	pogo_fake_advance(&board, 100);
+	pogo_fake_pogo_edge(&board, true);
+	EXPECT_STATE(test, board.sm.delayed_state, DOCKING_DEBOUNCED);
+	KUNIT_EXPECT_EQ(test, board.run_at_ms, (unsigned long long)debounce_ms);
+
+	pogo_fake_advance(&board, debounce_ms - 600);
+	EXPECT_STATE(test, board.sm.state, STANDBY);
+	KUNIT_EXPECT_EQ(test, board.run_at_ms, 600ULL + debounce_ms);
+
+	pogo_fake_advance(&board, 599);
+	EXPECT_STATE(test, board.sm.state, STANDBY);
+	pogo_fake_advance(&board, 1);
+	EXPECT_STATE(test, board.sm.state, DOCK_HUB);
+	pogo_sm_expect_path(test, &board, PATH_HUB);
+	KUNIT_EXPECT_EQ(test, board.count.path_switches, 1U);
+}
+
+static void pogo_sm_dock_with_device(struct kunit *test)
+{
+	struct pogo_fake_board board;
+
+	pogo_fake_init(&board);
+
+	pogo_fake_dispatch(&board, INPUT_USBC_HOST_ON);
+	EXPECT_STATE(test, board.sm.state, DEVICE_DIRECT);
+	pogo_sm_expect_path(test, &board, PATH_USBC);
+
+	pogo_fake_pogo_edge(&board, true);
+	EXPECT_STATE(test, board.sm.delayed_state, DEVICE_DOCKING_DEBOUNCED);
+	pogo_fake_advance(&board, board.pogo_debounce_ms);
+	EXPECT_STATE(test, board.sm.state, DOCK_DEVICE_HUB);
+	pogo_sm_expect_path(test, &board, PATH_HUB);
+	/* The switch to the hub drops data_active, ACT_DATA_ACTIVE sets it back after */
+	KUNIT_EXPECT_TRUE(test, board.data_active);
+	KUNIT_EXPECT_TRUE(test, board.dock);
+
+	pogo_fake_pogo_edge(&board, false);
+	EXPECT_STATE(test, board.sm.state, DEVICE_HUB);
+	pogo_sm_expect_path(test, &board, PATH_HUB);
+	KUNIT_EXPECT_FALSE(test, board.dock);
+
+	pogo_fake_dispatch(&board, INPUT_USBC_HOST_OFF);
+	EXPECT_STATE(test, board.sm.state, STANDBY);
+	pogo_sm_expect_path(test, &board, PATH_USBC);
+}
+
+static void pogo_sm_h1s_on_off_on(struct kunit *test)
+{
+	struct pogo_fake_board board;
+
+	pogo_fake_init(&board);
+
+	pogo_sm_attach_acc(test, &board);
+
+	pogo_fake_dispatch(&board, INPUT_HES_DETACH);
+	pogo_fake_acc_edge(&board, false);
+	EXPECT_STATE(test, board.sm.state, STANDBY);
+	pogo_sm_expect_path(test, &board, PATH_USBC);
+	KUNIT_EXPECT_FALSE(test, board.vout);
+	KUNIT_EXPECT_FALSE(test, board.acc_ldo);
+	KUNIT_EXPECT_FALSE(test, board.acc_irq);
+	KUNIT_EXPECT_TRUE(test, board.pogo_irq);
+
+	pogo_sm_attach_acc(test, &board);
+}
+
+/* H1S goes away once the accessory has debounced but before it is connected */
+static void pogo_sm_h1s_detach_debouncing(struct kunit *test)
+{
+	struct pogo_fake_board board;
+
+	pogo_fake_init(&board);
+
+	pogo_fake_dispatch(&board, INPUT_HES_ATTACH);
+	pogo_fake_acc_edge(&board, true);
+	pogo_fake_advance(&board, board.acc_debounce_ms);
+	EXPECT_STATE(test, board.sm.state, STANDBY_ACC_DEBOUNCED);
+
+	pogo_fake_dispatch(&board, INPUT_HES_DETACH);
+	EXPECT_STATE(test, board.sm.state, STANDBY);
+	KUNIT_EXPECT_FALSE(test, board.vout);
+	KUNIT_EXPECT_FALSE(test, board.acc_ldo);
+	KUNIT_EXPECT_EQ(test, board.count.path_switches, 0U);
+}
+
+/* The accessory line drops during its debounce: VOUT is not voted and detection stays armed */
+static void pogo_sm_acc_debounce_fail(struct kunit *test)
+{
+	struct pogo_fake_board board;
+
+	pogo_fake_init(&board);
+
+	pogo_fake_dispatch(&board, INPUT_HES_ATTACH);
+	pogo_fake_acc_edge(&board, true);
+	pogo_fake_advance(&board, 4);
+	pogo_fake_acc_edge(&board, false);
+
+	pogo_fake_advance(&board, board.acc_debounce_ms - 4);
+	EXPECT_STATE(test, board.sm.state, STANDBY);
+	KUNIT_EXPECT_EQ(test, board.run_at_ms, 4ULL + board.acc_debounce_ms);
+
+	pogo_fake_advance(&board, 4);
+	EXPECT_STATE(test, board.sm.state, STANDBY_ACC_DEBOUNCED);
+	KUNIT_EXPECT_FALSE(test, board.vout);
+	KUNIT_EXPECT_TRUE(test, board.acc_irq);
+	KUNIT_EXPECT_TRUE(test, board.acc_ldo);
+	KUNIT_EXPECT_EQ(test, board.count.votes, 0U);
+}
+
+static void pogo_sm_lc_enter_exit(struct kunit *test)
+{
+	struct pogo_fake_board board;
+
+	pogo_fake_init(&board);
+	pogo_sm_attach_acc(test, &board);
+
+	pogo_fake_dispatch(&board, INPUT_LC);
+	EXPECT_STATE(test, board.sm.state, LC);
+	pogo_sm_expect_path(test, &board, PATH_USBC);
+	KUNIT_EXPECT_FALSE(test, board.vout);
+
+	pogo_fake_dispatch(&board, INPUT_USBC_HOST_ON);
+	EXPECT_STATE(test, board.sm.state, LC_DEVICE_DIRECT);
+	KUNIT_EXPECT_TRUE(test, board.data_active);
+
+	pogo_fake_dispatch(&board, INPUT_LC_CLEAR);
+	EXPECT_STATE(test, board.sm.state, ACC_DEVICE_HUB);
+	pogo_sm_expect_path(test, &board, PATH_HUB);
+	KUNIT_EXPECT_TRUE(test, board.vout);
+	KUNIT_EXPECT_TRUE(test, board.data_active);
+
+	pogo_fake_dispatch(&board, INPUT_LC);
+	EXPECT_STATE(test, board.sm.state, LC_DEVICE_DIRECT);
+	pogo_sm_expect_path(test, &board, PATH_USBC);
+	KUNIT_EXPECT_FALSE(test, board.vout);
+
+	pogo_fake_dispatch(&board, INPUT_USBC_HOST_OFF);
+	EXPECT_STATE(test, board.sm.state, LC);
+	pogo_fake_dispatch(&board, INPUT_LC_CLEAR);
+	EXPECT_STATE(test, board.sm.state, ACC_DIRECT);
+	pogo_sm_expect_path(test, &board, PATH_POGO);
+	KUNIT_EXPECT_TRUE(test, board.vout);
+	KUNIT_EXPECT_FALSE(test, board.data_active);
+}
+
+/* Return the GPIO writes of ACC_DEVICE_HUB -> ACC_HUB, the only transition toggling the hub mux */
+static unsigned int pogo_sm_host_off_behind_hub(struct kunit *test, bool ss_udev_attached)
+{
+	struct pogo_fake_board board;
+	unsigned int gpio_writes;
+
+	pogo_fake_init(&board);
+	pogo_sm_attach_acc(test, &board);
+	pogo_fake_dispatch(&board, INPUT_LC);
+	pogo_fake_dispatch(&board, INPUT_USBC_HOST_ON);
+	pogo_fake_dispatch(&board, INPUT_LC_CLEAR);
+	EXPECT_STATE(test, board.sm.state, ACC_DEVICE_HUB);
+
+	board.ss_udev_attached = ss_udev_attached;
+	gpio_writes = board.count.gpio_writes;
+	pogo_fake_dispatch(&board, INPUT_USBC_HOST_OFF);
+	EXPECT_STATE(test, board.sm.state, ACC_HUB);
+	pogo_sm_expect_path(test, &board, PATH_HUB);
+	KUNIT_EXPECT_FALSE(test, board.data_active);
+
+	return board.count.gpio_writes - gpio_writes;
+}
+
+/* The hub mux is only toggled, off and back on, if a superspeed device was behind the hub */
+static void pogo_sm_toggle_hub_mux(struct kunit *test)
+{
+	KUNIT_EXPECT_EQ(test, pogo_sm_host_off_behind_hub(test, false), 0U);
+	KUNIT_EXPECT_EQ(test, pogo_sm_host_off_behind_hub(test, true), 2U);
+}
+
+/* mfg_acc_test keeps the data path on USB-C when the accessory is attached */
+static void pogo_sm_mfg_acc_test(struct kunit *test)
+{
+	struct pogo_fake_board board;
+
+	pogo_fake_init(&board);
+
+	pogo_fake_dispatch(&board, INPUT_HES_ATTACH_HALL_ONLY);
+	EXPECT_STATE(test, board.sm.state, ACC_DIRECT);
+	pogo_sm_expect_path(test, &board, PATH_POGO);
+	pogo_fake_dispatch(&board, INPUT_HES_DETACH);
+	EXPECT_STATE(test, board.sm.state, STANDBY);
+	pogo_sm_expect_path(test, &board, PATH_USBC);
+
+	board.mfg_acc_test = true;
+	board.count.path_switches = 0;
+	pogo_fake_dispatch(&board, INPUT_HES_ATTACH_HALL_ONLY);
+	EXPECT_STATE(test, board.sm.state, ACC_DIRECT);
+	pogo_sm_expect_path(test, &board, PATH_USBC);
+	KUNIT_EXPECT_TRUE(test, board.vout);
+	KUNIT_EXPECT_EQ(test, board.count.path_switches, 0U);
+
+	pogo_fake_dispatch(&board, INPUT_LC);
+	EXPECT_STATE(test, board.sm.state, LC);
+	board.count.path_switches = 0;
+	pogo_fake_dispatch(&board, INPUT_LC_CLEAR);
+	EXPECT_STATE(test, board.sm.state, ACC_DIRECT);
+	pogo_sm_expect_path(test, &board, PATH_USBC);
+	KUNIT_EXPECT_EQ(test, board.count.path_switches, 0U);
+}
+
+/* Every input in every state, docked or not and with or without force_pogo, settles quickly */
+static void pogo_sm_path_length(struct kunit *test)
+{
+	struct pogo_fake_board board;
+	int state, input, levels;
+
+	for (state = STANDBY; state < ARRAY_SIZE(pogo_states); state++) {
+		for (input = 0; input < INPUT_ENTER; input++) {
+			/* BIT(0) docked, BIT(1) force_pogo */
+			for (levels = 0; levels < 4; levels++) {
+				pogo_fake_init(&board);
+				board.pogo_active = levels & BIT(0);
+				board.force_pogo = levels & BIT(1);
+				board.sm.state = state;
+
+				pogo_fake_dispatch(&board, input);
+				pogo_fake_advance(&board, board.pogo_debounce_ms);
+				KUNIT_EXPECT_LE_MSG(test, board.max_path_len, POGO_SM_MAX_PATH,
+						    "%s %s", pogo_states[state],
+						    pogo_inputs[input]);
+				KUNIT_EXPECT_EQ_MSG(test, board.run_at_ms, POGO_FAKE_IDLE,
+						    "%s %s", pogo_states[state],
+						    pogo_inputs[input]);
+			}
+		}
+	}
+}
+
+/* Dock and undock cycles stay within the budget of the event and State Machine handlers */
+static void pogo_sm_dispatch_budget(struct kunit *test)
+{
+	struct pogo_fake_board board;
+	unsigned int dispatches;
+	u64 start_ns, elapsed_ns;
+	int i;
+
+	pogo_fake_init(&board);
+	board.pogo_debounce_ms = 1;
+
+	start_ns = ktime_get_ns();
+	for (i = 0; i < POGO_SM_BUDGET_CYCLES; i++) {
+		pogo_fake_pogo_edge(&board, true);
+		pogo_fake_advance(&board, board.pogo_debounce_ms);
+		pogo_fake_dispatch(&board, INPUT_USBC_ORIENTATION);
+		pogo_fake_pogo_edge(&board, false);
+	}
+	elapsed_ns = ktime_get_ns() - start_ns;
+	dispatches = board.count.dispatches;
+
+	EXPECT_STATE(test, board.sm.state, STANDBY);
+	/* DOCKING_DEBOUNCED, DOCK_HUB and STANDBY on every cycle */
+	KUNIT_EXPECT_EQ(test, board.count.transitions, 3U * POGO_SM_BUDGET_CYCLES);
+	KUNIT_ASSERT_GT(test, dispatches, 0U);
+	KUNIT_EXPECT_LT(test, elapsed_ns, (u64)dispatches * POGO_SM_DISPATCH_BUDGET_NS);
+}
+
+/*
+ * Properties of the table the driver relies on:
+ *  - A delayed transition carries no actions, as they would run before the debounce.
+ *  - A state entered after a debounce does not enter itself again on ENTER, and one entered after
+ *    a pogo debounce leaves on ENTER, so that a debounce failing on the level of the line falls
+ *    back instead of getting stuck.
+ *  - While the pogo line debounces, its standby edge either does nothing or only re-enters the
+ *    current state; pogo_sm_dispatch() keeps the pending timer across it.
+ */
+static void pogo_sm_table(struct kunit *test)
+{
+	const struct pogo_transition *t, *enter, *standby;
+	int state, input;
+
+	for (state = STANDBY; state < ARRAY_SIZE(pogo_transitions); state++) {
+		for (input = 0; input < NR_POGO_INPUTS; input++) {
+			t = pogo_transition_get(state, input);
+			if (t->delay == DELAY_NONE)
+				continue;
+
+			KUNIT_EXPECT_NE_MSG(test, (int)t->next, (int)INVALID_STATE, "%s %s",
+					    pogo_states[state], pogo_inputs[input]);
+			KUNIT_EXPECT_EQ_MSG(test, t->actions, 0U, "%s %s", pogo_states[state],
+					    pogo_inputs[input]);
+
+			enter = pogo_transition_get(t->next, INPUT_ENTER);
+			KUNIT_EXPECT_NE_MSG(test, (int)enter->next, (int)t->next, "%s",
+					    pogo_states[t->next]);
+
+			if (t->delay != DELAY_POGO)
+				continue;
+
+			KUNIT_EXPECT_NE_MSG(test, (int)enter->next, (int)INVALID_STATE, "%s",
+					    pogo_states[t->next]);
+
+			standby = pogo_transition_get(state, INPUT_POGO_STANDBY);
+			KUNIT_EXPECT_EQ_MSG(test, standby->actions, 0U, "%s", pogo_states[state]);
+			KUNIT_EXPECT_EQ_MSG(test, (int)standby->delay, (int)DELAY_NONE, "%s",
+					    pogo_states[state]);
+			if (standby->next != INVALID_STATE)
+				KUNIT_EXPECT_EQ_MSG(test, (int)standby->next, state, "%s",
+						    pogo_states[state]);
+		}
+	}
+}
+
+static struct kunit_case pogo_sm_test_cases[] = {
+	KUNIT_CASE(pogo_sm_dock_undock),
+	KUNIT_CASE(pogo_sm_dock_bounce),
+	KUNIT_CASE(pogo_sm_dock_rebounce),
+	KUNIT_CASE(pogo_sm_dock_with_device),
+	KUNIT_CASE(pogo_sm_h1s_on_off_on),
+	KUNIT_CASE(pogo_sm_h1s_detach_debouncing),
+	KUNIT_CASE(pogo_sm_acc_debounce_fail),
+	KUNIT_CASE(pogo_sm_lc_enter_exit),
+	KUNIT_CASE(pogo_sm_toggle_hub_mux),
+	KUNIT_CASE(pogo_sm_mfg_acc_test),
+	KUNIT_CASE(pogo_sm_path_length),
+	KUNIT_CASE(pogo_sm_dispatch_budget),
+	KUNIT_CASE(pogo_sm_table),
+	{}
+};
+
+static struct kunit_suite pogo_sm_test_suite = {
+	.name = "pogo-transport-sm",
+	.test_cases = pogo_sm_test_cases,
+};
+
+kunit_test_suite(pogo_sm_test_suite);
+
+MODULE_DESCRIPTION("KUnit tests for the Pogo management driver State Machine");
+MODULE_AUTHOR("Google LLC");
+MODULE_LICENSE("GPL");
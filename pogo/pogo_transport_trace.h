@@ -0,0 +1,278 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (C) 2023, Google LLC
+ *
+ * Tracepoints for pogo_transport.
+ *
+ * Latency histograms can be built from these events with synthetic events. All events carry the
+ * device name in "dev", which is used as the key to pair the start and end events.
+ *
+ * IRQ to state change:
+ *   cd /sys/kernel/tracing
+ *   echo 'pogo_irq_to_state u64 lat' >> synthetic_events
+ *   echo 'hist:keys=dev:ts0=common_timestamp.usecs' >> \
+ *	events/pogo_transport/pogo_transport_irq/trigger
+ *   echo 'hist:keys=dev:lat=common_timestamp.usecs-$ts0:onmatch(pogo_transport.pogo_transport_irq).trace(pogo_irq_to_state,$lat) if delay_ms == 0' >> \
+ *	events/pogo_transport/pogo_transport_set_state/trigger
+ *   echo 'hist:keys=lat.log2:sort=lat' >> events/synthetic/pogo_irq_to_state/trigger
+ *
+ * Data path switch to USB enumeration:
+ *   echo 'pogo_switch_to_enum u64 lat' >> synthetic_events
+ *   echo 'hist:keys=dev:ts1=common_timestamp.usecs' >> \
+ *	events/pogo_transport/pogo_transport_switch_path/trigger
+ *   echo 'hist:keys=dev:lat=common_timestamp.usecs-$ts1:onmatch(pogo_transport.pogo_transport_switch_path).trace(pogo_switch_to_enum,$lat)' >> \
+ *	events/pogo_transport/pogo_transport_udev_add/trigger
+ *   echo 'hist:keys=lat.log2:sort=lat' >> events/synthetic/pogo_switch_to_enum/trigger
+ *
+ * The histograms are read from the "hist" file of the synthetic events.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM pogo_transport
+
+#if !defined(_POGO_TRANSPORT_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _POGO_TRANSPORT_TRACE_H
+
+#include <linux/device.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(pogo_transport_irq,
+
+	TP_PROTO(struct device *dev, const char *irq),
+
+	TP_ARGS(dev, irq),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__string(irq, irq)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__assign_str(irq, irq);
+	),
+
+	TP_printk("dev=%s irq=%s", __get_str(dev), __get_str(irq))
+);
+
+/* An IRQ line was masked for an edge storm, or unmasked backoff_ms later */
+TRACE_EVENT(pogo_transport_irq_storm,
+
+	TP_PROTO(struct device *dev, const char *irq, bool masked, u32 edges, u32 backoff_ms),
+
+	TP_ARGS(dev, irq, masked, edges, backoff_ms),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__string(irq, irq)
+		__field(bool, masked)
+		__field(u32, edges)
+		__field(u32, backoff_ms)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__assign_str(irq, irq);
+		__entry->masked = masked;
+		__entry->edges = edges;
+		__entry->backoff_ms = backoff_ms;
+	),
+
+	TP_printk("dev=%s irq=%s masked=%u edges=%u backoff_ms=%u", __get_str(dev), __get_str(irq),
+		  __entry->masked, __entry->edges, __entry->backoff_ms)
+);
+
+TRACE_EVENT(pogo_transport_queue_event,
+
+	TP_PROTO(struct device *dev, unsigned long event, int pos, bool overflow),
+
+	TP_ARGS(dev, event, pos, overflow),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(unsigned long, event)
+		__field(int, pos)
+		__field(bool, overflow)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->event = event;
+		__entry->pos = pos;
+		__entry->overflow = overflow;
+	),
+
+	TP_printk("dev=%s event=%#lx pos=%d overflow=%u", __get_str(dev), __entry->event,
+		  __entry->pos, __entry->overflow)
+);
+
+TRACE_EVENT(pogo_transport_dispatch,
+
+	TP_PROTO(struct device *dev, const char *state, const char *input, const char *next,
+		 unsigned int actions),
+
+	TP_ARGS(dev, state, input, next, actions),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__string(state, state)
+		__string(input, input)
+		__string(next, next)
+		__field(unsigned int, actions)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__assign_str(state, state);
+		__assign_str(input, input);
+		__assign_str(next, next);
+		__entry->actions = actions;
+	),
+
+	TP_printk("dev=%s state=%s input=%s next=%s actions=%#x", __get_str(dev),
+		  __get_str(state), __get_str(input), __get_str(next), __entry->actions)
+);
+
+DECLARE_EVENT_CLASS(pogo_transport_state,
+
+	TP_PROTO(struct device *dev, const char *from, const char *to, unsigned int delay_ms),
+
+	TP_ARGS(dev, from, to, delay_ms),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__string(from, from)
+		__string(to, to)
+		__field(unsigned int, delay_ms)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__assign_str(from, from);
+		__assign_str(to, to);
+		__entry->delay_ms = delay_ms;
+	),
+
+	TP_printk("dev=%s %s -> %s delay_ms=%u", __get_str(dev), __get_str(from), __get_str(to),
+		  __entry->delay_ms)
+);
+
+/* A state change was requested; delayed if delay_ms is not 0 */
+DEFINE_EVENT(pogo_transport_state, pogo_transport_set_state,
+	TP_PROTO(struct device *dev, const char *from, const char *to, unsigned int delay_ms),
+	TP_ARGS(dev, from, to, delay_ms)
+);
+
+/* A delayed state change requested delay_ms ago took effect */
+DEFINE_EVENT(pogo_transport_state, pogo_transport_delayed_state,
+	TP_PROTO(struct device *dev, const char *from, const char *to, unsigned int delay_ms),
+	TP_ARGS(dev, from, to, delay_ms)
+);
+
+TRACE_EVENT(pogo_transport_switch_path,
+
+	TP_PROTO(struct device *dev, const char *path, bool pogo_usb_active, bool usbc_data_active),
+
+	TP_ARGS(dev, path, pogo_usb_active, usbc_data_active),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__string(path, path)
+		__field(bool, pogo_usb_active)
+		__field(bool, usbc_data_active)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__assign_str(path, path);
+		__entry->pogo_usb_active = pogo_usb_active;
+		__entry->usbc_data_active = usbc_data_active;
+	),
+
+	TP_printk("dev=%s path=%s pogo_usb_active=%u usbc_data_active=%u", __get_str(dev),
+		  __get_str(path), __entry->pogo_usb_active, __entry->usbc_data_active)
+);
+
+TRACE_EVENT(pogo_transport_regulator,
+
+	TP_PROTO(struct device *dev, const char *supply, bool enable, int ret),
+
+	TP_ARGS(dev, supply, enable, ret),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__string(supply, supply)
+		__field(bool, enable)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__assign_str(supply, supply);
+		__entry->enable = enable;
+		__entry->ret = ret;
+	),
+
+	TP_printk("dev=%s supply=%s enable=%u ret=%d", __get_str(dev), __get_str(supply),
+		  __entry->enable, __entry->ret)
+);
+
+TRACE_EVENT(pogo_transport_vote,
+
+	TP_PROTO(struct device *dev, const char *election, int reason, int vote, int ret),
+
+	TP_ARGS(dev, election, reason, vote, ret),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__string(election, election)
+		__field(int, reason)
+		__field(int, vote)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__assign_str(election, election);
+		__entry->reason = reason;
+		__entry->vote = vote;
+		__entry->ret = ret;
+	),
+
+	TP_printk("dev=%s election=%s reason=%d vote=%d ret=%d", __get_str(dev),
+		  __get_str(election), __entry->reason, __entry->vote, __entry->ret)
+);
+
+TRACE_EVENT(pogo_transport_udev_add,
+
+	TP_PROTO(struct device *dev, u16 vid, u16 pid, int speed),
+
+	TP_ARGS(dev, vid, pid, speed),
+
+	TP_STRUCT__entry(
+		__string(dev, dev_name(dev))
+		__field(u16, vid)
+		__field(u16, pid)
+		__field(int, speed)
+	),
+
+	TP_fast_assign(
+		__assign_str(dev, dev_name(dev));
+		__entry->vid = vid;
+		__entry->pid = pid;
+		__entry->speed = speed;
+	),
+
+	TP_printk("dev=%s udev=%04X:%04X speed=%d", __get_str(dev), __entry->vid, __entry->pid,
+		  __entry->speed)
+);
+
+#endif /* _POGO_TRANSPORT_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE pogo_transport_trace
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>